@@ -0,0 +1,312 @@
+/*
+ * apex_btb.c
+ * Contains APEX branch target buffer implementation
+ *
+ * Author:
+ * Copyright (c) 2020, Gaurav Kothari (gkothar1@binghamton.edu)
+ * State University of New York at Binghamton
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "apex_btb.h"
+#include "apex_macros.h"
+
+static int
+is_power_of_two(int value)
+{
+    return value > 0 && (value & (value - 1)) == 0;
+}
+
+/*
+ * Maps a PC to its BTB set. Instructions are word aligned, so the low two
+ * bits are dropped and the next index_bits are folded with the bits above
+ * them to spread loop branches that sit a power of two apart.
+ */
+static int
+get_set_index(const APEX_BTB *btb, int pc)
+{
+    unsigned int word = (unsigned int)pc >> 2;
+
+    return (int)((word ^ (word >> btb->index_bits)) & (btb->sets - 1));
+}
+
+/* Marks way as most recently used in the set's pseudo-LRU tree */
+static void
+plru_touch(APEX_BTB *btb, int set, int way)
+{
+    unsigned int tree = btb->plru[set];
+    int node = 1;
+    int level;
+
+    for (level = btb->ways >> 1; level > 0; level >>= 1)
+    {
+        int right = (way & level) ? 1 : 0;
+
+        /* Point the node away from the half just used */
+        if (right)
+        {
+            tree &= ~(1u << node);
+        }
+        else
+        {
+            tree |= (1u << node);
+        }
+        node = node * 2 + right;
+    }
+    btb->plru[set] = tree;
+}
+
+static int
+plru_victim(const APEX_BTB *btb, int set)
+{
+    unsigned int tree = btb->plru[set];
+    int node = 1;
+    int way = 0;
+    int level;
+
+    for (level = btb->ways >> 1; level > 0; level >>= 1)
+    {
+        int right = (tree >> node) & 1;
+
+        way |= right ? level : 0;
+        node = node * 2 + right;
+    }
+    return way;
+}
+
+static void
+touch_entry(APEX_BTB *btb, int set, int way)
+{
+    switch (btb->policy)
+    {
+        case BTB_REPL_LRU:
+        {
+            btb->entries[set * btb->ways + way].stamp = ++btb->tick;
+            break;
+        }
+        case BTB_REPL_PLRU:
+        {
+            plru_touch(btb, set, way);
+            break;
+        }
+    }
+}
+
+/*
+ * Creates an empty BTB of sets x ways entries. sets must be a power of two,
+ * and so must ways when pseudo-LRU replacement is used.
+ *
+ * Returns 0 on success, -1 on a bad geometry or allocation failure
+ */
+int
+btb_init(APEX_BTB *btb, int sets, int ways, int policy)
+{
+    memset(btb, 0, sizeof(APEX_BTB));
+
+    if (!is_power_of_two(sets) || ways <= 0 || ways > BTB_MAX_WAYS)
+    {
+        return -1;
+    }
+    if (policy == BTB_REPL_PLRU && !is_power_of_two(ways))
+    {
+        return -1;
+    }
+    if (policy != BTB_REPL_FIFO && policy != BTB_REPL_LRU
+        && policy != BTB_REPL_PLRU)
+    {
+        return -1;
+    }
+
+    btb->sets = sets;
+    btb->ways = ways;
+    btb->policy = policy;
+    while ((1 << btb->index_bits) < sets)
+    {
+        btb->index_bits++;
+    }
+
+    btb->entries = calloc(sets * ways, sizeof(BTB));
+    btb->plru = calloc(sets, sizeof(unsigned int));
+    if (!btb->entries || !btb->plru)
+    {
+        btb_free(btb);
+        return -1;
+    }
+    return 0;
+}
+
+void
+btb_free(APEX_BTB *btb)
+{
+    free(btb->entries);
+    free(btb->plru);
+    btb->entries = NULL;
+    btb->plru = NULL;
+}
+
+/* Invalidates every entry, keeping the geometry */
+void
+btb_reset(APEX_BTB *btb)
+{
+    memset(btb->entries, 0, sizeof(BTB) * btb->sets * btb->ways);
+    memset(btb->plru, 0, sizeof(unsigned int) * btb->sets);
+    btb->tick = 0;
+}
+
+/*
+ * Searches the set that pc maps to. A hit updates the replacement state.
+ *
+ * Returns the matching entry, or NULL on a miss
+ */
+BTB *
+btb_lookup(APEX_BTB *btb, int pc)
+{
+    int set = get_set_index(btb, pc);
+    BTB *row = &btb->entries[set * btb->ways];
+    int way;
+
+    for (way = 0; way < btb->ways; ++way)
+    {
+        if (row[way].valid && row[way].inst_address == pc)
+        {
+            touch_entry(btb, set, way);
+            return &row[way];
+        }
+    }
+    return NULL;
+}
+
+/*
+ * Installs pc in its set, evicting a victim chosen by the replacement policy
+ * when every way is valid. The returned entry is cleared apart from its tag.
+ */
+BTB *
+btb_allocate(APEX_BTB *btb, int pc)
+{
+    int set = get_set_index(btb, pc);
+    BTB *row = &btb->entries[set * btb->ways];
+    int victim = -1;
+    int way;
+
+    for (way = 0; way < btb->ways; ++way)
+    {
+        if (!row[way].valid)
+        {
+            victim = way;
+            break;
+        }
+    }
+
+    if (victim < 0)
+    {
+        if (btb->policy == BTB_REPL_PLRU)
+        {
+            victim = plru_victim(btb, set);
+        }
+        else
+        {
+            /* Oldest insertion for FIFO, oldest use for LRU */
+            victim = 0;
+            for (way = 1; way < btb->ways; ++way)
+            {
+                if (row[way].stamp < row[victim].stamp)
+                {
+                    victim = way;
+                }
+            }
+        }
+    }
+
+    memset(&row[victim], 0, sizeof(BTB));
+    row[victim].valid = TRUE;
+    row[victim].inst_address = pc;
+    row[victim].stamp = ++btb->tick;
+    if (btb->policy == BTB_REPL_PLRU)
+    {
+        plru_touch(btb, set, victim);
+    }
+    return &row[victim];
+}
+
+/* Returns the BTB_REPL_* value for name, or -1 if it is not recognised */
+int
+btb_policy_from_string(const char *name)
+{
+    if (strcmp(name, "fifo") == 0)
+    {
+        return BTB_REPL_FIFO;
+    }
+    if (strcmp(name, "lru") == 0)
+    {
+        return BTB_REPL_LRU;
+    }
+    if (strcmp(name, "plru") == 0)
+    {
+        return BTB_REPL_PLRU;
+    }
+    return -1;
+}
+
+const char *
+btb_policy_name(int policy)
+{
+    switch (policy)
+    {
+        case BTB_REPL_LRU:
+            return "lru";
+        case BTB_REPL_PLRU:
+            return "plru";
+        default:
+            return "fifo";
+    }
+}
+
+/*
+ * Writes the geometry, replacement state and every entry to fp
+ *
+ * Returns 0 on success, -1 on a write error
+ */
+int
+btb_save(const APEX_BTB *btb, FILE *fp)
+{
+    int geometry[3] = {btb->sets, btb->ways, btb->policy};
+
+    if (fwrite(geometry, sizeof(geometry), 1, fp) != 1
+        || fwrite(&btb->tick, sizeof(btb->tick), 1, fp) != 1
+        || fwrite(btb->entries, sizeof(BTB), btb->sets * btb->ways, fp)
+           != (size_t)(btb->sets * btb->ways)
+        || fwrite(btb->plru, sizeof(unsigned int), btb->sets, fp) != (size_t)btb->sets)
+    {
+        return -1;
+    }
+    return 0;
+}
+
+/*
+ * Reads back a BTB written by btb_save into one created with the same
+ * geometry and policy
+ *
+ * Returns 0 on success, -1 on a read error or a geometry mismatch
+ */
+int
+btb_load(APEX_BTB *btb, FILE *fp)
+{
+    int geometry[3];
+
+    if (fread(geometry, sizeof(geometry), 1, fp) != 1
+        || geometry[0] != btb->sets || geometry[1] != btb->ways
+        || geometry[2] != btb->policy)
+    {
+        return -1;
+    }
+    if (fread(&btb->tick, sizeof(btb->tick), 1, fp) != 1
+        || fread(btb->entries, sizeof(BTB), btb->sets * btb->ways, fp)
+           != (size_t)(btb->sets * btb->ways)
+        || fread(btb->plru, sizeof(unsigned int), btb->sets, fp) != (size_t)btb->sets)
+    {
+        return -1;
+    }
+    return 0;
+}
@@ -0,0 +1,49 @@
+/*
+ * apex_btb.h
+ * Contains APEX branch target buffer declarations
+ *
+ * Author:
+ * Copyright (c) 2020, Gaurav Kothari (gkothar1@binghamton.edu)
+ * State University of New York at Binghamton
+ */
+#ifndef _APEX_BTB_H_
+#define _APEX_BTB_H_
+
+#include <stdio.h>
+
+/* Replacement policies for a BTB set */
+#define BTB_REPL_FIFO 0
+#define BTB_REPL_LRU 1
+#define BTB_REPL_PLRU 2
+
+typedef struct BTB
+{
+    int valid;
+    int inst_address;
+    int target_address;
+    int num_executed; //number of times branch was executed irrespective of taken,  not taken
+    unsigned long stamp; // insertion time for FIFO, last use for LRU
+} BTB;
+
+/* Set-associative BTB, entries are stored set by set */
+typedef struct APEX_BTB
+{
+    int sets;
+    int ways;
+    int policy;
+    int index_bits;
+    unsigned long tick;
+    BTB *entries;          /* sets * ways entries */
+    unsigned int *plru;    /* one tree of (ways - 1) bits per set */
+} APEX_BTB;
+
+int btb_init(APEX_BTB *btb, int sets, int ways, int policy);
+void btb_free(APEX_BTB *btb);
+void btb_reset(APEX_BTB *btb);
+BTB *btb_lookup(APEX_BTB *btb, int pc);
+BTB *btb_allocate(APEX_BTB *btb, int pc);
+int btb_policy_from_string(const char *name);
+const char *btb_policy_name(int policy);
+int btb_save(const APEX_BTB *btb, FILE *fp);
+int btb_load(APEX_BTB *btb, FILE *fp);
+#endif
@@ -0,0 +1,168 @@
+/*
+ * apex_checkpoint.c
+ * Contains APEX CPU checkpoint save and restore
+ *
+ * Author:
+ * Copyright (c) 2020, Gaurav Kothari (gkothar1@binghamton.edu)
+ * State University of New York at Binghamton
+ */
+#include <stdio.h>
+#include <string.h>
+
+#include "apex_checkpoint.h"
+#include "apex_ooo.h"
+
+/* FNV-1a over the decoded fields, so padding never affects the result */
+static uint32_t
+code_checksum(const APEX_CPU *cpu)
+{
+    uint32_t hash = 2166136261u;
+    int i;
+
+    for (i = 0; i < cpu->code_memory_size; ++i)
+    {
+        const APEX_Instruction *ins = &cpu->code_memory[i];
+        int fields[5] = {ins->opcode, ins->rd, ins->rs1, ins->rs2, ins->imm};
+        const unsigned char *bytes = (const unsigned char *)fields;
+        size_t b;
+
+        for (b = 0; b < sizeof(fields); ++b)
+        {
+            hash = (hash ^ bytes[b]) * 16777619u;
+        }
+    }
+    return hash;
+}
+
+static void
+fill_header(const APEX_CPU *cpu, checkpoint_header *header)
+{
+    memset(header, 0, sizeof(checkpoint_header));
+    memcpy(header->magic, CHECKPOINT_MAGIC, sizeof(header->magic));
+    header->version = CHECKPOINT_VERSION;
+    header->stage_size = sizeof(CPU_Stage);
+    header->code_size = cpu->code_memory_size;
+    header->code_checksum = code_checksum(cpu);
+    header->core = cpu->ooo ? CORE_OOO : CORE_INORDER;
+}
+
+static int
+transfer_block(void *ptr, size_t size, FILE *fp, int save)
+{
+    size_t done = save ? fwrite(ptr, size, 1, fp) : fread(ptr, size, 1, fp);
+
+    return done == 1 ? 0 : -1;
+}
+
+/* Reads or writes the CPU section */
+static int
+transfer_cpu(APEX_CPU *cpu, FILE *fp, int save)
+{
+    int ret = 0;
+
+    ret |= transfer_block(&cpu->pc, sizeof(cpu->pc), fp, save);
+    ret |= transfer_block(&cpu->clock, sizeof(cpu->clock), fp, save);
+    ret |= transfer_block(&cpu->insn_completed, sizeof(cpu->insn_completed), fp, save);
+    ret |= transfer_block(&cpu->insn_fast_forwarded, sizeof(cpu->insn_fast_forwarded), fp, save);
+    ret |= transfer_block(cpu->regs, sizeof(cpu->regs), fp, save);
+    ret |= transfer_block(cpu->regs_writing, sizeof(cpu->regs_writing), fp, save);
+    ret |= transfer_block(&cpu->zero_flag, sizeof(cpu->zero_flag), fp, save);
+    ret |= transfer_block(&cpu->fetch_from_next_cycle, sizeof(cpu->fetch_from_next_cycle), fp, save);
+    ret |= transfer_block(&cpu->cc, sizeof(cpu->cc), fp, save);
+    ret |= transfer_block(&cpu->fetch, sizeof(CPU_Stage), fp, save);
+    ret |= transfer_block(&cpu->decode, sizeof(CPU_Stage), fp, save);
+    ret |= transfer_block(&cpu->execute, sizeof(CPU_Stage), fp, save);
+    ret |= transfer_block(&cpu->memory, sizeof(CPU_Stage), fp, save);
+    ret |= transfer_block(&cpu->writeback, sizeof(CPU_Stage), fp, save);
+    return ret;
+}
+
+/*
+ * Writes the complete simulation state of cpu to path. It can be taken at
+ * any cycle boundary, with instructions in flight.
+ *
+ * Returns 0 on success, -1 on an I/O error
+ */
+int
+APEX_checkpoint_save(const APEX_CPU *cpu, const char *path)
+{
+    checkpoint_header header;
+    FILE *fp = fopen(path, "wb");
+    int ret;
+
+    if (!fp)
+    {
+        return -1;
+    }
+
+    fill_header(cpu, &header);
+    ret = transfer_block(&header, sizeof(header), fp, TRUE);
+    ret |= transfer_cpu((APEX_CPU *)cpu, fp, TRUE);
+    ret |= memory_save(&cpu->data_memory, fp);
+    ret |= btb_save(&cpu->btb, fp);
+    ret |= predictor_save(&cpu->predictor, fp);
+    ret |= indirect_save(&cpu->indirect, fp);
+    ret |= ras_save(&cpu->ras, fp);
+    ret |= ras_save(&cpu->ras_resolved, fp);
+    ret |= ftq_save(&cpu->ftq, fp);
+    if (cpu->ooo)
+    {
+        ret |= ooo_save(cpu->ooo, fp);
+    }
+    ret |= stats_save(&cpu->stats, fp);
+
+    if (fclose(fp) != 0)
+    {
+        ret = -1;
+    }
+    return ret;
+}
+
+/*
+ * Restores a checkpoint into cpu, which must have been created from the same
+ * program with the same BTB, predictor, indirect predictor, return address
+ * stack, fetch target queue and core configuration. Simulation then continues from
+ * the cycle after the one the checkpoint was taken at.
+ *
+ * Returns 0 on success, CHECKPOINT_ERR_OPEN if the file cannot be opened or
+ * CHECKPOINT_ERR_MISMATCH if it is from another version, truncated or does
+ * not match cpu. cpu is left partially restored on a mismatch.
+ */
+int
+APEX_checkpoint_restore(APEX_CPU *cpu, const char *path)
+{
+    checkpoint_header expected;
+    checkpoint_header header;
+    FILE *fp = fopen(path, "rb");
+    int ret;
+
+    if (!fp)
+    {
+        return CHECKPOINT_ERR_OPEN;
+    }
+
+    fill_header(cpu, &expected);
+    if (transfer_block(&header, sizeof(header), fp, FALSE) != 0
+        || memcmp(&header, &expected, sizeof(header)) != 0)
+    {
+        fclose(fp);
+        return CHECKPOINT_ERR_MISMATCH;
+    }
+
+    ret = transfer_cpu(cpu, fp, FALSE);
+    ret |= memory_load(&cpu->data_memory, fp);
+    ret |= btb_load(&cpu->btb, fp);
+    ret |= predictor_load(&cpu->predictor, fp);
+    ret |= indirect_load(&cpu->indirect, fp);
+    ret |= ras_load(&cpu->ras, fp);
+    ret |= ras_load(&cpu->ras_resolved, fp);
+    ret |= ftq_load(&cpu->ftq, fp);
+    if (cpu->ooo)
+    {
+        ret |= ooo_load(cpu->ooo, fp);
+    }
+    ret |= stats_load(&cpu->stats, fp);
+
+    fclose(fp);
+    return ret != 0 ? CHECKPOINT_ERR_MISMATCH : 0;
+}
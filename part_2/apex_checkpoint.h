@@ -0,0 +1,44 @@
+/*
+ * apex_checkpoint.h
+ * Contains APEX CPU checkpoint file declarations
+ *
+ * Author:
+ * Copyright (c) 2020, Gaurav Kothari (gkothar1@binghamton.edu)
+ * State University of New York at Binghamton
+ */
+#ifndef _APEX_CHECKPOINT_H_
+#define _APEX_CHECKPOINT_H_
+
+#include <stdint.h>
+
+#include "apex_cpu.h"
+
+#define CHECKPOINT_MAGIC "APXC"
+
+/* Bump whenever the layout of a section or of CPU_Stage changes */
+#define CHECKPOINT_VERSION 10
+
+/* APEX_checkpoint_restore failures */
+#define CHECKPOINT_ERR_OPEN -1         /* file missing or unreadable, errno says why */
+#define CHECKPOINT_ERR_MISMATCH -2     /* another version, program or configuration */
+
+/*
+ * A checkpoint is this header followed by the CPU section (architectural
+ * state, scoreboard, condition codes and the five stage latches), then the
+ * data memory, BTB, predictor, indirect predictor, return address stack,
+ * fetch target queue, out-of-order core (when there is one) and statistics
+ * sections written by their own modules. Fields are in host byte order.
+ */
+typedef struct checkpoint_header
+{
+    char magic[4];
+    uint32_t version;
+    uint32_t stage_size;           /* sizeof(CPU_Stage) of the writer */
+    uint32_t code_size;            /* instructions in the program */
+    uint32_t code_checksum;        /* of the pre-decoded program */
+    uint32_t core;                 /* CORE_* back end of the writer */
+} checkpoint_header;
+
+int APEX_checkpoint_save(const APEX_CPU *cpu, const char *path);
+int APEX_checkpoint_restore(APEX_CPU *cpu, const char *path);
+#endif
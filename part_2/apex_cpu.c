@@ -7,11 +7,15 @@
  * State University of New York at Binghamton
  */
 //final dimple 
+#include <errno.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
 #include "apex_cpu.h"
+#include "apex_functional.h"
+#include "apex_checkpoint.h"
+#include "apex_ooo.h"
 #include "apex_macros.h"
 
 /* Converts the PC(4000 series) into array index for code memory
@@ -21,94 +25,14 @@
 static int
 get_code_memory_index_from_pc(const int pc)
 {
-    return (pc - 4000) / 4;
-}
-
-typedef struct {
-    int prediction_state;
-    int history_state;
-} PredictionResult;
-
-void predict_and_update_btb(BTB *btb_entry, int outcome, int type, PredictionResult *result) {
-    
-    int prediction_state = btb_entry->prediction_state;
-    int history_prediction = btb_entry->history_state;
-    /* Update prediction state based on the outcome and type */
-    if (outcome == TAKEN && type == 0) //bnz bp
-    {
-        if (history_prediction == 2)
-            history_prediction = 3;
-        else if (history_prediction == 1)
-            history_prediction = 2;
-        else if (history_prediction == 3)
-            history_prediction = 3;
-        else if (history_prediction == 0)
-            history_prediction = 1;
-    } 
-    else if (outcome == NOT_TAKEN && type == 0) 
-    {
-        if (history_prediction == 1)
-            history_prediction = 0;
-        else if (history_prediction == 3)
-            history_prediction = 2;
-        else if (history_prediction == 0)
-            history_prediction = 0;
-        else if (history_prediction == 2)
-            history_prediction = 1;
-    } 
-    else if (outcome == TAKEN && type == 1) // bz bnp
-    {
-        if (history_prediction == 2)
-            history_prediction = 3;
-        else if (history_prediction == 1)
-            history_prediction = 2;
-        else if (history_prediction == 3)
-            history_prediction = 3;
-        else if (history_prediction == 0)
-            history_prediction = 1;
-        
-    } 
-    else if (outcome == NOT_TAKEN && type == 1) 
-    {
-        if (history_prediction == 1)
-            history_prediction = 0;
-        else if (history_prediction == 3)
-            history_prediction = 2;
-        else if (history_prediction == 0)
-            history_prediction = 0;
-        else if (history_prediction == 2)
-            history_prediction = 1;
-    }
-
-    if((history_prediction == 0 || history_prediction == 1 ) && type == 1) //bz bnp
-    {
-        prediction_state = 0;
-    }
-    else if((history_prediction == 3 || history_prediction == 2) && type == 1)
-    {
-        prediction_state = 1;
-    }
-    else if((history_prediction == 3  || history_prediction == 2) && type == 0) //bnz bp
-    {
-        prediction_state = 1;
-    }
-    else if((history_prediction == 0 || history_prediction == 1) && type == 0)
-    {
-        prediction_state = 0;
-    }
-
-    /* Update the BTB entry with the new prediction state */
-    btb_entry->prediction_state = prediction_state;
-    btb_entry->history_state = history_prediction;
-
-    result->prediction_state = prediction_state;
-    result->history_state = history_prediction;
-
+    return (pc - CODE_MEMORY_BASE) / 4;
 }
 
+/* Writes the instruction in stage as assembly text to buf */
 static void
-print_instruction(const CPU_Stage *stage)
+format_instruction(char *buf, size_t size, const CPU_Stage *stage)
 {
+    buf[0] = '\0';
     switch (stage->opcode)
     {
         case OPCODE_ADD:
@@ -119,8 +43,8 @@ print_instruction(const CPU_Stage *stage)
         case OPCODE_OR:
         case OPCODE_XOR:
         {
-            printf("%s,R%d,R%d,R%d ", stage->opcode_str, stage->rd, stage->rs1,
-                   stage->rs2);
+            snprintf(buf, size, "%s,R%d,R%d,R%d ", get_opcode_name(stage->opcode), stage->rd, stage->rs1,
+                     stage->rs2);
             break;
         }
 
@@ -128,31 +52,31 @@ print_instruction(const CPU_Stage *stage)
         case OPCODE_SUBL:
         case OPCODE_JALR:
         {
-            printf("%s,R%d,R%d,#%d ", stage->opcode_str, stage->rd, stage->rs1,
-                   stage->imm);
+            snprintf(buf, size, "%s,R%d,R%d,#%d ", get_opcode_name(stage->opcode), stage->rd, stage->rs1,
+                     stage->imm);
             break;
         }
 
 
         case OPCODE_MOVC:
         {
-            printf("%s,R%d,#%d ", stage->opcode_str, stage->rd, stage->imm);
+            snprintf(buf, size, "%s,R%d,#%d ", get_opcode_name(stage->opcode), stage->rd, stage->imm);
             break;
         }
 
         case OPCODE_LOAD:
         case OPCODE_LOADP:
         {
-            printf("%s,R%d,R%d,#%d ", stage->opcode_str, stage->rd, stage->rs1,
-                   stage->imm);
+            snprintf(buf, size, "%s,R%d,R%d,#%d ", get_opcode_name(stage->opcode), stage->rd, stage->rs1,
+                     stage->imm);
             break;
         }
 
         case OPCODE_STORE:
         case OPCODE_STOREP:
         {
-            printf("%s,R%d,R%d,#%d ", stage->opcode_str, stage->rs1, stage->rs2,
-                   stage->imm);
+            snprintf(buf, size, "%s,R%d,R%d,#%d ", get_opcode_name(stage->opcode), stage->rs1, stage->rs2,
+                     stage->imm);
             break;
         }
 
@@ -163,30 +87,30 @@ print_instruction(const CPU_Stage *stage)
         case OPCODE_BN:
         case OPCODE_BNN:
         {
-            printf("%s,#%d ", stage->opcode_str, stage->imm);
+            snprintf(buf, size, "%s,#%d ", get_opcode_name(stage->opcode), stage->imm);
             break;
         }
 
 
         case OPCODE_HALT:
         {
-            printf("%s", stage->opcode_str);
+            snprintf(buf, size, "%s", get_opcode_name(stage->opcode));
             break;
         }
         case OPCODE_NOP:
         {
-            printf("%s", stage->opcode_str);
+            snprintf(buf, size, "%s", get_opcode_name(stage->opcode));
             break;
         }
         case OPCODE_CML:
         case OPCODE_JUMP:
         {
-            printf("%s,R%d,#%d", stage->opcode_str,stage->rs1,stage->imm);
+            snprintf(buf, size, "%s,R%d,#%d", get_opcode_name(stage->opcode),stage->rs1,stage->imm);
             break;
         }
         case OPCODE_CMP:
         {
-            printf("%s,R%d,R%d", stage->opcode_str,stage->rs1,stage->rs2);
+            snprintf(buf, size, "%s,R%d,R%d", get_opcode_name(stage->opcode),stage->rs1,stage->rs2);
             break;
         }
     }
@@ -196,7 +120,17 @@ print_instruction(const CPU_Stage *stage)
  *
  * Note: You can edit this function to print in more detail
  */
+
 static void
+print_instruction(const CPU_Stage *stage)
+{
+    char text[64];
+
+    format_instruction(text, sizeof(text), stage);
+    printf("%s", text);
+}
+
+void
 print_stage_content(const char *name, const CPU_Stage *stage)
 {
 
@@ -235,15 +169,144 @@ print_reg_file(const APEX_CPU *cpu)
     printf("\n");
     printf("\n \n \n");
     printf("----------\n%s\n----------\n", "MEMORY:");
-    for (int i =0; i<cpu->data_counter; ++i){
-        printf("\nMemory[%d]= %d\n", cpu->mem_address[i],cpu->data_memory[cpu->mem_address[i]]);
-    }
+    memory_dump(&cpu->data_memory, stdout);
     printf("\n\n");
 }
 
+/*
+ * Applies a JUMP or JALR being predicted at pc to the fetch side return
+ * address stack. A JUMP through a register some call linked through is taken
+ * to be a return to the most recent call.
+ *
+ * Returns TRUE with the predicted target in *target for such a return
+ */
+static int
+predict_return(APEX_CPU *cpu, const APEX_Instruction *ins, int pc, int *target)
+{
+    const ras_entry *top;
+
+    if (ins->opcode == OPCODE_JALR)
+    {
+        ras_push(&cpu->ras, pc + 4, ins->rd);
+        return FALSE;
+    }
+    if (!ras_is_return(&cpu->ras, ins->rs1))
+    {
+        return FALSE;
+    }
+    top = ras_top(&cpu->ras);
+    if (!top)
+    {
+        return FALSE;
+    }
+    *target = top->address + ins->imm;
+    ras_pop(&cpu->ras);
+    return TRUE;
+}
+
+/*
+ * Predicts the target of a JUMP or JALR into entry. Returns come from the
+ * return address stack, every other jump from the indirect target predictor,
+ * which is consulted for all of them so execute can train it.
+ *
+ * Returns TRUE if prediction should carry on at entry->pred_target
+ */
+static int
+predict_jump(APEX_CPU *cpu, const APEX_Instruction *ins, ftq_entry *entry)
+{
+    int hit;
+
+    if (ins->opcode != OPCODE_JUMP && ins->opcode != OPCODE_JALR)
+    {
+        return FALSE;
+    }
+    hit = indirect_predict(&cpu->indirect, entry->pc, &entry->pred_target, &entry->pred_meta);
+    return predict_return(cpu, ins, entry->pc, &entry->pred_target) || hit;
+}
+
+/*
+ * Predicts the instruction at entry->pc, whose opcode and operand classes
+ * are known from pre-decode: the BTB target is followed when the direction
+ * predictor says taken, and a predicted target for a JUMP or JALR.
+ */
+static void
+predict_fetch_target(APEX_CPU *cpu, ftq_entry *entry)
+{
+    const APEX_Instruction *ins = &cpu->code_memory[get_code_memory_index_from_pc(entry->pc)];
+    BTB *btb_entry = NULL;
+
+    entry->pred_taken = NOT_TAKEN;
+    if (ins->flags & INSN_PREDICTED)
+    {
+        btb_entry = btb_lookup(&cpu->btb, entry->pc);
+        stats_record_lookup(&cpu->stats, entry->pc, btb_entry != NULL);
+        if (btb_entry != NULL)
+        {
+            RECORD_EVENT(cpu, EVENT_BTB_HIT, entry->pc, ins->opcode,
+                         btb_entry->target_address);
+        }
+        entry->pred_taken = predictor_predict(&cpu->predictor, entry->pc, &entry->pred_meta);
+    }
+    if (btb_entry != NULL && entry->pred_taken == TAKEN && btb_entry->num_executed > 0
+        && btb_entry->target_address != 0)
+    {
+        entry->followed = TRUE;
+        entry->pred_target = btb_entry->target_address;
+    }
+    else
+    {
+        entry->followed = predict_jump(cpu, ins, entry);
+    }
+    entry->next_pc = entry->followed ? entry->pred_target : entry->pc + 4;
+}
+
+/*
+ * Branch prediction unit, decoupled from fetch by the fetch target queue.
+ * Each cycle it predicts the instruction at cpu->pc into the queue and moves
+ * cpu->pc on to the next one. With a queue depth it keeps going while decode
+ * holds fetch, until the queue is full; with depth 0 it only predicts what
+ * fetch takes in the same cycle. It stops after a HALT, or at a pc outside
+ * code memory, until a redirect.
+ */
+static void
+APEX_predict(APEX_CPU *cpu)
+{
+    int fetch_ready = !cpu->fetch.stalled && !cpu->fetch_from_next_cycle;
+    ftq_entry *entry;
+
+    if (cpu->draining || !cpu->fetch.has_insn || cpu->ftq.stopped
+        || ftq_full(&cpu->ftq) || (cpu->ftq.depth == 0 && !fetch_ready))
+    {
+        return;
+    }
+    if (cpu->pc < CODE_MEMORY_BASE
+        || get_code_memory_index_from_pc(cpu->pc) >= cpu->code_memory_size)
+    {
+        return;
+    }
+
+    entry = ftq_push(&cpu->ftq);
+    entry->pc = cpu->pc;
+    entry->cycle = cpu->clock;
+    predict_fetch_target(cpu, entry);
+    cpu->pc = entry->next_pc;
+
+    /* Nothing after a HALT is fetched */
+    cpu->ftq.stopped = cpu->code_memory[get_code_memory_index_from_pc(entry->pc)].opcode
+                       == OPCODE_HALT;
+    cpu->stats.ftq.predictions++;
+    if (!fetch_ready)
+    {
+        cpu->stats.ftq.run_ahead++;
+    }
+}
+
 /*
  * Fetch Stage of APEX Pipeline
  *
+ * Fetches the oldest instruction in the fetch target queue, with the
+ * prediction made for it, and passes it to decode.
+ *
  * Note: You are free to edit this function according to your implementation
  */
 
@@ -251,111 +314,83 @@ static void
 APEX_fetch(APEX_CPU *cpu)
 {
     APEX_Instruction *current_ins;
+    const ftq_entry *entry;
+
+    if (cpu->draining)
+    {
+        /* Decode only empties when fetch replaces its instruction, so retire
+         * the one it just passed on instead of fetching a new one */
+        if (cpu->fetch.stalled == 0)
+        {
+            cpu->decode.has_insn = FALSE;
+        }
+        return;
+    }
+
     if (cpu->fetch.has_insn)
     {    
         cpu->fetch.btb_searched = 0;
         
         /* This fetches new branch target instruction from next cycle */
-        if (cpu->fetch_from_next_cycle == TRUE && cpu->fetch.btb_searched ==0)
+        if (cpu->fetch_from_next_cycle == TRUE)
         {
             
             cpu->fetch_from_next_cycle = FALSE;
 
+            /* A branch decode redirected has moved on, nothing replaces it */
+            if (cpu->fetch.stalled == 0)
+            {
+                cpu->decode.has_insn = FALSE;
+            }
+
             /* Skip this cycle*/
             return;
         }
 
-        /* Store current PC in fetch latch */
-        cpu->fetch.pc = cpu->pc;
-        if(cpu->fetch.stalled == 0 )
-        {  
-        
+        /* Store the PC of the oldest prediction in fetch latch */
+        entry = ftq_head(&cpu->ftq);
+        cpu->fetch.pc = entry ? entry->pc : cpu->pc;
+        if (cpu->fetch.stalled == 0 && entry == NULL)
+        {
+            /* Nothing predicted yet, decode gets a bubble */
+            cpu->stats.ftq.empty++;
+            cpu->decode.has_insn = FALSE;
+        }
+        else if (cpu->fetch.stalled == 0)
+        {
           /* Index into code memory using this pc and copy all instruction fields
-           * into fetch latch  */
-          current_ins = &cpu->code_memory[get_code_memory_index_from_pc(cpu->pc)];
-          strcpy(cpu->fetch.opcode_str, current_ins->opcode_str);
+           * into fetch latch, along with the prediction made for it */
+          current_ins = &cpu->code_memory[get_code_memory_index_from_pc(entry->pc)];
           cpu->fetch.opcode = current_ins->opcode;
+          cpu->fetch.flags = current_ins->flags;
           cpu->fetch.rd = current_ins->rd;
           cpu->fetch.rs1 = current_ins->rs1;
           cpu->fetch.rs2 = current_ins->rs2;
           cpu->fetch.imm = current_ins->imm;
-          for (int i = 0; i < cpu->btb_queue.size; i++) 
-            {   
-                int index = (cpu->btb_queue.head + i) % cpu->btb_queue.size;
-                if (cpu->pc == cpu->btb_queue.data[index].inst_address && cpu->btb_queue.data[index].num_executed > 0 && cpu->fetch.type_of_branch== 0 && cpu->btb_queue.data[index].prediction_state == 1 && cpu->btb_queue.data[index].target_address != 0) 
-                {   
-                    
-                    
-                    cpu->fetch.btb_searched = 1;
-                    cpu->pc = cpu->btb_queue.data[index].target_address;
-                    cpu->decode = cpu->fetch; //sending branch to decode so that fetch is updated to target address
-
-                    if(cpu->fetch.stalled == 0)
-                    {
-
-                        /* Stop fetching new instructions if HALT is fetched */
-                        if (cpu->fetch.opcode == OPCODE_HALT)
-                        {
-                            cpu->fetch.has_insn = FALSE;
-                        }
-                    }
-                    if (ENABLE_DEBUG_MESSAGES)
-                    {
-                        print_stage_content("Fetch", &cpu->fetch);
-                    }
-
-                    return;
-                
-                }
-                else if (cpu->pc == cpu->btb_queue.data[index].inst_address && cpu->btb_queue.data[index].num_executed > 0 && cpu->fetch.type_of_branch== 1 && cpu->btb_queue.data[index].prediction_state == 1 && cpu->btb_queue.data[index].target_address != 0) 
-                {   
-                    
-                    cpu->fetch.btb_searched = 1;
-                    cpu->pc = cpu->btb_queue.data[index].target_address;
-                    cpu->decode = cpu->fetch; //sending branch to decode so that fetch is updated to target address
-                    
-                    if(cpu->fetch.stalled == 0)
-                    {
-
-                        /* Stop fetching new instructions if HALT is fetched */
-                        if (cpu->fetch.opcode == OPCODE_HALT)
-                        {
-                            cpu->fetch.has_insn = FALSE;
-                        }
-                    }
-                    if (ENABLE_DEBUG_MESSAGES)
-                    {
-                        print_stage_content("Fetch", &cpu->fetch);
-                    }
-
-                    return;
-                
-                }
-
-                
-            }
-        }
-            
-        if(cpu->fetch.stalled == 0 && cpu->fetch.btb_searched==0)
-        {
-            /* Update PC for next instruction */
-            cpu->pc += 4;
-
-            /* Copy data from fetch latch to decode latch*/
+          cpu->fetch.pred_taken = entry->pred_taken;
+          cpu->fetch.pred_meta = entry->pred_meta;
+          cpu->fetch.pred_target = entry->pred_target;
+          cpu->fetch.btb_searched = entry->followed;
+          if (cpu->kanata)
+          {
+              char text[64];
 
-              cpu->decode = cpu->fetch;
-        }
+              format_instruction(text, sizeof(text), &cpu->fetch);
+              cpu->fetch.seq = kanata_fetch(cpu->kanata, cpu->clock, text);
+          }
+          RECORD_EVENT(cpu, EVENT_FETCH, cpu->fetch.pc, cpu->fetch.opcode, entry->next_pc);
+          ftq_pop(&cpu->ftq);
 
-        if(cpu->fetch.stalled == 0)
-        {
+          /* Copy data from fetch latch to decode latch*/
+          cpu->decode = cpu->fetch;
 
-            /* Stop fetching new instructions if HALT is fetched */
-            if (cpu->fetch.opcode == OPCODE_HALT)
-            {
-                cpu->fetch.has_insn = FALSE;
-            }
+          /* Stop fetching new instructions if HALT is fetched */
+          if (cpu->fetch.opcode == OPCODE_HALT)
+          {
+              cpu->fetch.has_insn = FALSE;
+          }
         }
-        if (ENABLE_DEBUG_MESSAGES)
+        if (DEBUG_ON(cpu))
         {
         print_stage_content("Fetch", &cpu->fetch);
         }
@@ -365,428 +400,266 @@ APEX_fetch(APEX_CPU *cpu)
 }
 
 /*
- * Decode Stage of APEX Pipeline
+ * One fetch slot of the front end: the branch prediction unit, then fetch,
+ * which leaves the instruction it delivered in cpu->decode. The five stage
+ * pipeline runs one slot a cycle, a wider back end runs several.
+ */
+void
+APEX_fetch_slot(APEX_CPU *cpu)
+{
+    APEX_predict(cpu);
+    APEX_fetch(cpu);
+}
+
+/*
+ * Reads source register reg for decode: from the forwarding network when an
+ * instruction in flight produces it, otherwise from the register file once
+ * no older instruction is still writing it
  *
- * Note: You are free to edit this function according to your implementation
+ * Returns TRUE once the value is in *value
  */
-static void
-APEX_decode(APEX_CPU *cpu)
+static int
+read_source(APEX_CPU *cpu, int reg, int *value)
 {
-    if (cpu->decode.has_insn)
+    switch (forward_lookup(&cpu->forward, reg, value))
+    {
+        case FORWARD_MISS:
+            break;
+        case FORWARD_PENDING:
+            return FALSE;
+        default:
+            return TRUE;
+    }
+    if (cpu->regs_writing[reg])
+    {
+        return FALSE;
+    }
+    *value = cpu->regs[reg];
+    return TRUE;
+}
+
+/*
+ * Resolves the sources named by the decode latch's operand signature, its
+ * INSN_READS_* flags, and once all of them are found claims the registers
+ * named by its INSN_WRITES_* flags in the scoreboard. Every instruction class
+ * goes through these same reads, so whether decode stalls depends only on
+ * which registers are read and what is in flight, never on the opcode.
+ *
+ * Returns TRUE if the instruction can leave decode this cycle
+ */
+static int
+decode_operands(APEX_CPU *cpu)
+{
+    CPU_Stage *stage = &cpu->decode;
+    int flags = stage->flags;
+
+    if ((flags & INSN_READS_RS1) && !stage->rs1_f)
+    {
+        stage->rs1_f = read_source(cpu, stage->rs1, &stage->rs1_value);
+    }
+    if ((flags & INSN_READS_RS2) && !stage->rs2_f)
+    {
+        stage->rs2_f = read_source(cpu, stage->rs2, &stage->rs2_value);
+    }
+    if (((flags & INSN_READS_RS1) && !stage->rs1_f)
+        || ((flags & INSN_READS_RS2) && !stage->rs2_f))
     {
+        return FALSE;
+    }
+
+    if (flags & INSN_WRITES_RD)
+    {
+        cpu->regs_writing[stage->rd] = 1;
+    }
+    if (flags & INSN_WRITES_RS1)
+    {
+        cpu->regs_writing[stage->rs1] = 1;
+    }
+    if (flags & INSN_WRITES_RS2)
+    {
+        cpu->regs_writing[stage->rs2] = 1;
+    }
+    return TRUE;
+}
 
+/*
+ * Records where each operand that became ready this cycle came from, and the
+ * register decode is still waiting for if it stalled. The network is the
+ * same one read_source consulted, anything it did not supply came from the
+ * register file.
+ */
+static void
+record_decode_events(APEX_CPU *cpu, int rs1_was_ready, int rs2_was_ready)
+{
+    const CPU_Stage *stage = &cpu->decode;
+    int regs[2] = {stage->rs1, stage->rs2};
+    int now_ready[2] = {stage->rs1_f && !rs1_was_ready, stage->rs2_f && !rs2_was_ready};
+    int reads[2] = {stage->flags & INSN_READS_RS1, stage->flags & INSN_READS_RS2};
+    int value;
+    int i;
 
-        /* Read operands from register file based on the instruction type */
-        switch (cpu->decode.opcode)
+    for (i = 0; i < 2; ++i)
+    {
+        if (!reads[i] || !now_ready[i])
         {
-            case OPCODE_ADD:
-            case OPCODE_SUB:
-            case OPCODE_MUL:
-            case OPCODE_AND:
-            case OPCODE_OR:
-            case OPCODE_XOR:
-            {
+            continue;
+        }
+        switch (forward_lookup(&cpu->forward, regs[i], &value))
+        {
+            case FORWARD_EXECUTE:
+                RECORD_EVENT(cpu, EVENT_FORWARD_EX, stage->pc, stage->opcode, regs[i]);
+                break;
+            case FORWARD_MEMORY:
+                RECORD_EVENT(cpu, EVENT_FORWARD_MEM, stage->pc, stage->opcode, regs[i]);
+                break;
+        }
+    }
 
-                if(cpu->decode.rs1== cpu->ex_fb.reg && cpu->decode.rs1_f==0)
-                {
-                    cpu->decode.rs1_value=cpu->ex_fb.value;
-                    cpu->decode.rs1_f =1;
-                }
-                if(cpu->decode.rs1==cpu->mem_fb.reg && cpu->decode.rs1_f==0)
-                {
-                    cpu->decode.rs1_value=cpu->mem_fb.value;
-                    cpu->decode.rs1_f =1;
-                }
+    if (stage->stalled)
+    {
+        RECORD_EVENT(cpu, EVENT_STALL, stage->pc, stage->opcode,
+                     (reads[0] && !stage->rs1_f) ? regs[0] : regs[1]);
+    }
+}
 
-                if (cpu->decode.rs1_f==0 && cpu->regs_writing[cpu->decode.rs1] == 0){
-                  cpu->decode.rs1_value = cpu->regs[cpu->decode.rs1];
-                  cpu->decode.rs1_f = 1;
-                }
-                // ---------------- rs1 done by now
-                if( cpu->decode.rs2== cpu->ex_fb.reg && cpu->decode.rs2_f==0)
-                {
-                    cpu->decode.rs2_value=cpu->ex_fb.value;
-                    cpu->decode.rs2_f =1;
+/*
+ * Charges a decode stall to its cause. The register decode waits for is
+ * matched against the instructions ahead of it: the one execute just passed
+ * to memory, then the one memory just passed to writeback.
+ */
+static void
+record_decode_stall(APEX_CPU *cpu)
+{
+    const CPU_Stage *stage = &cpu->decode;
+    const CPU_Stage *producers[2] = {&cpu->memory, &cpu->writeback};
+    int on_rs1 = (stage->flags & INSN_READS_RS1) && !stage->rs1_f;
+    int reg = on_rs1 ? stage->rs1 : stage->rs2;
+    int i;
 
-                }
-                if(cpu->regs_writing[cpu->decode.rs2]==1 && cpu->decode.rs2== cpu->mem_fb.reg && cpu->decode.rs2_f==0 )
-                {
-                    cpu->decode.rs2_value=cpu->mem_fb.value;
-                    cpu->decode.rs2_f =1;
-                }
-                if(cpu->regs_writing[cpu->decode.rs2] ==0 && cpu->decode.rs2_f==0)
-                {
-                    cpu->decode.rs2_value = cpu->regs[cpu->decode.rs2];
-                    cpu->decode.rs2_f = 1;
-                }
+    for (i = 0; i < 2; ++i)
+    {
+        const CPU_Stage *producer = producers[i];
 
-                if (cpu->decode.rs1_f==1 && cpu->decode.rs2_f==1)
-                {
-                    cpu->regs_writing[cpu->decode.rd] = 1;
-                    cpu->decode.stalled = 0;
-                    break;
-                }
+        if (!producer->has_insn)
+        {
+            continue;
+        }
+        if ((producer->flags & INSN_WRITES_RD) && producer->rd == reg)
+        {
+            stats_record_stall(&cpu->stats, stage->pc,
+                               (producer->flags & INSN_MEMORY) ? STALL_LOAD_USE
+                               : on_rs1 ? STALL_RAW_RS1 : STALL_RAW_RS2,
+                               producer->pc);
+            return;
+        }
+        if (((producer->flags & INSN_WRITES_RS1) && producer->rs1 == reg)
+            || ((producer->flags & INSN_WRITES_RS2) && producer->rs2 == reg))
+        {
+            stats_record_stall(&cpu->stats, stage->pc, STALL_ADDR_UPDATE, producer->pc);
+            return;
+        }
+    }
+    stats_record_stall(&cpu->stats, stage->pc, STALL_STRUCTURAL, 0);
+}
 
-                else{
-                  cpu->decode.stalled = 1;
-                  break;
-                }
-            }
-            case OPCODE_ADDL:
-            case OPCODE_SUBL:
-            case OPCODE_JALR:
-            case OPCODE_LOAD:
-            {
-              
-
-                if (cpu->decode.rs1== cpu->ex_fb.reg && cpu->decode.rs1_f ==0 ){
-                    cpu->decode.rs1_value = cpu->ex_fb.value;
-                    cpu->decode.rs1_f = 1;
-                  }
-
-                if (cpu->decode.rs1== cpu->mem_fb.reg && cpu->decode.rs1_f ==0 ){
-                    cpu->decode.rs1_value = cpu->mem_fb.value;
-                    cpu->decode.rs1_f = 1;
-                  }
-                  if (cpu->regs_writing[cpu->decode.rs1] == 0 && cpu->decode.rs1_f ==0){
-                    cpu->decode.rs1_value = cpu->regs[cpu->decode.rs1];
-                    cpu->decode.rs1_f = 1;
-                    }
-                if(cpu->decode.rs1_f){
-                    cpu->regs_writing[cpu->decode.rd] = 1;
-                    cpu->decode.stalled = 0;
-                    break;
-                }
-                else{
-                  cpu->decode.stalled = 1;
-                  break;
-                }}
-            case OPCODE_LOADP:
-            {
+/*
+ * Sends fetch to new_pc from decode. Fetch has not run yet this cycle, so
+ * only the predictions made behind the branch in decode are dropped and
+ * fetch skips one cycle.
+ */
+static void
+redirect_from_decode(APEX_CPU *cpu, int new_pc)
+{
+    stats_record_flush(&cpu->stats, cpu->decode.pc, FLUSH_BTB_MISS, DECODE_REDIRECT_PENALTY);
+    RECORD_EVENT(cpu, EVENT_FLUSH, cpu->decode.pc, cpu->decode.opcode, new_pc);
 
-                if (cpu->decode.rs1== cpu->ex_fb.reg && cpu->decode.rs1_f ==0 ){
-                    cpu->decode.rs1_value = cpu->ex_fb.value;
-                    cpu->decode.rs1_f = 1;
-                    }
-
-                if (cpu->decode.rs1== cpu->mem_fb.reg && cpu->decode.rs1_f ==0){
-                    cpu->decode.rs1_value = cpu->mem_fb.value;
-                    cpu->decode.rs1_f = 1;
-                    }
-                if (cpu->regs_writing[cpu->decode.rs1] == 0 && cpu->decode.rs1_f ==0){
-                  cpu->decode.rs1_value = cpu->regs[cpu->decode.rs1];
-                  cpu->decode.rs1_f = 1;
-                  }
-                if(cpu->decode.rs1_f){
-                    cpu->regs_writing[cpu->decode.rs1] = 1;
-                    cpu->regs_writing[cpu->decode.rd] = 1;
-                    cpu->decode.stalled = 0;
-                    break;
-                }
-                else{
-                  cpu->decode.stalled = 1;
-                  break;
-                }
+    cpu->pc = new_pc;
+    cpu->fetch_from_next_cycle = TRUE;
+    cpu->stats.ftq.flushed += ftq_flush(&cpu->ftq);
+    ras_copy(&cpu->ras, &cpu->ras_resolved);
+    cpu->fetch.has_insn = TRUE;
+}
 
-                }
+/*
+ * Handles a BTB tracked branch in stage that fetch did not send to its
+ * target, either because it missed in the BTB or because its entry has not
+ * been trained. Its target pc + imm is known at decode: a missing entry is
+ * allocated with it and seeded, and when the direction predictor says taken
+ * the branch is marked as followed to the target.
+ *
+ * Returns TRUE if fetch should be sent to stage->pred_target now, losing one
+ * cycle rather than two at execute. A branch just allocated is predicted from
+ * its seed alone and only redirected when it jumps backward, like a loop
+ * that goes round again; a wrong guess costs three cycles where falling
+ * through would have cost none.
+ */
+int
+APEX_decode_branch_target(APEX_CPU *cpu, CPU_Stage *stage)
+{
+    int target = stage->pc + stage->imm;
+    BTB *entry = btb_lookup(&cpu->btb, stage->pc);
+    uint64_t meta = stage->pred_meta;
+    int seeded = FALSE;
 
-            case OPCODE_CML:
-            case OPCODE_JUMP:
-                {
+    if (entry == NULL)
+    {
+        /* Allocate a new entry, by default BNZ/BP start strongly taken and BZ/BNP strongly not taken */
+        entry = btb_allocate(&cpu->btb, stage->pc);
+        entry->target_address = target;
+        predictor_install(&cpu->predictor, stage->pc,
+                          predictor_seed_state(cpu->counter_init,
+                                               get_opcode_hint(stage->opcode)));
+
+        /* Fetch predicted before the counters were seeded */
+        stage->pred_taken = predictor_predict(&cpu->predictor, stage->pc, &meta);
+        seeded = TRUE;
+    }
+    if (!cpu->decode_redirect || stage->pred_taken != TAKEN
+        || (seeded && stage->imm >= 0))
+    {
+        return FALSE;
+    }
 
-                if (cpu->decode.rs1== cpu->ex_fb.reg && cpu->decode.rs1_f ==0 ){
-                    cpu->decode.rs1_value = cpu->ex_fb.value;
-                    cpu->decode.rs1_f = 1;}
-                if (cpu->decode.rs1== cpu->mem_fb.reg && cpu->decode.rs1_f ==0 ){
-                    cpu->decode.rs1_value = cpu->mem_fb.value;
-                    cpu->decode.rs1_f = 1;}
-                if (cpu->regs_writing[cpu->decode.rs1] == 0 && cpu->decode.rs1_f ==0 ){
-                  cpu->decode.rs1_value = cpu->regs[cpu->decode.rs1];
-                  cpu->decode.rs1_f = 1;
-                  }
-                if(cpu->decode.rs1_f){
-                    cpu->regs_writing[cpu->decode.rs1]=1;
-                    cpu->decode.stalled = 0;
-                    break;
-                }
+    /* Execute now sees the branch as followed to its target */
+    stage->btb_searched = 1;
+    stage->pred_target = target;
+    stage->pred_meta = meta;
+    return TRUE;
+}
 
-                else{
-                  cpu->decode.stalled = 1;
-                  break;
-                }
+/*
+ * Decode Stage of APEX Pipeline
+ *
+ * Note: You are free to edit this function according to your implementation
+ */
+static void
+APEX_decode(APEX_CPU *cpu)
+{
+    if (cpu->decode.has_insn)
+    {
+        int rs1_was_ready = cpu->decode.rs1_f;
+        int rs2_was_ready = cpu->decode.rs2_f;
 
-                }
+        if (cpu->kanata)
+        {
+            kanata_stage(cpu->kanata, cpu->clock, cpu->decode.seq, KANATA_DECODE);
+        }
 
-            case OPCODE_STORE:
-            {
-                if( cpu->decode.rs1 == cpu->ex_fb.reg && cpu->decode.rs1_f ==0)
-                {
-                    cpu->decode.rs1_value=cpu->ex_fb.value;
-                    cpu->decode.rs1_f =1;
-                }
-                if(cpu->decode.rs2== cpu->ex_fb.reg && cpu->decode.rs2_f ==0)
-                {
-                    cpu->decode.rs2_value=cpu->ex_fb.value;
-                    cpu->decode.rs2_f =1;
-                }
-                if(cpu->decode.rs1== cpu->mem_fb.reg && cpu->decode.rs1_f ==0)
-                {
-                    cpu->decode.rs1_value=cpu->mem_fb.value;
-                    cpu->decode.rs1_f =1;
-                }
-                if( cpu->decode.rs2== cpu->mem_fb.reg && cpu->decode.rs2_f ==0)
-                {
-                    cpu->decode.rs2_value=cpu->mem_fb.value;
-                    cpu->decode.rs2_f =1;
-                }
-                if (cpu->regs_writing[cpu->decode.rs1] == 0 && cpu->decode.rs1_f ==0){
-                  cpu->decode.rs1_value = cpu->regs[cpu->decode.rs1];
-                  cpu->decode.rs1_f = 1;
-                }
-                if(cpu->regs_writing[cpu->decode.rs2] ==0 && cpu->decode.rs2_f ==0)
-                {
-                    cpu->decode.rs2_value = cpu->regs[cpu->decode.rs2];
-                    cpu->decode.rs2_f = 1;
-                }
-                if (cpu->decode.rs1_f==1 && cpu->decode.rs2_f==1)
-                {
-                    cpu->decode.stalled = 0;
-                    break;
-                }
-                else{
-                  cpu->decode.stalled = 1;
-                  break;
-                }
-            }
-            case OPCODE_STOREP:
-            {
-                if(cpu->decode.rs1== cpu->ex_fb.reg && cpu->decode.rs1_f ==0 )
-                {
-                    cpu->decode.rs1_value=cpu->ex_fb.value;
-                    cpu->decode.rs1_f =1;
-                }
-                if(cpu->decode.rs2== cpu->ex_fb.reg && cpu->decode.rs2_f ==0  )
-                {
-                    cpu->decode.rs2_value=cpu->ex_fb.value;
-                    cpu->decode.rs2_f =1;
-                }
-                if(cpu->decode.rs1== cpu->mem_fb.reg && cpu->decode.rs1_f ==0  )
-                {
-                    cpu->decode.rs1_value=cpu->mem_fb.value;
-                    cpu->decode.rs1_f =1;
-                }
-                if(cpu->decode.rs2== cpu->mem_fb.reg && cpu->decode.rs2_f ==0  )
-                {
-                    cpu->decode.rs2_value=cpu->mem_fb.value;
-                    cpu->decode.rs2_f =1;
-                }
-                if (cpu->regs_writing[cpu->decode.rs1] == 0 && cpu->decode.rs1_f ==0 ){
-                  cpu->decode.rs1_value = cpu->regs[cpu->decode.rs1];
-                  cpu->decode.rs1_f = 1;
-                }
-                if(cpu->regs_writing[cpu->decode.rs2] ==0 && cpu->decode.rs2_f ==0 )  // loadp ne pkda hai to ye kaese hua??
-                {
-                    cpu->decode.rs2_value = cpu->regs[cpu->decode.rs2];
-                    cpu->decode.rs2_f = 1;
-                }
-
-                if (cpu->decode.rs1_f==1 && cpu->decode.rs2_f==1)
-                {
-                    
-                    cpu->decode.stalled = 0;
-                    break;
-                }
-                else{
-                  cpu->decode.stalled = 1;
-                  break;
-                }
-            }
-
-            case OPCODE_CMP:
-            {
-
-
-                if(cpu->decode.rs1== cpu->ex_fb.reg && cpu->decode.rs1_f ==0 )
-                {
-                    cpu->decode.rs1_value=cpu->ex_fb.value;
-                    cpu->decode.rs1_f =1;
-                }
-                if(cpu->decode.rs2== cpu->ex_fb.reg && cpu->decode.rs2_f ==0 )
-                {
-                    cpu->decode.rs2_value=cpu->ex_fb.value;
-                    cpu->decode.rs2_f =1;
-                }
-                if(cpu->decode.rs1== cpu->mem_fb.reg && cpu->decode.rs1_f ==0 )
-                {
-                    cpu->decode.rs1_value=cpu->mem_fb.value;
-                    cpu->decode.rs1_f =1;
-                }
-                if(cpu->decode.rs2== cpu->mem_fb.reg && cpu->decode.rs2_f ==0 )
-                {
-                    cpu->decode.rs2_value=cpu->mem_fb.value;
-                    cpu->decode.rs2_f =1;
-                }
-                if (cpu->regs_writing[cpu->decode.rs1] == 0 && cpu->decode.rs1_f ==0){
-                  cpu->decode.rs1_value = cpu->regs[cpu->decode.rs1];
-                  cpu->decode.rs1_f = 1;
-                }
-                if(cpu->regs_writing[cpu->decode.rs2] ==0 && cpu->decode.rs2_f ==0)
-                {
-                    cpu->decode.rs2_value = cpu->regs[cpu->decode.rs2];
-                    cpu->decode.rs2_f = 1;
-                }
-
-                if (cpu->decode.rs1_f==1 && cpu->decode.rs2_f==1)
-                {
-                    cpu->decode.stalled = 0;
-                    break;
-                }
-                else{
-                  cpu->decode.stalled = 1;
-                  break;
-                }
-            }
+        cpu->decode.stalled = !decode_operands(cpu);
 
-            case OPCODE_MOVC:
-            {
-                /* MOVC doesn't have register operands */
-                cpu->regs_writing[cpu->decode.rd] = 1;
-                break;
-            }
-            case OPCODE_BNZ:
-            case OPCODE_BP:
-            {
-                
-                if (cpu->btb_queue.size < 4 && cpu->decode.btb_searched == 0) 
-                {   
-                    
-                    // The queue is not full, add a new entry
-                    int inst_address_exists = 0;
-                    for (int i = 0; i < cpu->btb_queue.size; i++)
-                    {
-                        if (cpu->decode.pc == cpu->btb_queue.data[i].inst_address)
-                        {
-                            inst_address_exists = 1;
-                            break;
-                        }
-                    }
-
-                    if (!inst_address_exists)
-                    {
-                        // Add a new entry
-                        cpu->btb_queue.data[cpu->btb_queue.tail].inst_address = cpu->decode.pc;
-                        cpu->btb_queue.data[cpu->btb_queue.tail].prediction_state =1;
-                        cpu->btb_queue.data[cpu->btb_queue.tail].history_state =3;
-                        cpu->btb_queue.data[cpu->btb_queue.tail].executed =0;
-                        cpu->btb_queue.data[cpu->btb_queue.tail].num_executed=0;
-                        cpu->btb_queue.size++;
-                        cpu->btb_queue.tail = (cpu->btb_queue.tail + 1) % 4; // Update tail
-                    }
-                    
-                    
-                    break;  
-                } 
-                else if (cpu->btb_queue.size >= 4 && cpu->decode.btb_searched == 0)
-                {
-                    
-                    // The queue is full, replace the oldest entry (FIFO)
-                    int inst_address_exists = 0;
-                    for (int i = 0; i < cpu->btb_queue.size; i++)
-                    {
-                        if (cpu->decode.pc == cpu->btb_queue.data[i].inst_address)
-                        {
-                            inst_address_exists = 1;
-                            break;
-                        }
-                    }
-                    if (!inst_address_exists)
-                    {
-                        // Replace the oldest entry
-                        int replaced_index = cpu->btb_queue.head;
-                        cpu->btb_queue.data[replaced_index].inst_address = cpu->decode.pc;
-                        cpu->btb_queue.data[replaced_index].target_address = 0; // Reset target_address
-                        cpu->btb_queue.data[replaced_index].prediction_state = 1; // Reset prediction_state
-                        cpu->btb_queue.data[replaced_index].executed = 0;        // Reset executed
-                        cpu->btb_queue.data[replaced_index].history_state = 3;
-                        cpu->btb_queue.data[replaced_index].num_executed =0;
-
-                        // Update head
-                        cpu->btb_queue.head = (cpu->btb_queue.head + 1) % 4;
-                    }
-                            
-                    break;
-                    
-                }
-             
-            }
-            case OPCODE_BNP:
-            case OPCODE_BZ:
-            {
-                
-                 
-                if (cpu->btb_queue.size < 4 && cpu->decode.btb_searched == 0) 
-                {   
-                    
-                    // The queue is not full, add a new entry
-                    int inst_address_exists = 0;
-                    for (int i = 0; i < cpu->btb_queue.size; i++)
-                    {
-                        if (cpu->decode.pc == cpu->btb_queue.data[i].inst_address)
-                        {
-                            inst_address_exists = 1;
-                            break;
-                        }
-                    }
-
-                    if (!inst_address_exists)
-                    {
-                        // Add a new entry
-                        cpu->btb_queue.data[cpu->btb_queue.tail].inst_address = cpu->decode.pc;
-                        cpu->btb_queue.data[cpu->btb_queue.tail].prediction_state =0;
-                        cpu->btb_queue.data[cpu->btb_queue.tail].history_state =0;
-                        cpu->btb_queue.data[cpu->btb_queue.tail].executed =0;
-                        cpu->btb_queue.data[cpu->btb_queue.tail].num_executed=0;
-                        cpu->btb_queue.size++;
-                        cpu->btb_queue.tail = (cpu->btb_queue.tail + 1) % 4; // Update tail
-                    }
-                    
-                    break;  
-                } 
-                else if (cpu->btb_queue.size >= 4 && cpu->decode.btb_searched == 0)
-                {
-                    
-                   
-                    // The queue is full, replace the oldest entry (FIFO)
-                    int inst_address_exists = 0;
-                    for (int i = 0; i < cpu->btb_queue.size; i++)
-                    {
-                        if (cpu->decode.pc == cpu->btb_queue.data[i].inst_address)
-                        {
-                            inst_address_exists = 1;
-                            break;
-                        }
-                    }
-                    if (!inst_address_exists)
-                    {
-                        // Replace the oldest entry
-                        int replaced_index = cpu->btb_queue.head;
-                        cpu->btb_queue.data[replaced_index].inst_address = cpu->decode.pc;
-                        cpu->btb_queue.data[replaced_index].target_address = 0; // Reset target_address
-                        cpu->btb_queue.data[replaced_index].prediction_state = 0; // Reset prediction_state
-                        cpu->btb_queue.data[replaced_index].executed = 0;        // Reset executed
-                        cpu->btb_queue.data[replaced_index].history_state = 0;
-                        cpu->btb_queue.data[replaced_index].num_executed =0;
-
-                        // Update head
-                        cpu->btb_queue.head = (cpu->btb_queue.head + 1) % 4;
-                    }
-      
-                    break;
-                    
-                }
-
-            }
+        if ((cpu->decode.flags & INSN_PREDICTED) && cpu->decode.btb_searched == 0
+            && APEX_decode_branch_target(cpu, &cpu->decode))
+        {
+            redirect_from_decode(cpu, cpu->decode.pred_target);
+        }
 
+        if (ENABLE_PIPELINE_EVENTS && cpu->events)
+        {
+            record_decode_events(cpu, rs1_was_ready, rs2_was_ready);
+        }
+        if (cpu->decode.stalled)
+        {
+            record_decode_stall(cpu);
         }
 
         /* Copy data from decode latch to execute latch*/
@@ -798,7 +671,7 @@ APEX_decode(APEX_CPU *cpu)
         else{
           cpu->fetch.stalled = 1;
         }
-        if (ENABLE_DEBUG_MESSAGES)
+        if (DEBUG_ON(cpu))
         {
             print_stage_content("Decode/RF", &cpu->decode);
         }
@@ -807,1110 +680,408 @@ APEX_decode(APEX_CPU *cpu)
 }
 
 /*
- * Execute Stage of APEX Pipeline
- *
- * Note: You are free to edit this function according to your implementation
+ * Sends new_pc to fetch and squashes the instruction fetched behind the one
+ * in execute, charging the lost cycles to cause
  */
 static void
-APEX_execute(APEX_CPU *cpu)
+redirect_fetch(APEX_CPU *cpu, int new_pc, int cause)
 {
-    if (cpu->execute.has_insn)
+    stats_record_flush(&cpu->stats, cpu->execute.pc, cause, EXECUTE_REDIRECT_PENALTY);
+    RECORD_EVENT(cpu, EVENT_FLUSH, cpu->execute.pc, cpu->execute.opcode, new_pc);
+    if (cpu->kanata && cpu->decode.has_insn)
     {
-        /* Execute logic based on instruction type */
-        switch (cpu->execute.opcode)
-        {
-
-          case OPCODE_ADD:
-          {
-            if(cpu->regs_writing[cpu->execute.rd] == 0){
-              cpu->regs_writing[cpu->execute.rd] = 1;
-            }
-              cpu->execute.result_buffer
-                  = cpu->execute.rs1_value + cpu->execute.rs2_value;
-              cpu->ex_fb.reg= cpu->execute.rd;
-              cpu->ex_fb.value = cpu->execute.result_buffer;
-              /* Set the zero flag based on the result buffer */
-              if(cpu->execute.result_buffer<0){
-                    cpu->cc.p = FALSE;
-                    cpu->cc.n = TRUE;
-                    cpu->cc.z = FALSE;
-                    cpu->zero_flag = FALSE;
-                }
-                if(cpu->execute.result_buffer>0){
-                    cpu->cc.p = TRUE;
-                    cpu->cc.n = FALSE;
-                    cpu->cc.z = FALSE;
-                    cpu->zero_flag = FALSE;
-                }
-
-                /* Set the zero flag based on the result buffer */
-                if (cpu->execute.result_buffer == 0)
-                {
-                    cpu->cc.p = FALSE;
-                    cpu->cc.n = FALSE;
-                    cpu->cc.z = TRUE;
-                    cpu->zero_flag = TRUE;
-                }
+        kanata_flush(cpu->kanata, cpu->clock, cpu->decode.seq);
+    }
 
-              break;
-          }
-          case OPCODE_ADDL:
-          {
+    /* Calculate new PC, and send it to fetch unit */
+    cpu->pc = new_pc;
 
-            if(cpu->regs_writing[cpu->execute.rd] == 0){
-              cpu->regs_writing[cpu->execute.rd] = 1;
-            }
-              cpu->execute.result_buffer
-                  = cpu->execute.rs1_value + cpu->execute.imm;
-                cpu->ex_fb.reg= cpu->execute.rd;
-              cpu->ex_fb.value = cpu->execute.result_buffer;
-              /* Set the zero flag based on the result buffer */
-              if(cpu->execute.result_buffer<0){
-                    cpu->cc.p = FALSE;
-                    cpu->cc.n = TRUE;
-                    cpu->cc.z = FALSE;
-                    cpu->zero_flag = FALSE;
-                }
-                if(cpu->execute.result_buffer>0){
-                    cpu->cc.p = TRUE;
-                    cpu->cc.n = FALSE;
-                    cpu->cc.z = FALSE;
-                    cpu->zero_flag = FALSE;
-                }
+    /* Since we are using reverse callbacks for pipeline stages,
+     * this will prevent the new instruction from being fetched in the current cycle*/
+    cpu->fetch_from_next_cycle = TRUE;
 
-                /* Set the zero flag based on the result buffer */
-                if (cpu->execute.result_buffer == 0)
-                {
-                    cpu->cc.p = FALSE;
-                    cpu->cc.n = FALSE;
-                    cpu->cc.z = TRUE;
-                    cpu->zero_flag = TRUE;
-                }
+    /* Flush previous stages */
+    cpu->decode.has_insn = FALSE;
 
-              break;
-          }
-          case OPCODE_SUB:
-          {
-            if(cpu->regs_writing[cpu->execute.rd] == 0){
-              cpu->regs_writing[cpu->execute.rd] = 1;
-            }
-              cpu->execute.result_buffer
-                  = cpu->execute.rs1_value - cpu->execute.rs2_value;
-                   cpu->ex_fb.reg= cpu->execute.rd;
-              cpu->ex_fb.value = cpu->execute.result_buffer;
-
-              /* Set the zero flag based on the result buffer */
-             if(cpu->execute.result_buffer<0){
-                    cpu->cc.p = FALSE;
-                    cpu->cc.n = TRUE;
-                    cpu->cc.z = FALSE;
-                    cpu->zero_flag = FALSE;
-                }
-                if(cpu->execute.result_buffer>0){
-                    cpu->cc.p = TRUE;
-                    cpu->cc.n = FALSE;
-                    cpu->cc.z = FALSE;
-                    cpu->zero_flag = FALSE;
-                }
+    /* Predictions made behind the redirecting instruction, and the calls and
+     * returns among them, are gone */
+    cpu->stats.ftq.flushed += ftq_flush(&cpu->ftq);
+    ras_copy(&cpu->ras, &cpu->ras_resolved);
 
-                /* Set the zero flag based on the result buffer */
-                if (cpu->execute.result_buffer == 0)
-                {
-                    cpu->cc.p = FALSE;
-                    cpu->cc.n = FALSE;
-                    cpu->cc.z = TRUE;
-                    cpu->zero_flag = TRUE;
-                }
+    /* Make sure fetch stage is enabled to start fetching from new PC */
+    cpu->fetch.has_insn = TRUE;
+}
 
-              break;
-          }
-          case OPCODE_SUBL:
-          {
-            if(cpu->regs_writing[cpu->execute.rd] == 0){
-              cpu->regs_writing[cpu->execute.rd] = 1;
-            }
-              cpu->execute.result_buffer
-                  = cpu->execute.rs1_value - cpu->execute.imm;
-                   cpu->ex_fb.reg= cpu->execute.rd;
-              cpu->ex_fb.value = cpu->execute.result_buffer;
-
-              /* Set the zero flag based on the result buffer */
-              if(cpu->execute.result_buffer<0){
-                    cpu->cc.p = FALSE;
-                    cpu->cc.n = TRUE;
-                    cpu->cc.z = FALSE;
-                    cpu->zero_flag = FALSE;
-                }
-                if(cpu->execute.result_buffer>0){
-                    cpu->cc.p = TRUE;
-                    cpu->cc.n = FALSE;
-                    cpu->cc.z = FALSE;
-                    cpu->zero_flag = FALSE;
-                }
+/* Sets the condition codes, and the zero flag used by BZ/BNZ, from a result */
+static void
+set_condition_codes(APEX_CPU *cpu, int result)
+{
+    cpu->cc.z = (result == 0);
+    cpu->cc.p = (result > 0);
+    cpu->cc.n = (result < 0);
+    cpu->zero_flag = cpu->cc.z;
+}
 
-                /* Set the zero flag based on the result buffer */
-                if (cpu->execute.result_buffer == 0)
-                {
-                    cpu->cc.p = FALSE;
-                    cpu->cc.n = FALSE;
-                    cpu->cc.z = TRUE;
-                    cpu->zero_flag = TRUE;
-                }
+/*
+ * Accounts the branch in stage once resolved, predicted being the direction
+ * fetch followed, shifts it into the indirect predictor's path history and
+ * appends it to the branch trace when one is being written
+ */
+void
+record_branch_outcome(APEX_CPU *cpu, const CPU_Stage *stage, int predicted, int outcome,
+                      int target)
+{
+    stats_record_outcome(&cpu->stats, stage->pc, predicted, outcome);
+    indirect_history(&cpu->indirect, outcome, target);
+    if (cpu->trace)
+    {
+        trace_write(cpu->trace, stage->pc, target, stage->opcode, outcome,
+                    stage->rd, stage->rs1, stage->imm);
+    }
+}
 
-              break;
-          }
-          case OPCODE_MUL:
-          {
-            if(cpu->regs_writing[cpu->execute.rd] == 0){
-              cpu->regs_writing[cpu->execute.rd] = 1;
-            }
-              cpu->execute.result_buffer
-                  = cpu->execute.rs1_value * cpu->execute.rs2_value;
-             cpu->ex_fb.reg= cpu->execute.rd;
-              cpu->ex_fb.value = cpu->execute.result_buffer;
-              /* Set the zero flag based on the result buffer */
-              if(cpu->execute.result_buffer<0){
-                    cpu->cc.p = FALSE;
-                    cpu->cc.n = TRUE;
-                    cpu->cc.z = FALSE;
-                    cpu->zero_flag = FALSE;
-                }
-                if(cpu->execute.result_buffer>0){
-                    cpu->cc.p = TRUE;
-                    cpu->cc.n = FALSE;
-                    cpu->cc.z = FALSE;
-                    cpu->zero_flag = FALSE;
-                }
+/*
+ * Resolves a BTB tracked conditional branch in execute. The predictor and the
+ * BTB entry are trained with the outcome, and fetch is redirected when the
+ * path it followed (the BTB target or the fall through) was the wrong one.
+ */
+static void
+resolve_conditional_branch(APEX_CPU *cpu, int outcome)
+{
+    BTB *entry = btb_lookup(&cpu->btb, cpu->execute.pc);
+    int fetched_taken = cpu->execute.btb_searched;
+    int target = cpu->execute.pc + cpu->execute.imm;
 
-                /* Set the zero flag based on the result buffer */
-                if (cpu->execute.result_buffer == 0)
-                {
-                    cpu->cc.p = FALSE;
-                    cpu->cc.n = FALSE;
-                    cpu->cc.z = TRUE;
-                    cpu->zero_flag = TRUE;
-                }
-              break;
-          }
-          case OPCODE_AND:
-          {
-            if(cpu->regs_writing[cpu->execute.rd] == 0){
-              cpu->regs_writing[cpu->execute.rd] = 1;
-            }
+    record_branch_outcome(cpu, &cpu->execute, fetched_taken ? TAKEN : NOT_TAKEN, outcome,
+                          target);
 
-              cpu->execute.result_buffer
-                  = cpu->execute.rs1_value&cpu->execute.rs2_value;
-                 cpu->ex_fb.reg= cpu->execute.rd;
-              cpu->ex_fb.value = cpu->execute.result_buffer;
-              /* Set the zero flag based on the result buffer */
-              if(cpu->execute.result_buffer<0){
-                    cpu->cc.p = FALSE;
-                    cpu->cc.n = TRUE;
-                    cpu->cc.z = FALSE;
-                    cpu->zero_flag = FALSE;
-                }
-                if(cpu->execute.result_buffer>0){
-                    cpu->cc.p = TRUE;
-                    cpu->cc.n = FALSE;
-                    cpu->cc.z = FALSE;
-                    cpu->zero_flag = FALSE;
-                }
+    /* A younger branch decoded while this one waited can have evicted it */
+    if (entry == NULL)
+    {
+        entry = btb_allocate(&cpu->btb, cpu->execute.pc);
+    }
+    entry->num_executed++;
+    entry->target_address = target;
+    predictor_update(&cpu->predictor, cpu->execute.pc, outcome, cpu->execute.pred_meta);
 
-                /* Set the zero flag based on the result buffer */
-                if (cpu->execute.result_buffer == 0)
-                {
-                    cpu->cc.p = FALSE;
-                    cpu->cc.n = FALSE;
-                    cpu->cc.z = TRUE;
-                    cpu->zero_flag = TRUE;
-                }
+    if (outcome == TAKEN && !fetched_taken)
+    {
+        /* Predicted taken but not followed means there was no target */
+        redirect_fetch(cpu, target,
+                       cpu->execute.pred_taken == TAKEN ? FLUSH_BTB_MISS : FLUSH_DIRECTION);
+    }
+    else if (outcome == NOT_TAKEN && fetched_taken)
+    {
+        redirect_fetch(cpu, cpu->execute.pc + 4, FLUSH_DIRECTION);
+    }
+}
 
-              break;
-          }
-          case OPCODE_OR:
-          {
-            if(cpu->regs_writing[cpu->execute.rd] == 0){
-              cpu->regs_writing[cpu->execute.rd] = 1;
-            }
-              cpu->execute.result_buffer
-                  = cpu->execute.rs1_value | cpu->execute.rs2_value;
-                  cpu->ex_fb.reg= cpu->execute.rd;
-              cpu->ex_fb.value = cpu->execute.result_buffer;
-              /* Set the zero flag based on the result buffer */
-              if(cpu->execute.result_buffer<0){
-                    cpu->cc.p = FALSE;
-                    cpu->cc.n = TRUE;
-                    cpu->cc.z = FALSE;
-                    cpu->zero_flag = FALSE;
-                }
-                if(cpu->execute.result_buffer>0){
-                    cpu->cc.p = TRUE;
-                    cpu->cc.n = FALSE;
-                    cpu->cc.z = FALSE;
-                    cpu->zero_flag = FALSE;
-                }
+/* ALU operations, selected by opcode through alu_table */
+typedef int (*alu_fn)(int a, int b);
+
+static int alu_add(int a, int b) { return a + b; }
+static int alu_sub(int a, int b) { return a - b; }
+static int alu_mul(int a, int b) { return a * b; }
+static int alu_and(int a, int b) { return a & b; }
+static int alu_or(int a, int b) { return a | b; }
+static int alu_xor(int a, int b) { return a ^ b; }
+
+static const alu_fn alu_table[NUM_OPCODES] = {
+    [OPCODE_ADD] = alu_add,
+    [OPCODE_ADDL] = alu_add,
+    [OPCODE_SUB] = alu_sub,
+    [OPCODE_SUBL] = alu_sub,
+    [OPCODE_MUL] = alu_mul,
+    [OPCODE_AND] = alu_and,
+    [OPCODE_OR] = alu_or,
+    [OPCODE_XOR] = alu_xor,
+    [OPCODE_CMP] = alu_sub,
+    [OPCODE_CML] = alu_sub,
+};
+
+/* Second ALU operand, rs2 for register forms and the literal otherwise */
+static int
+alu_operand2(const CPU_Stage *stage)
+{
+    return (stage->flags & INSN_READS_RS2) ? stage->rs2_value : stage->imm;
+}
 
-                /* Set the zero flag based on the result buffer */
-                if (cpu->execute.result_buffer == 0)
-                {
-                    cpu->cc.p = FALSE;
-                    cpu->cc.n = FALSE;
-                    cpu->cc.z = TRUE;
-                    cpu->zero_flag = TRUE;
-                }
+/* ADD, ADDL, SUB, SUBL, MUL, AND, OR, EXOR */
+static void
+execute_alu(APEX_CPU *cpu)
+{
+    CPU_Stage *stage = &cpu->execute;
 
-              break;
-          }
-          case OPCODE_XOR:
-          {
-            if(cpu->regs_writing[cpu->execute.rd] == 0){
-              cpu->regs_writing[cpu->execute.rd] = 1;
-            }
-              cpu->execute.result_buffer = cpu->execute.rs1_value ^ cpu->execute.rs2_value;
-              cpu->ex_fb.reg= cpu->execute.rd;
-              cpu->ex_fb.value = cpu->execute.result_buffer;
-              /* Set the zero flag based on the result buffer */
-              if(cpu->execute.result_buffer<0){
-                    cpu->cc.p = FALSE;
-                    cpu->cc.n = TRUE;
-                    cpu->cc.z = FALSE;
-                    cpu->zero_flag = FALSE;
-                }
-                if(cpu->execute.result_buffer>0){
-                    cpu->cc.p = TRUE;
-                    cpu->cc.n = FALSE;
-                    cpu->cc.z = FALSE;
-                    cpu->zero_flag = FALSE;
-                }
+    cpu->regs_writing[stage->rd] = 1;
+    stage->result_buffer = alu_table[stage->opcode](stage->rs1_value, alu_operand2(stage));
+    set_condition_codes(cpu, stage->result_buffer);
+}
 
-                /* Set the zero flag based on the result buffer */
-                if (cpu->execute.result_buffer == 0)
-                {
-                    cpu->cc.p = FALSE;
-                    cpu->cc.n = FALSE;
-                    cpu->cc.z = TRUE;
-                    cpu->zero_flag = TRUE;
-                }
+/* CMP, CML only update the condition codes */
+static void
+execute_compare(APEX_CPU *cpu)
+{
+    CPU_Stage *stage = &cpu->execute;
 
-              break;
-          }
-            case OPCODE_LOAD:
-            {
+    stage->result_buffer = alu_table[stage->opcode](stage->rs1_value, alu_operand2(stage));
+    set_condition_codes(cpu, stage->result_buffer);
+}
 
-              if(cpu->regs_writing[cpu->execute.rd] == 0){
-                cpu->regs_writing[cpu->execute.rd] = 1;
-              }
-                cpu->execute.memory_address
-                    = cpu->execute.rs1_value + cpu->execute.imm;
-                break;
-            }
-            case OPCODE_LOADP:
-            {
+static void
+execute_movc(APEX_CPU *cpu)
+{
+    cpu->regs_writing[cpu->execute.rd] = 1;
+    cpu->execute.result_buffer = cpu->execute.imm + 0;
+}
 
-              // if regs_writing was over-written
+static void
+execute_load(APEX_CPU *cpu)
+{
+    cpu->regs_writing[cpu->execute.rd] = 1;
+    cpu->execute.memory_address = cpu->execute.rs1_value + cpu->execute.imm;
+}
 
-              if(cpu->regs_writing[cpu->execute.rd] == 0){
-                cpu->regs_writing[cpu->execute.rd] = 1;
-              }
-              if(cpu->regs_writing[cpu->execute.rs1] == 0){
-                cpu->regs_writing[cpu->execute.rs1] = 1;
-              }
+static void
+execute_loadp(APEX_CPU *cpu)
+{
+    cpu->regs_writing[cpu->execute.rd] = 1;
+    cpu->regs_writing[cpu->execute.rs1] = 1;
+    cpu->execute.memory_address = cpu->execute.rs1_value + cpu->execute.imm;
+    cpu->execute.rs1_value = cpu->execute.rs1_value + 4;
+}
 
-                cpu->execute.memory_address = cpu->execute.rs1_value + cpu->execute.imm;
-                cpu->execute.rs1_value=cpu->execute.rs1_value+4;
-                cpu->ex_fb.reg = cpu->execute.rs2;
-                cpu->ex_fb.value = cpu->execute.rs2_value;
-                break;
-            }
-            case OPCODE_STORE:
-            {
+static void
+execute_store(APEX_CPU *cpu)
+{
+    cpu->execute.memory_address = cpu->execute.rs2_value + cpu->execute.imm;
+}
 
-                cpu->execute.memory_address = cpu->execute.rs2_value + cpu->execute.imm;
-                cpu->mem_address[cpu->data_counter++] = cpu->execute.memory_address;
-                break;
-            }
-            case OPCODE_STOREP:
-            {
-               
-              if(cpu->regs_writing[cpu->execute.rs2] == 0){
-                cpu->regs_writing[cpu->execute.rs2] = 1;
-              }
-                cpu->execute.memory_address = cpu->execute.rs2_value + cpu->execute.imm;
-                cpu->execute.rs2_value =cpu->execute.rs2_value +4;
-                cpu->ex_fb.reg = cpu->execute.rs2;
-                cpu->ex_fb.value = cpu->execute.rs2_value;
-                cpu->mem_address[cpu->data_counter++] = cpu->execute.memory_address;
-                break;
-            }
-            case OPCODE_BZ:
-            {
-                
-                cpu->execute.type_of_branch=1;
-             
-                if (cpu->zero_flag == TRUE)
-                {
-                    for (int i = 0; i < cpu->btb_queue.size; i++)
-                            {
-                                int index = (cpu->btb_queue.head + i) % cpu->btb_queue.size;
-
-                                if (cpu->execute.pc == cpu->btb_queue.data[index].inst_address && cpu->btb_queue.data[index].executed == 0 && cpu->btb_queue.data[index].prediction_state == 0 && cpu->btb_queue.data[index].num_executed==0)
-                                {
-                                    //first time condition is true
-                                    /* Calculate new PC, and send it to fetch unit */
-                                    cpu->pc = cpu->execute.pc + cpu->execute.imm;
-
-                                    cpu->btb_queue.data[index].executed = 1;
-                                    cpu->btb_queue.data[index].num_executed ++;
-                                    /* Update BTB entry with the correct target address */
-                                    cpu->btb_queue.data[index].target_address = cpu->pc;
-
-                                    /* Predict the outcome and update BTB entry */
-                                    PredictionResult result;
-                                    predict_and_update_btb(&cpu->btb_queue.data[index], 1, cpu->execute.type_of_branch, &result);
-                                    cpu->btb_queue.data[index].prediction_state = result.prediction_state;
-                                    
-                                    cpu->btb_queue.data[index].history_state = result.history_state;
-
-                                    /* Since we are using reverse callbacks for pipeline stages,
-                                    * this will prevent the new instruction from being fetched in the current cycle*/
-                                    cpu->fetch_from_next_cycle = TRUE;
-
-                                    /* Flush previous stages */
-                                    cpu->decode.has_insn = FALSE;
-
-                                    /* Make sure fetch stage is enabled to start fetching from the new PC */
-                                    cpu->fetch.has_insn = TRUE;
-
-                                    break;
-                                }
-                                else if (cpu->execute.pc == cpu->btb_queue.data[index].inst_address && cpu->btb_queue.data[index].num_executed > 0 && cpu->btb_queue.data[index].prediction_state == 0)
-                                    {
-                                        //second time it is running with true
-                                        /* Calculate new PC, and send it to fetch unit */
-                                        cpu->pc = cpu->execute.pc + cpu->execute.imm;
-                                        cpu->btb_queue.data[index].num_executed ++;
-                                        /* Update BTB entry with the correct target address */
-                                        cpu->btb_queue.data[index].target_address = cpu->pc;
-                                        /* Predict the outcome and update BTB entry */
-                                        PredictionResult result;
-                                        predict_and_update_btb(&cpu->btb_queue.data[index], 1, cpu->execute.type_of_branch, &result);
-                                        cpu->btb_queue.data[index].prediction_state = result.prediction_state;
-                                        cpu->btb_queue.data[index].history_state = result.history_state;
-                                        
-                                        /* Since we are using reverse callbacks for pipeline stages,
-                                        * this will prevent the new instruction from being fetched in the current cycle*/
-                                        cpu->fetch_from_next_cycle = TRUE;
-
-                                        /* Flush previous stages */
-                                        cpu->decode.has_insn = FALSE;
-
-                                        /* Make sure fetch stage is enabled to start fetching from new PC */
-                                        cpu->fetch.has_insn = TRUE;
-                                        break;
-                                    }
-                                else if (cpu->execute.pc == cpu->btb_queue.data[index].inst_address && cpu->btb_queue.data[index].num_executed > 0 && cpu->btb_queue.data[index].prediction_state == 1 )
-                                    {
-                                        // second time onwards running for true
-                                        cpu->btb_queue.data[index].num_executed ++;
-                                        PredictionResult result;
-                                        predict_and_update_btb(&cpu->btb_queue.data[index], 1, cpu->execute.type_of_branch, &result);
-                                        cpu->btb_queue.data[index].prediction_state = result.prediction_state;
-                                        cpu->btb_queue.data[index].history_state = result.history_state;
-                                        cpu->btb_queue.data[index].target_address = cpu->execute.pc + cpu->execute.imm;
-                                        
-                                        break;
-                                    }
-    
-                            }
-                    
-                    break; 
-                } 
-        
-                
-                else if (cpu->zero_flag == FALSE)
-                {
-                   
-                    for (int i = 0; i < cpu->btb_queue.size; i++)
-                        {
-                            int index = (cpu->btb_queue.head + i) % cpu->btb_queue.size;
-
-                            if (cpu->execute.pc == cpu->btb_queue.data[index].inst_address && cpu->btb_queue.data[index].num_executed >0 && cpu->btb_queue.data[index].prediction_state == 1)
-                                {
-                                    
-                                    //after it was run before for true now it is false again
-                                    cpu->btb_queue.data[index].num_executed ++;
-                                    /* Predict the outcome and update BTB entry */
-                                    cpu->btb_queue.data[index].target_address = cpu->execute.pc + cpu->execute.imm;
-                                    PredictionResult result;
-                                    predict_and_update_btb(&cpu->btb_queue.data[index], 0, cpu->execute.type_of_branch, &result);
-                                    cpu->btb_queue.data[index].prediction_state = result.prediction_state;
-                                    cpu->btb_queue.data[index].history_state = result.history_state;
-
-                                    //write logic for flushing everything                                  
-                                    /* Since we are using reverse callbacks for pipeline stages,
-                                        * this will prevent the new instruction from being fetched in the current cycle*/
-                                        cpu->fetch_from_next_cycle = TRUE;
-                                    /* Flush previous stages */
-                                        cpu->decode.has_insn = FALSE;
-                                    /* Make sure fetch stage is enabled to start fetching from new PC */
-                                        cpu->fetch.has_insn = TRUE;
-                                        cpu->pc = cpu->execute.pc +4;
-                                    break;
-                                }
-                            else if (cpu->execute.pc == cpu->btb_queue.data[index].inst_address && cpu->btb_queue.data[index].num_executed == 0 && cpu->btb_queue.data[index].prediction_state == 0)
-                                {
-                                    
-                                    // first time and false condition
-                                    cpu->btb_queue.data[index].num_executed ++;
-                                    /* Predict the outcome and update BTB entry */
-                                    cpu->btb_queue.data[index].target_address = cpu->execute.pc + cpu->execute.imm;
-                                    PredictionResult result;
-                                    predict_and_update_btb(&cpu->btb_queue.data[index], 0, cpu->execute.type_of_branch, &result);
-                                    cpu->btb_queue.data[index].prediction_state = result.prediction_state;
-                                    cpu->btb_queue.data[index].history_state = result.history_state;
-                                    break;
-                                }
-                            else if(cpu->execute.pc == cpu->btb_queue.data[index].inst_address && cpu->btb_queue.data[index].num_executed > 0 && cpu->btb_queue.data[index].prediction_state == 0)
-                                {
-                                    
-                                    // second onwards time and false condition
-                                    cpu->btb_queue.data[index].num_executed ++;
-                                    /* Predict the outcome and update BTB entry */
-                                    cpu->btb_queue.data[index].target_address = cpu->execute.pc + cpu->execute.imm;
-                                    PredictionResult result;
-                                    predict_and_update_btb(&cpu->btb_queue.data[index], 0, cpu->execute.type_of_branch, &result);
-                                    cpu->btb_queue.data[index].prediction_state = result.prediction_state;
-                                    cpu->btb_queue.data[index].history_state = result.history_state;
-                                    break;
-                                }
-                        }
-                        break;
-                }
-      
-                break;
-            }
+static void
+execute_storep(APEX_CPU *cpu)
+{
+    cpu->regs_writing[cpu->execute.rs2] = 1;
+    cpu->execute.memory_address = cpu->execute.rs2_value + cpu->execute.imm;
+    cpu->execute.rs2_value = cpu->execute.rs2_value + 4;
+}
 
-            case OPCODE_BNZ:
-            {
-                cpu->execute.type_of_branch=0;
-                
-                if (cpu->zero_flag == FALSE)
-                {
-                   
-                        /* Try to find the BTB entry with matching inst_address */
-                        for (int i = 0; i < cpu->btb_queue.size; i++)
-                            {
-                                int index = (cpu->btb_queue.head + i) % cpu->btb_queue.size;
-
-                                if (cpu->execute.pc == cpu->btb_queue.data[index].inst_address && cpu->btb_queue.data[index].executed == 0 && cpu->btb_queue.data[index].num_executed==0)
-                                {
-                                    // first time runnig when condition is true 
-                                    /* Calculate new PC, and send it to fetch unit */
-                                    cpu->pc = cpu->execute.pc + cpu->execute.imm;
-                                    cpu->btb_queue.data[index].num_executed ++;
-                                    cpu->btb_queue.data[index].executed = 1;
-
-                                    /* Update BTB entry with the correct target address */
-                                    cpu->btb_queue.data[index].target_address = cpu->pc;
-
-                                    /* Predict the outcome and update BTB entry */
-                                    PredictionResult result;
-                                    predict_and_update_btb(&cpu->btb_queue.data[index], 1, cpu->execute.type_of_branch, &result);
-                                    cpu->btb_queue.data[index].prediction_state = result.prediction_state;
-                                    cpu->btb_queue.data[index].history_state = result.history_state;
-
-                                    /* Since we are using reverse callbacks for pipeline stages,
-                                    * this will prevent the new instruction from being fetched in the current cycle*/
-                                    cpu->fetch_from_next_cycle = TRUE;
-
-                                    /* Flush previous stages */
-                                    cpu->decode.has_insn = FALSE;
-
-                                    /* Make sure fetch stage is enabled to start fetching from the new PC */
-                                    cpu->fetch.has_insn = TRUE;
-
-                                    break;
-                                }
-                                else if (cpu->execute.pc == cpu->btb_queue.data[index].inst_address && cpu->btb_queue.data[index].num_executed > 0 && cpu->btb_queue.data[index].prediction_state ==0)
-                                    {
-                                        // it has run multiple time and been false before now it is runnning again
-        
-                                        /* Calculate new PC, and send it to fetch unit */
-                                        cpu->pc = cpu->execute.pc + cpu->execute.imm;
-                                        cpu->btb_queue.data[index].num_executed ++;
-                                        /* Update BTB entry with the correct target address */
-                                        cpu->btb_queue.data[index].target_address = cpu->pc;
-                                        /* Predict the outcome and update BTB entry */
-                                        PredictionResult result;
-                                        predict_and_update_btb(&cpu->btb_queue.data[index], 1, cpu->execute.type_of_branch, &result);
-                                        cpu->btb_queue.data[index].prediction_state = result.prediction_state;
-                                        cpu->btb_queue.data[index].history_state = result.history_state;
-
-                                        /* Since we are using reverse callbacks for pipeline stages,
-                                        * this will prevent the new instruction from being fetched in the current cycle*/
-                                        cpu->fetch_from_next_cycle = TRUE;
-
-                                        /* Flush previous stages */
-                                        cpu->decode.has_insn = FALSE;
-
-                                        /* Make sure fetch stage is enabled to start fetching from new PC */
-                                        cpu->fetch.has_insn = TRUE;
-                                        break;
-                                    }
-                                else if (cpu->execute.pc == cpu->btb_queue.data[index].inst_address && cpu->btb_queue.data[index].num_executed > 0 && cpu->btb_queue.data[index].prediction_state == 1 )
-                                    {
-                                        //when it was running with everything true and prediction is also right
-                                        cpu->btb_queue.data[index].num_executed ++;
-                                        PredictionResult result;
-                                        predict_and_update_btb(&cpu->btb_queue.data[index], 1, cpu->execute.type_of_branch, &result);
-                                        cpu->btb_queue.data[index].prediction_state = result.prediction_state;
-                                        cpu->btb_queue.data[index].history_state = result.history_state;
-                                        cpu->btb_queue.data[index].target_address = cpu->execute.pc + cpu->execute.imm ;
-
-                                        break;
-                                    }
-    
-                                
-                            }
-                        break;  
-                }
-                
-                else if (cpu->zero_flag == TRUE )
-                {
-                    for (int i = 0; i < cpu->btb_queue.size; i++)
-                        {
-                            int index = (cpu->btb_queue.head + i) % cpu->btb_queue.size;
-
-                            if (cpu->execute.pc == cpu->btb_queue.data[index].inst_address && cpu->btb_queue.data[index].num_executed > 0 && cpu->btb_queue.data[index].prediction_state == 1)
-                                {
-                                   
-                                    //after many trues false
-                                    cpu->btb_queue.data[index].num_executed ++;
-                                    /* Predict the outcome and update BTB entry */
-                                    cpu->btb_queue.data[index].target_address = cpu->execute.pc +cpu->execute.imm;
-                                    PredictionResult result;
-                                    predict_and_update_btb(&cpu->btb_queue.data[index], 0, cpu->execute.type_of_branch, &result);
-                                    cpu->btb_queue.data[index].prediction_state = result.prediction_state;
-                                    cpu->btb_queue.data[index].history_state = result.history_state;
-                                    //write logic for flushing everything                                  
-                                    /* Since we are using reverse callbacks for pipeline stages,
-                                        * this will prevent the new instruction from being fetched in the current cycle*/
-                                        cpu->fetch_from_next_cycle = TRUE;
-                                    /* Flush previous stages */
-                                        cpu->decode.has_insn = FALSE;
-                                    /* Make sure fetch stage is enabled to start fetching from new PC */
-                                        cpu->fetch.has_insn = TRUE;
-                                        cpu->pc = cpu->execute.pc +4;
-                                    break;
-                                }
-                            else if (cpu->execute.pc == cpu->btb_queue.data[index].inst_address && cpu->btb_queue.data[index].num_executed > 0 &&cpu->btb_queue.data[index].prediction_state == 0 && cpu->btb_queue.data[index].history_state < 3)
-                                {
-                                    
-                                    // third onwards time coming and it is still false
-                                    cpu->btb_queue.data[index].num_executed ++;
-                                    /* Predict the outcome and update BTB entry */
-                                    cpu->btb_queue.data[index].target_address = cpu->execute.pc + cpu->execute.imm;
-                                    PredictionResult result;
-                                    predict_and_update_btb(&cpu->btb_queue.data[index], 0, cpu->execute.type_of_branch, &result);
-                                    cpu->btb_queue.data[index].prediction_state = result.prediction_state;
-                                    cpu->btb_queue.data[index].history_state = result.history_state;
-                                    break;
-                                }
-                            else if (cpu->execute.pc == cpu->btb_queue.data[index].inst_address && cpu->btb_queue.data[index].num_executed == 1 &&cpu->btb_queue.data[index].prediction_state == 1 && cpu->btb_queue.data[index].history_state <= 3)
-                                {
-                                    
-                                    //second time it is false
-                                    cpu->btb_queue.data[index].num_executed ++;
-                                    /* Predict the outcome and update BTB entry */
-                                    cpu->btb_queue.data[index].target_address = cpu->execute.pc + cpu->execute.imm;
-                                    PredictionResult result;
-                                    predict_and_update_btb(&cpu->btb_queue.data[index], 0, cpu->execute.type_of_branch, &result);
-                                    cpu->btb_queue.data[index].prediction_state = result.prediction_state;
-                                    cpu->btb_queue.data[index].history_state = result.history_state;
-                                    //write logic for flushing everything                                  
-                                    /* Since we are using reverse callbacks for pipeline stages,
-                                        * this will prevent the new instruction from being fetched in the current cycle*/
-                                        cpu->fetch_from_next_cycle = TRUE;
-                                    /* Flush previous stages */
-                                        cpu->decode.has_insn = FALSE;
-                                    /* Make sure fetch stage is enabled to start fetching from new PC */
-                                        cpu->fetch.has_insn = TRUE;
-                                        cpu->pc = cpu->execute.pc +4;
-                                    break;
-                                }
-                            else if (cpu->execute.pc == cpu->btb_queue.data[index].inst_address && cpu->btb_queue.data[index].num_executed == 0 &&cpu->btb_queue.data[index].prediction_state == 1 && cpu->btb_queue.data[index].history_state <= 3)
-                                {
-                                   
-                                    //first time it is false
-                                    cpu->btb_queue.data[index].num_executed ++;
-                                    /* Predict the outcome and update BTB entry */
-                                    cpu->btb_queue.data[index].target_address = cpu->execute.pc + cpu->execute.imm;
-                                    PredictionResult result;
-                                    predict_and_update_btb(&cpu->btb_queue.data[index], 0, cpu->execute.type_of_branch, &result);
-                                    cpu->btb_queue.data[index].prediction_state = result.prediction_state;
-                                    cpu->btb_queue.data[index].history_state = result.history_state;
-                                    break;
-                                }
-                        }
-                    
-                    break;
-                }
-                
-            }
-            case OPCODE_BN:
-            {
-                if (cpu->cc.n == TRUE)
-                {
-                    /* Calculate new PC, and send it to fetch unit */
-                    cpu->pc = cpu->execute.pc + cpu->execute.imm;
+static void
+execute_bz(APEX_CPU *cpu)
+{
+    resolve_conditional_branch(cpu, cpu->zero_flag == TRUE ? TAKEN : NOT_TAKEN);
+}
 
-                    /* Since we are using reverse callbacks for pipeline stages,
-                     * this will prevent the new instruction from being fetched in the current cycle*/
-                    cpu->fetch_from_next_cycle = TRUE;
+static void
+execute_bnz(APEX_CPU *cpu)
+{
+    resolve_conditional_branch(cpu, cpu->zero_flag == FALSE ? TAKEN : NOT_TAKEN);
+}
 
-                    /* Flush previous stages */
-                    cpu->decode.has_insn = FALSE;
+static void
+execute_bp(APEX_CPU *cpu)
+{
+    resolve_conditional_branch(cpu, cpu->cc.p == TRUE ? TAKEN : NOT_TAKEN);
+}
 
-                    /* Make sure fetch stage is enabled to start fetching from new PC */
-                    cpu->fetch.has_insn = TRUE;
-                }
-                break;
-            }
-            case OPCODE_BNN:
-            {
-                if (cpu->cc.n == FALSE)
-                {
-                    /* Calculate new PC, and send it to fetch unit */
-                    cpu->pc = cpu->execute.pc + cpu->execute.imm;
+static void
+execute_bnp(APEX_CPU *cpu)
+{
+    resolve_conditional_branch(cpu, cpu->cc.p == FALSE ? TAKEN : NOT_TAKEN);
+}
 
-                    /* Since we are using reverse callbacks for pipeline stages,
-                     * this will prevent the new instruction from being fetched in the current cycle*/
-                    cpu->fetch_from_next_cycle = TRUE;
+/*
+ * BN and BNN are not tracked by the BTB. Fetch always falls through past
+ * them, so a taken one is a misprediction that redirects.
+ */
+static void
+resolve_untracked_branch(APEX_CPU *cpu, int outcome, int target)
+{
+    record_branch_outcome(cpu, &cpu->execute, NOT_TAKEN, outcome, target);
+    if (outcome == TAKEN)
+    {
+        redirect_fetch(cpu, target, FLUSH_DIRECTION);
+    }
+}
 
-                    /* Flush previous stages */
-                    cpu->decode.has_insn = FALSE;
-
-                    /* Make sure fetch stage is enabled to start fetching from new PC */
-                    cpu->fetch.has_insn = TRUE;
-                }
-                break;
-            }
-            case OPCODE_BP:
-            {
-                cpu->execute.type_of_branch=0;
-                
-                if (cpu->cc.p == TRUE)
-                {
-                    
-                       for (int i = 0; i < cpu->btb_queue.size; i++)
-                            {
-                                int index = (cpu->btb_queue.head + i) % cpu->btb_queue.size;
-                                
-                                if (cpu->execute.pc == cpu->btb_queue.data[index].inst_address && cpu->btb_queue.data[index].executed == 0 && cpu->btb_queue.data[index].prediction_state ==1 && cpu->btb_queue.data[index].num_executed==0)
-                                {
-                                    // first time true
-                                    cpu->btb_queue.data[index].executed =1;
-                                    cpu->btb_queue.data[index].num_executed ++;
-                                    /* Calculate new PC, and send it to fetch unit */
-                                    cpu->pc = cpu->execute.pc + cpu->execute.imm;
-
-                                    /* Update BTB entry with the correct target address */
-                                    cpu->btb_queue.data[index].target_address = cpu->pc;
-
-                                    /* Predict the outcome and update BTB entry */
-                                    //cpu->btb_queue.data[index].prediction_state = predict_and_update_btb(&cpu->btb_queue.data[index], 1, cpu->execute.type_of_branch);
-                                    PredictionResult result;
-                                    predict_and_update_btb(&cpu->btb_queue.data[index], 1, cpu->execute.type_of_branch, &result);
-                                    cpu->btb_queue.data[index].prediction_state = result.prediction_state;
-                                    cpu->btb_queue.data[index].history_state = result.history_state;
-
-                                    /* Since we are using reverse callbacks for pipeline stages,
-                                    * this will prevent the new instruction from being fetched in the current cycle*/
-                                    cpu->fetch_from_next_cycle = TRUE;
-
-                                    /* Flush previous stages */
-                                    cpu->decode.has_insn = FALSE;
-
-                                    /* Make sure fetch stage is enabled to start fetching from new PC */
-                                    cpu->fetch.has_insn = TRUE;
-
-                                    break;
-                                }
-                            else if (cpu->execute.pc == cpu->btb_queue.data[index].inst_address && cpu->btb_queue.data[index].num_executed > 0 && cpu->btb_queue.data[index].prediction_state == 0 )
-                                    {
-                                        // after many false true again
-                                        /* Calculate new PC, and send it to fetch unit */
-                                        cpu->pc = cpu->execute.pc + cpu->execute.imm;
-                                        cpu->btb_queue.data[index].num_executed ++;
-                                        /* Update BTB entry with the correct target address */
-                                        cpu->btb_queue.data[index].target_address = cpu->pc;
-                                        /* Predict the outcome and update BTB entry */
-                                        //cpu->btb_queue.data[index].prediction_state = predict_and_update_btb(&cpu->btb_queue.data[index], 1, cpu->execute.type_of_branch);
-                                        PredictionResult result;
-                                        predict_and_update_btb(&cpu->btb_queue.data[index], 1, cpu->execute.type_of_branch, &result);
-                                        cpu->btb_queue.data[index].prediction_state = result.prediction_state;
-                                        cpu->btb_queue.data[index].history_state = result.history_state;
-
-                                        /* Since we are using reverse callbacks for pipeline stages,
-                                        * this will prevent the new instruction from being fetched in the current cycle*/
-                                        cpu->fetch_from_next_cycle = TRUE;
-
-                                        /* Flush previous stages */
-                                        cpu->decode.has_insn = FALSE;
-
-                                        /* Make sure fetch stage is enabled to start fetching from new PC */
-                                        cpu->fetch.has_insn = TRUE;
-                                        break;
-                                    }
-                                else if (cpu->execute.pc == cpu->btb_queue.data[index].inst_address && cpu->btb_queue.data[index].num_executed > 0 && cpu->btb_queue.data[index].prediction_state == 1 )
-                                    {
-                                        
-                                        cpu->btb_queue.data[index].num_executed ++;
-                                        cpu->btb_queue.data[index].target_address = cpu->execute.pc + cpu->execute.imm;
-                                        //cpu->btb_queue.data[index].prediction_state = predict_and_update_btb(&cpu->btb_queue.data[index], 1, cpu->execute.type_of_branch);
-                                        PredictionResult result;
-                                        predict_and_update_btb(&cpu->btb_queue.data[index], 1, cpu->execute.type_of_branch, &result);
-                                        cpu->btb_queue.data[index].prediction_state = result.prediction_state;
-                                        cpu->btb_queue.data[index].history_state = result.history_state;
-
-                                        break;
-                                    }
-                                
-                                
-                            }
-                        break;
-                }
-                
-                
-                
-                else if (cpu->cc.p == FALSE)
-                {
-                    
-                    for (int i = 0; i < cpu->btb_queue.size; i++)
-                        {
-                            int index = (cpu->btb_queue.head + i) % cpu->btb_queue.size;
-
-                            if (cpu->execute.pc == cpu->btb_queue.data[index].inst_address && cpu->btb_queue.data[index].num_executed == 1 &&cpu->btb_queue.data[index].prediction_state == 1)
-                                {
-                                    //second time false
-                                    cpu->btb_queue.data[index].num_executed ++;
-                                    /* Predict the outcome and update BTB entry */
-                                    cpu->btb_queue.data[index].target_address = cpu->execute.pc + cpu->execute.imm;
-                                    PredictionResult result;
-                                    predict_and_update_btb(&cpu->btb_queue.data[index], 0, cpu->execute.type_of_branch, &result);
-                                    cpu->btb_queue.data[index].prediction_state = result.prediction_state;
-                                    cpu->btb_queue.data[index].history_state = result.history_state;
-
-                                    //write logic for flushing everything 
-                                    /* Since we are using reverse callbacks for pipeline stages,
-                                        * this will prevent the new instruction from being fetched in the current cycle*/
-                                        cpu->fetch_from_next_cycle = TRUE;
-                                    /* Flush previous stages */
-                                        cpu->decode.has_insn = FALSE;
-                                    /* Make sure fetch stage is enabled to start fetching from new PC */
-                                        cpu->fetch.has_insn = TRUE;
-                                        cpu->pc = cpu->execute.pc +4;
-                                    break;
-                                }
-                            else if (cpu->execute.pc == cpu->btb_queue.data[index].inst_address && cpu->btb_queue.data[index].num_executed == 0 &&cpu->btb_queue.data[index].prediction_state == 1 && cpu->btb_queue.data[index].history_state <= 3)
-                                {
-                                    
-                                    //first time it is false
-                                    cpu->btb_queue.data[index].num_executed ++;
-                                    /* Predict the outcome and update BTB entry */
-                                    cpu->btb_queue.data[index].target_address = cpu->execute.pc + cpu->execute.imm;
-                                    PredictionResult result;
-                                    predict_and_update_btb(&cpu->btb_queue.data[index], 0, cpu->execute.type_of_branch, &result);
-                                    cpu->btb_queue.data[index].prediction_state = result.prediction_state;
-                                    cpu->btb_queue.data[index].history_state = result.history_state;
-                                    break;
-                                }
-                            else if (cpu->execute.pc == cpu->btb_queue.data[index].inst_address && cpu->btb_queue.data[index].num_executed > 0 &&cpu->btb_queue.data[index].prediction_state == 0)
-                                {
-                                    //third time onwards and still false
-                                    cpu->btb_queue.data[index].num_executed ++;
-                                    /* Predict the outcome and update BTB entry */
-                                    cpu->btb_queue.data[index].target_address = cpu->execute.pc + cpu->execute.imm;
-                                    PredictionResult result;
-                                    predict_and_update_btb(&cpu->btb_queue.data[index], 0, cpu->execute.type_of_branch, &result);
-                                    cpu->btb_queue.data[index].prediction_state = result.prediction_state;
-                                    cpu->btb_queue.data[index].history_state = result.history_state;
-                                    break;
-                                }
-                            else if (cpu->execute.pc == cpu->btb_queue.data[index].inst_address && cpu->btb_queue.data[index].num_executed > 0 &&cpu->btb_queue.data[index].prediction_state == 1)
-                                {
-                                    //after many trues false
-                                    cpu->btb_queue.data[index].num_executed ++;
-                                    /* Predict the outcome and update BTB entry */
-                                    cpu->btb_queue.data[index].target_address = cpu->execute.pc + cpu->execute.imm;
-                                    PredictionResult result;
-                                    predict_and_update_btb(&cpu->btb_queue.data[index], 0, cpu->execute.type_of_branch, &result);
-                                    cpu->btb_queue.data[index].prediction_state = result.prediction_state;
-                                    cpu->btb_queue.data[index].history_state = result.history_state;
-                                    //write logic for flushing everything                                  
-                                    /* Since we are using reverse callbacks for pipeline stages,
-                                        * this will prevent the new instruction from being fetched in the current cycle*/
-                                        cpu->fetch_from_next_cycle = TRUE;
-                                    /* Flush previous stages */
-                                        cpu->decode.has_insn = FALSE;
-                                    /* Make sure fetch stage is enabled to start fetching from new PC */
-                                        cpu->fetch.has_insn = TRUE;
-                                        cpu->pc = cpu->execute.pc +4;
-                                    break;
-                                }
-                        }
-                    break;
-                
-                }
-            }
-            case OPCODE_BNP:
-            {
-                cpu->execute.type_of_branch=1;
-                
-                if (cpu->cc.p == FALSE)
-                {
-                   
-                       for (int i = 0; i < cpu->btb_queue.size; i++)
-                            {
-                                int index = (cpu->btb_queue.head + i) % cpu->btb_queue.size;
-                                
-                                if (cpu->execute.pc == cpu->btb_queue.data[index].inst_address && cpu->btb_queue.data[index].executed == 0 && cpu->btb_queue.data[index].prediction_state == 0 && cpu->btb_queue.data[index].num_executed == 0)
-                                {
-                                    //first time true
-                                    cpu->btb_queue.data[index].executed =1;
-                                    cpu->btb_queue.data[index].num_executed ++;
-                                    /* Calculate new PC, and send it to fetch unit */
-                                    cpu->pc = cpu->execute.pc + cpu->execute.imm;
-
-                                    /* Update BTB entry with the correct target address */
-                                    cpu->btb_queue.data[index].target_address = cpu->pc;
-
-                                    /* Predict the outcome and update BTB entry */
-                                    //cpu->btb_queue.data[index].prediction_state = predict_and_update_btb(&cpu->btb_queue.data[index], 1, cpu->execute.type_of_branch);
-                                    PredictionResult result;
-                                    predict_and_update_btb(&cpu->btb_queue.data[index], 1, cpu->execute.type_of_branch, &result);
-                                    cpu->btb_queue.data[index].prediction_state = result.prediction_state;
-                                    cpu->btb_queue.data[index].history_state = result.history_state;
-
-                                    /* Since we are using reverse callbacks for pipeline stages,
-                                    * this will prevent the new instruction from being fetched in the current cycle*/
-                                    cpu->fetch_from_next_cycle = TRUE;
-
-                                    /* Flush previous stages */
-                                    cpu->decode.has_insn = FALSE;
-
-                                    /* Make sure fetch stage is enabled to start fetching from new PC */
-                                    cpu->fetch.has_insn = TRUE;
-
-                                    break;
-                                }
-                            else if (cpu->execute.pc == cpu->btb_queue.data[index].inst_address && cpu->btb_queue.data[index].num_executed > 0 && cpu->btb_queue.data[index].prediction_state == 0 )
-                                    {
-                                        //second time true and for true which come after many false
-                                        cpu->btb_queue.data[index].num_executed ++;
-                                        /* Calculate new PC, and send it to fetch unit */
-                                        cpu->pc = cpu->execute.pc + cpu->execute.imm;
-                                        /* Update BTB entry with the correct target address */
-                                        cpu->btb_queue.data[index].target_address = cpu->pc;
-                                        /* Predict the outcome and update BTB entry */
-                                        PredictionResult result;
-                                        predict_and_update_btb(&cpu->btb_queue.data[index], 1, cpu->execute.type_of_branch, &result);
-                                        cpu->btb_queue.data[index].prediction_state = result.prediction_state;
-                                        cpu->btb_queue.data[index].history_state = result.history_state;
-
-                                        /* Since we are using reverse callbacks for pipeline stages,
-                                        * this will prevent the new instruction from being fetched in the current cycle*/
-                                        cpu->fetch_from_next_cycle = TRUE;
-
-                                        /* Flush previous stages */
-                                        cpu->decode.has_insn = FALSE;
-
-                                        /* Make sure fetch stage is enabled to start fetching from new PC */
-                                        cpu->fetch.has_insn = TRUE;
-                                        break;
-                                    }
-                                else if (cpu->execute.pc == cpu->btb_queue.data[index].inst_address && cpu->btb_queue.data[index].num_executed > 0 && cpu->btb_queue.data[index].prediction_state == 1 )
-                                    {
-                                        //3 onwards and still true
-                                        cpu->btb_queue.data[index].num_executed ++;
-                                        cpu->btb_queue.data[index].target_address = cpu->execute.pc + cpu->execute.imm ;
-                                        PredictionResult result;
-                                        predict_and_update_btb(&cpu->btb_queue.data[index], 1, cpu->execute.type_of_branch, &result);
-                                        cpu->btb_queue.data[index].prediction_state = result.prediction_state;
-                                        cpu->btb_queue.data[index].history_state = result.history_state;
-
-                                        break;
-                                    }
-                                
-                            }
-                        
-                            break;
-                        
-                        
-                }
-                
-                else if (cpu->cc.p == TRUE) 
-                {
-                    
-                    for (int i = 0; i < cpu->btb_queue.size; i++)
-                        {
-                            int index = (cpu->btb_queue.head + i) % cpu->btb_queue.size;
-
-                            if (cpu->execute.pc == cpu->btb_queue.data[index].inst_address && cpu->btb_queue.data[index].prediction_state ==1 && cpu->btb_queue.data[index].num_executed > 0)
-                                {
-                                    
-                                    //after many trues false
-                                    cpu->btb_queue.data[index].num_executed ++;
-                                    /* Predict the outcome and update BTB entry */
-                                    cpu->btb_queue.data[index].target_address = cpu->execute.pc + cpu->execute.imm;
-                                    PredictionResult result;
-                                    predict_and_update_btb(&cpu->btb_queue.data[index], 0, cpu->execute.type_of_branch, &result);
-                                    cpu->btb_queue.data[index].prediction_state = result.prediction_state;
-                                    cpu->btb_queue.data[index].history_state = result.history_state;
-                                    //write logic for flushing everything 
-                                    /* Since we are using reverse callbacks for pipeline stages,
-                                    * this will prevent the new instruction from being fetched in the current cycle*/
-                                    cpu->fetch_from_next_cycle = TRUE;
-                                    /* Flush previous stages */
-                                    cpu->decode.has_insn = FALSE;
-                                    /* Make sure fetch stage is enabled to start fetching from new PC */
-                                    cpu->fetch.has_insn = TRUE;
-                                    cpu->pc = cpu->execute.pc +4;
-                                    break;
-                                }
-                            else if (cpu->execute.pc == cpu->btb_queue.data[index].inst_address && cpu->btb_queue.data[index].prediction_state == 0 && cpu->btb_queue.data[index].num_executed >= 0)
-                                {
-                                    
-                                    //first onwards and contious to be false
-                                    cpu->btb_queue.data[index].num_executed ++;
-                                    /* Predict the outcome and update BTB entry */
-                                    cpu->btb_queue.data[index].target_address = cpu->execute.pc + cpu->execute.imm;
-                                    //cpu->btb_queue.data[index].prediction_state = predict_and_update_btb(&cpu->btb_queue.data[index], 0, cpu->execute.type_of_branch);
-                                    PredictionResult result;
-                                    predict_and_update_btb(&cpu->btb_queue.data[index], 0, cpu->execute.type_of_branch, &result);
-                                    cpu->btb_queue.data[index].prediction_state = result.prediction_state;
-                                    cpu->btb_queue.data[index].history_state = result.history_state;
-                                    break;
-                                }
-                        }
-                        break;
-                
-                }
-                
-            }
-            case OPCODE_JUMP:
-            {
-                /* Calculate new PC, and send it to fetch unit */
-                cpu->pc = cpu->execute.rs1_value + cpu->execute.imm;
-
-                /* Since we are using reverse callbacks for pipeline stages,
-                    * this will prevent the new instruction from being fetched in the current cycle*/
-                cpu->fetch_from_next_cycle = TRUE;
-
-                /* Flush previous stages */
-                cpu->decode.has_insn = FALSE;
-
-                /* Make sure fetch stage is enabled to start fetching from new PC */
-                cpu->fetch.has_insn = TRUE;
+static void
+execute_bn(APEX_CPU *cpu)
+{
+    resolve_untracked_branch(cpu, cpu->cc.n == TRUE ? TAKEN : NOT_TAKEN,
+                             cpu->execute.pc + cpu->execute.imm);
+}
 
-                break;
-            }
-            case OPCODE_JALR:
-            {   
-                if(cpu->regs_writing[cpu->memory.rd] == 0){
-                  cpu->regs_writing[cpu->memory.rd] = 1;
-                }
+static void
+execute_bnn(APEX_CPU *cpu)
+{
+    resolve_untracked_branch(cpu, cpu->cc.n == FALSE ? TAKEN : NOT_TAKEN,
+                             cpu->execute.pc + cpu->execute.imm);
+}
 
-                /* Calculate new PC, and send it to fetch unit */
-                cpu->execute.result_buffer = cpu->execute.pc + 4;
-                cpu->pc = cpu->execute.rs1_value + cpu->execute.imm;
+/*
+ * Applies the call or return in stage, once resolved, to the resolved return
+ * address stack, which only ever sees correct path instructions, and counts
+ * it
+ *
+ * Returns TRUE if the instruction was a return
+ */
+int
+resolve_return_stack(APEX_CPU *cpu, const CPU_Stage *stage, int target)
+{
+    ras_stats *counters = &cpu->stats.ras;
 
+    if (cpu->ras_resolved.depth == 0)
+    {
+        return FALSE;
+    }
+    if (stage->opcode == OPCODE_JALR)
+    {
+        counters->calls++;
+        if (ras_push(&cpu->ras_resolved, stage->pc + 4, stage->rd))
+        {
+            counters->overflows++;
+        }
+        return FALSE;
+    }
+    if (!ras_is_return(&cpu->ras_resolved, stage->rs1))
+    {
+        return FALSE;
+    }
 
-                /* Since we are using reverse callbacks for pipeline stages,
-                    * this will prevent the new instruction from being fetched in the current cycle*/
-                cpu->fetch_from_next_cycle = TRUE;
+    counters->returns++;
+    if (!ras_top(&cpu->ras_resolved))
+    {
+        counters->underflows++;
+    }
+    ras_pop(&cpu->ras_resolved);
+    if (stage->btb_searched && stage->pred_target == target)
+    {
+        counters->correct++;
+    }
+    else
+    {
+        counters->incorrect++;
+    }
+    return TRUE;
+}
 
-                /* Flush previous stages */
-                cpu->decode.has_insn = FALSE;
+/*
+ * JUMP and JALR always transfer to target. Fetch has only gone there if the
+ * return address stack or the indirect predictor predicted it; otherwise, or
+ * when the predicted target was wrong, the jump counts as predicted not taken
+ * and redirects. Returns are left to the return address stack, every other
+ * jump trains the indirect predictor.
+ */
+static void
+resolve_indirect_branch(APEX_CPU *cpu, int target)
+{
+    int followed = cpu->execute.btb_searched && cpu->execute.pred_target == target;
 
-                /* Make sure fetch stage is enabled to start fetching from new PC */
-                cpu->fetch.has_insn = TRUE;
+    stats_record_target(&cpu->stats, cpu->execute.pc, target);
+    if (!resolve_return_stack(cpu, &cpu->execute, target))
+    {
+        indirect_update(&cpu->indirect, cpu->execute.pc, target, cpu->execute.pred_meta);
+    }
+    record_branch_outcome(cpu, &cpu->execute, followed ? TAKEN : NOT_TAKEN, TAKEN, target);
+    if (!followed)
+    {
+        redirect_fetch(cpu, target, FLUSH_TARGET);
+    }
+}
 
-                break;
-            }
+static void
+execute_jump(APEX_CPU *cpu)
+{
+    resolve_indirect_branch(cpu, cpu->execute.rs1_value + cpu->execute.imm);
+}
 
-            case OPCODE_MOVC:
-            {
-              if(cpu->regs_writing[cpu->execute.rd] == 0){
-                cpu->regs_writing[cpu->execute.rd] = 1;
-              }
-                cpu->execute.result_buffer = cpu->execute.imm + 0;
-                cpu->ex_fb.reg= cpu->execute.rd;
-                cpu->ex_fb.value = cpu->execute.result_buffer;
-                break;
-            }
-            case OPCODE_CML:
-            {
-                cpu->execute.result_buffer = cpu->execute.rs1_value-cpu->execute.imm;
+static void
+execute_jalr(APEX_CPU *cpu)
+{
+    cpu->regs_writing[cpu->execute.rd] = 1;
+    cpu->execute.result_buffer = cpu->execute.pc + 4;
+    resolve_indirect_branch(cpu, cpu->execute.rs1_value + cpu->execute.imm);
+}
 
-                if(cpu->execute.result_buffer<0){
-                    cpu->cc.p = FALSE;
-                    cpu->cc.n = TRUE;
-                    cpu->cc.z = FALSE;
-                    cpu->zero_flag = FALSE;
-                }
-                else if(cpu->execute.result_buffer>0){
-                    cpu->cc.p = TRUE;
-                    cpu->cc.n = FALSE;
-                    cpu->cc.z = FALSE;
-                    cpu->zero_flag = FALSE;
-                }
+/* Execute stage work per opcode, NOP, HALT and DIV have none */
+typedef void (*execute_fn)(APEX_CPU *cpu);
+
+static const execute_fn execute_table[NUM_OPCODES] = {
+    [OPCODE_ADD] = execute_alu,
+    [OPCODE_ADDL] = execute_alu,
+    [OPCODE_SUB] = execute_alu,
+    [OPCODE_SUBL] = execute_alu,
+    [OPCODE_MUL] = execute_alu,
+    [OPCODE_AND] = execute_alu,
+    [OPCODE_OR] = execute_alu,
+    [OPCODE_XOR] = execute_alu,
+    [OPCODE_CMP] = execute_compare,
+    [OPCODE_CML] = execute_compare,
+    [OPCODE_MOVC] = execute_movc,
+    [OPCODE_LOAD] = execute_load,
+    [OPCODE_LOADP] = execute_loadp,
+    [OPCODE_STORE] = execute_store,
+    [OPCODE_STOREP] = execute_storep,
+    [OPCODE_BZ] = execute_bz,
+    [OPCODE_BNZ] = execute_bnz,
+    [OPCODE_BP] = execute_bp,
+    [OPCODE_BNP] = execute_bnp,
+    [OPCODE_BN] = execute_bn,
+    [OPCODE_BNN] = execute_bnn,
+    [OPCODE_JUMP] = execute_jump,
+    [OPCODE_JALR] = execute_jalr,
+};
 
-                /* Set the zero flag based on the result buffer */
-                else if (cpu->execute.result_buffer == 0)
-                {
-                    cpu->cc.p = FALSE;
-                    cpu->cc.n = FALSE;
-                    cpu->cc.z = TRUE;
-                    cpu->zero_flag = TRUE;
-                }
-                break;
-            }
-            case OPCODE_CMP:
-            {
-                cpu->execute.result_buffer = cpu->execute.rs1_value-cpu->execute.rs2_value;
+/*
+ * Drives every destination register of stage onto the forwarding network.
+ * A load's value only exists after memory, in execute it claims rd so that
+ * older values of the register are not forwarded past it.
+ */
+static void
+forward_results(APEX_CPU *cpu, int producer, const CPU_Stage *stage)
+{
+    if (stage->flags & INSN_WRITES_RD)
+    {
+        forward_drive(&cpu->forward, producer, stage->rd, stage->result_buffer,
+                      producer != FORWARD_EXECUTE || !(stage->flags & INSN_MEMORY));
+    }
+    if (stage->flags & INSN_WRITES_RS1)
+    {
+        forward_drive(&cpu->forward, producer, stage->rs1, stage->rs1_value, TRUE);
+    }
+    if (stage->flags & INSN_WRITES_RS2)
+    {
+        forward_drive(&cpu->forward, producer, stage->rs2, stage->rs2_value, TRUE);
+    }
+}
 
-                if(cpu->execute.result_buffer<0){
-                    cpu->cc.p = FALSE;
-                    cpu->cc.n = TRUE;
-                    cpu->cc.z = FALSE;
-                    cpu->zero_flag = FALSE;
-                }
-                else if(cpu->execute.result_buffer>0){
-                    cpu->cc.p = TRUE;
-                    cpu->cc.n = FALSE;
-                    cpu->cc.z = FALSE;
-                    cpu->zero_flag = FALSE;
-                }
+/*
+ * Execute Stage of APEX Pipeline
+ *
+ * Note: You are free to edit this function according to your implementation
+ */
+static void
+APEX_execute(APEX_CPU *cpu)
+{
+    if (cpu->execute.has_insn)
+    {
+        if (cpu->kanata)
+        {
+            kanata_stage(cpu->kanata, cpu->clock, cpu->execute.seq, KANATA_EXECUTE);
+        }
 
-                /* Set the zero flag based on the result buffer */
-                else if (cpu->execute.result_buffer == 0)
-                {
-                    cpu->cc.p = FALSE;
-                    cpu->cc.n = FALSE;
-                    cpu->cc.z = TRUE;
-                    cpu->zero_flag = TRUE;
-                }
+        /* Execute logic based on instruction type */
+        execute_fn handler = execute_table[cpu->execute.opcode];
 
-                break;
-            }
+        if (handler)
+        {
+            handler(cpu);
         }
+        forward_results(cpu, FORWARD_EXECUTE, &cpu->execute);
 
         /* Copy data from execute latch to memory latch*/
         cpu->memory = cpu->execute;
         cpu->execute.has_insn = FALSE;
 
-         if (ENABLE_DEBUG_MESSAGES)
+        if (DEBUG_ON(cpu))
         {
             print_stage_content("Execute", &cpu->execute);
         }
@@ -1918,6 +1089,18 @@ APEX_execute(APEX_CPU *cpu)
 
 }
 
+/*
+ * Reports a load or store in the memory stage outside data memory. The run
+ * ends at the end of the cycle.
+ */
+static void
+memory_fault(APEX_CPU *cpu)
+{
+    fprintf(stderr, "APEX_Error: Data memory address %d out of range (size %d) at pc %d\n",
+            cpu->memory.memory_address, cpu->data_memory.size, cpu->memory.pc);
+    cpu->fault = TRUE;
+}
+
 /*
  * Memory Stage of APEX Pipeline
  *
@@ -1928,6 +1111,11 @@ APEX_memory(APEX_CPU *cpu)
 {
     if (cpu->memory.has_insn)
     {
+        if (cpu->kanata)
+        {
+            kanata_stage(cpu->kanata, cpu->clock, cpu->memory.seq, KANATA_MEMORY);
+        }
+
         switch (cpu->memory.opcode)
         {
             case OPCODE_ADD:
@@ -1944,16 +1132,12 @@ APEX_memory(APEX_CPU *cpu)
                 if(cpu->regs_writing[cpu->memory.rd] == 0){
                   cpu->regs_writing[cpu->memory.rd] = 1;
                 }
-                cpu->mem_fb.reg= cpu->memory.rd;
-                cpu->mem_fb.value = cpu->memory.result_buffer;
                 break;
             }
             case OPCODE_MOVC:{
               if(cpu->regs_writing[cpu->memory.rd] == 0){
                 cpu->regs_writing[cpu->memory.rd] = 1;
               }
-              cpu->mem_fb.reg= cpu->memory.rd;
-              cpu->mem_fb.value = cpu->memory.result_buffer;
                 break;
             }
 
@@ -1962,9 +1146,11 @@ APEX_memory(APEX_CPU *cpu)
                 cpu->regs_writing[cpu->memory.rd] = 1;
               }
                 /* Read from data memory */
-                cpu->memory.result_buffer = cpu->data_memory[cpu->memory.memory_address];
-                cpu->mem_fb.reg= cpu->memory.rd;
-                cpu->mem_fb.value = cpu->memory.result_buffer;
+                if (memory_read(&cpu->data_memory, cpu->memory.memory_address,
+                                &cpu->memory.result_buffer) != 0)
+                {
+                    memory_fault(cpu);
+                }
                 break;
             }
             case OPCODE_LOADP:
@@ -1976,9 +1162,11 @@ APEX_memory(APEX_CPU *cpu)
                 cpu->regs_writing[cpu->memory.rs1] = 1;
               }
                 /* Read from data memory */
-                cpu->memory.result_buffer = cpu->data_memory[cpu->memory.memory_address];
-                cpu->mem_fb.reg= cpu->memory.rd;
-                cpu->mem_fb.value = cpu->memory.result_buffer;
+                if (memory_read(&cpu->data_memory, cpu->memory.memory_address,
+                                &cpu->memory.result_buffer) != 0)
+                {
+                    memory_fault(cpu);
+                }
                 break;
             }
 
@@ -1986,11 +1174,11 @@ APEX_memory(APEX_CPU *cpu)
             {
 
                 /* Read from data memory */
-                cpu->data_memory[cpu->memory.memory_address]= cpu->memory.rs1_value;
-                // cpu->mem_fb.reg= -1;
-                // cpu->mem_fb.value = 0;
-                cpu->mem_fb.reg= cpu->memory.rs2;
-                cpu->mem_fb.value = cpu->memory.rs2_value;
+                if (memory_write(&cpu->data_memory, cpu->memory.memory_address,
+                                 cpu->memory.rs1_value) != 0)
+                {
+                    memory_fault(cpu);
+                }
                 break;
             }
             case OPCODE_STOREP:
@@ -2000,185 +1188,901 @@ APEX_memory(APEX_CPU *cpu)
                 cpu->regs_writing[cpu->memory.rs2] = 1;
               }
 
-                /* Read from data memory */
-                cpu->data_memory[cpu->memory.memory_address]= cpu->memory.rs1_value;
-                // cpu->mem_fb.reg= -1;
-                // cpu->mem_fb.value = 0;
-                cpu->mem_fb.reg= cpu->memory.rs2;
-                cpu->mem_fb.value = cpu->memory.rs2_value;
+                /* Read from data memory */
+                if (memory_write(&cpu->data_memory, cpu->memory.memory_address,
+                                 cpu->memory.rs1_value) != 0)
+                {
+                    memory_fault(cpu);
+                }
+
+                break;
+            }
+            case OPCODE_JALR:
+            {
+                if(cpu->regs_writing[cpu->memory.rd] == 0){
+                  cpu->regs_writing[cpu->memory.rd] = 1;
+                }
+            }
+            case OPCODE_JUMP:
+            {
+                break;
+            }
+        }
+
+        forward_results(cpu, FORWARD_MEMORY, &cpu->memory);
+
+        /* Copy data from memory latch to writeback latch*/
+        cpu->writeback = cpu->memory;
+        cpu->memory.has_insn = FALSE;
+
+        if (DEBUG_ON(cpu))
+        {
+            print_stage_content("Memory", &cpu->memory);
+        }
+    }
+
+}
+
+/*
+ * Writeback Stage of APEX Pipeline
+ *
+ * Note: You are free to edit this function according to your implementation
+ */
+static int
+APEX_writeback(APEX_CPU *cpu)
+{
+    if (cpu->writeback.has_insn)
+    {
+        if (cpu->kanata)
+        {
+            kanata_stage(cpu->kanata, cpu->clock, cpu->writeback.seq, KANATA_WRITEBACK);
+        }
+
+        /* Write result to register file based on instruction type */
+        switch (cpu->writeback.opcode)
+        {
+          case OPCODE_ADD:
+          case OPCODE_ADDL:
+          case OPCODE_SUB:
+          case OPCODE_SUBL:
+          case OPCODE_MUL:
+          case OPCODE_AND:
+          case OPCODE_OR:
+          case OPCODE_XOR:
+            {
+                cpu->regs[cpu->writeback.rd] = cpu->writeback.result_buffer;
+                cpu->regs_writing[cpu->writeback.rd] = 0;
+                break;
+            }
+
+            case OPCODE_LOAD:
+            {
+                cpu->regs[cpu->writeback.rd] = cpu->writeback.result_buffer;
+                cpu->regs_writing[cpu->writeback.rd] = 0;
+
+                break;
+            }
+            case OPCODE_LOADP:
+            {
+                cpu->regs[cpu->writeback.rd] = cpu->writeback.result_buffer;
+                cpu->regs[cpu->writeback.rs1]=cpu->writeback.rs1_value;
+                cpu->regs_writing[cpu->writeback.rd] = 0;
+                cpu->regs_writing[cpu->writeback.rs1] =0;
+                break;
+            }
+            case OPCODE_STOREP:
+            {
+                cpu->regs[cpu->writeback.rs2]=cpu->writeback.rs2_value;
+                cpu->regs_writing[cpu->writeback.rs2] = 0;
+                
+                break;
+            }
+
+            case OPCODE_MOVC:
+            {
+                cpu->regs[cpu->writeback.rd] = cpu->writeback.result_buffer;
+                cpu->regs_writing[cpu->writeback.rd] = 0;
+                break;
+            }
+            case OPCODE_JALR:
+            {
+                cpu->regs[cpu->writeback.rd]= cpu->writeback.result_buffer;
+                cpu->regs_writing[cpu->writeback.rd] = 0;
+                break;
+            }
+        }
+
+        cpu->insn_completed++;
+        cpu->writeback.has_insn = FALSE;
+        RECORD_EVENT(cpu, EVENT_RETIRE, cpu->writeback.pc, cpu->writeback.opcode,
+                     cpu->insn_completed);
+        if (cpu->kanata)
+        {
+            kanata_retire(cpu->kanata, cpu->clock, cpu->writeback.seq);
+        }
+
+         if (DEBUG_ON(cpu))
+        {
+            print_stage_content("Writeback", &cpu->writeback);
+        }
+        if (cpu->writeback.opcode == OPCODE_HALT)
+            {
+                /* Stop the APEX simulator */
+                return TRUE;
+            }
+
+    }
+
+    /* Default */
+    return 0;
+}
+
+/*
+ * Fills in the default machine configuration
+ */
+void
+APEX_config_init(APEX_Config *config)
+{
+    memset(config, 0, sizeof(APEX_Config));
+    config->btb_sets = BTB_DEFAULT_SETS;
+    config->btb_ways = BTB_DEFAULT_WAYS;
+    config->btb_policy = BTB_REPL_FIFO;
+    config->predictor = PREDICTOR_BIMODAL;
+    config->predictor_bits = PREDICTOR_DEFAULT_BITS;
+    config->history_bits = PREDICTOR_DEFAULT_HISTORY;
+    config->ras_depth = RAS_DEFAULT_DEPTH;
+    config->indirect_bits = INDIRECT_DEFAULT_BITS;
+    config->ftq_depth = FTQ_DEFAULT_DEPTH;
+    config->decode_redirect = TRUE;
+    config->core = CORE_INORDER;
+    config->ooo_width = OOO_DEFAULT_WIDTH;
+    config->rob_size = OOO_DEFAULT_ROB;
+    config->iq_size = OOO_DEFAULT_IQ;
+    config->phys_regs = OOO_DEFAULT_PHYS_REGS;
+    config->branch_checkpoints = OOO_DEFAULT_CHECKPOINTS;
+    config->counter_init = COUNTER_INIT_BY_OPCODE;
+    config->memory_size = DATA_MEMORY_SIZE;
+    config->forward_ports = FORWARD_DEFAULT_PORTS;
+}
+
+/*
+ * This function creates and initializes APEX cpu.
+ *
+ * Note: You are free to edit this function according to your implementation
+ */
+APEX_CPU *
+APEX_cpu_init(const char *filename, const APEX_Config *config)
+{
+    int i, data_size;
+    APEX_CPU *cpu;
+    APEX_Data_Init *data;
+
+    if (!filename || !config)
+    {
+        return NULL;
+    }
+
+    cpu = calloc(1, sizeof(APEX_CPU));
+
+    if (!cpu)
+    {
+        return NULL;
+    }
+
+    /* Initialize PC, Registers and all pipeline stages */
+    cpu->pc = CODE_MEMORY_BASE;
+    memset(cpu->regs, 0, sizeof(int) * REG_FILE_SIZE);
+    cpu->single_step = ENABLE_SINGLE_STEP;
+    cpu->debug_messages = ENABLE_DEBUG_MESSAGES;
+    cpu->batch = config->batch;
+    if (cpu->batch)
+    {
+        cpu->single_step = FALSE;
+        cpu->debug_messages = FALSE;
+    }
+
+    /* Parse input file and create code memory */
+    cpu->code_memory = create_code_memory(filename, &cpu->code_memory_size,
+                                          &data, &data_size);
+    if (!cpu->code_memory)
+    {
+        free(cpu);
+        return NULL;
+    }
+
+    /* From here on every failure releases what was set up through APEX_cpu_stop */
+    if (config->counter_init < COUNTER_INIT_BY_OPCODE || config->counter_init > 3)
+    {
+        fprintf(stderr, "APEX_Error: Invalid counter initial state %d\n",
+                config->counter_init);
+        free(data);
+        APEX_cpu_stop(cpu);
+        return NULL;
+    }
+    cpu->counter_init = config->counter_init;
+    cpu->decode_redirect = config->decode_redirect;
+    cpu->fast_forward = config->fast_forward;
+    cpu->sample_cycles = config->sample_cycles;
+
+    if (memory_init(&cpu->data_memory, config->memory_size) != 0)
+    {
+        fprintf(stderr, "APEX_Error: Invalid data memory size %d\n",
+                config->memory_size);
+        free(data);
+        APEX_cpu_stop(cpu);
+        return NULL;
+    }
+
+    /* Seed data memory from the program's .data directives */
+    for (i = 0; i < data_size; ++i)
+    {
+        if (memory_write(&cpu->data_memory, data[i].address, data[i].value) != 0)
+        {
+            fprintf(stderr, "APEX_Error: .data address %d outside data memory of %d words\n",
+                    data[i].address, cpu->data_memory.size);
+            free(data);
+            APEX_cpu_stop(cpu);
+            return NULL;
+        }
+    }
+    free(data);
+
+    if (btb_init(&cpu->btb, config->btb_sets, config->btb_ways,
+                 config->btb_policy) != 0)
+    {
+        fprintf(stderr, "APEX_Error: Invalid BTB geometry %dx%d (%s)\n",
+                config->btb_sets, config->btb_ways,
+                btb_policy_name(config->btb_policy));
+        APEX_cpu_stop(cpu);
+        return NULL;
+    }
+
+    if (forward_init(&cpu->forward, config->forward_ports) != 0)
+    {
+        fprintf(stderr, "APEX_Error: Invalid number of forwarding ports %d (0 to %d)\n",
+                config->forward_ports, FORWARD_MAX_PORTS);
+        APEX_cpu_stop(cpu);
+        return NULL;
+    }
+
+    if (predictor_init(&cpu->predictor, config->predictor, config->predictor_bits,
+                       config->history_bits) != 0)
+    {
+        fprintf(stderr, "APEX_Error: Invalid %s predictor with %d table bits, %d history bits\n",
+                predictor_name(config->predictor), config->predictor_bits,
+                config->history_bits);
+        APEX_cpu_stop(cpu);
+        return NULL;
+    }
+
+    if (indirect_init(&cpu->indirect, config->indirect_bits) != 0)
+    {
+        fprintf(stderr, "APEX_Error: Invalid indirect predictor size of %d bits (0 to %d)\n",
+                config->indirect_bits, INDIRECT_MAX_BITS);
+        APEX_cpu_stop(cpu);
+        return NULL;
+    }
+
+    if (ras_init(&cpu->ras, config->ras_depth) != 0
+        || ras_init(&cpu->ras_resolved, config->ras_depth) != 0)
+    {
+        fprintf(stderr, "APEX_Error: Invalid return address stack depth %d (0 to %d)\n",
+                config->ras_depth, RAS_MAX_DEPTH);
+        APEX_cpu_stop(cpu);
+        return NULL;
+    }
+
+    if (ftq_init(&cpu->ftq, config->ftq_depth) != 0)
+    {
+        fprintf(stderr, "APEX_Error: Invalid fetch target queue depth %d (0 to %d)\n",
+                config->ftq_depth, FTQ_MAX_DEPTH);
+        APEX_cpu_stop(cpu);
+        return NULL;
+    }
+
+    if (config->core == CORE_OOO)
+    {
+        cpu->ooo = malloc(sizeof(APEX_OOO));
+        if (!cpu->ooo
+            || ooo_init(cpu->ooo, config->ooo_width, config->rob_size, config->iq_size,
+                        config->phys_regs, config->branch_checkpoints) != 0)
+        {
+            fprintf(stderr, "APEX_Error: Invalid out-of-order core, width %d, ROB %d,"
+                    " IQ %d, %d physical registers, %d branch checkpoints\n",
+                    config->ooo_width, config->rob_size, config->iq_size,
+                    config->phys_regs, config->branch_checkpoints);
+            free(cpu->ooo);
+            cpu->ooo = NULL;
+            APEX_cpu_stop(cpu);
+            return NULL;
+        }
+        APEX_ooo_resume(cpu);
+    }
+
+    if (stats_init(&cpu->stats, cpu->code_memory_size) != 0)
+    {
+        APEX_cpu_stop(cpu);
+        return NULL;
+    }
+    cpu->stats_file = config->stats_file;
+
+    if (config->trace_file)
+    {
+        cpu->trace = malloc(sizeof(APEX_Trace));
+        if (!cpu->trace || trace_open_write(cpu->trace, config->trace_file) != 0)
+        {
+            fprintf(stderr, "APEX_Error: Unable to create branch trace %s\n",
+                    config->trace_file);
+            free(cpu->trace);
+            cpu->trace = NULL;
+            APEX_cpu_stop(cpu);
+            return NULL;
+        }
+    }
+
+    if (config->kanata_file)
+    {
+        cpu->kanata = malloc(sizeof(APEX_Kanata));
+        if (!cpu->kanata || kanata_open(cpu->kanata, config->kanata_file, cpu->clock) != 0)
+        {
+            fprintf(stderr, "APEX_Error: Unable to create Kanata log %s\n",
+                    config->kanata_file);
+            free(cpu->kanata);
+            cpu->kanata = NULL;
+            APEX_cpu_stop(cpu);
+            return NULL;
+        }
+    }
+
+    if (config->events > 0)
+    {
+        if (!ENABLE_PIPELINE_EVENTS)
+        {
+            fprintf(stderr, "APEX_Error: Pipeline events are compiled out, see ENABLE_PIPELINE_EVENTS\n");
+            APEX_cpu_stop(cpu);
+            return NULL;
+        }
+        cpu->events = malloc(sizeof(APEX_Events));
+        if (!cpu->events
+            || events_init(cpu->events, config->events, config->events_file) != 0)
+        {
+            fprintf(stderr, "APEX_Error: Unable to keep %d pipeline events\n",
+                    config->events);
+            free(cpu->events);
+            cpu->events = NULL;
+            APEX_cpu_stop(cpu);
+            return NULL;
+        }
+    }
+
+    if (DEBUG_ON(cpu))
+    {
+        fprintf(stderr,
+                "APEX_CPU: Initialized APEX CPU, loaded %d instructions\n",
+                cpu->code_memory_size);
+        fprintf(stderr, "APEX_CPU: PC initialized to %d\n", cpu->pc);
+        fprintf(stderr, "APEX_CPU: Printing Code Memory\n");
+        printf("%-9s %-9s %-9s %-9s %-9s\n", "opcode_str", "rd", "rs1", "rs2",
+               "imm");
+
+        for (i = 0; i < cpu->code_memory_size; ++i)
+        {
+            printf("%-9s %-9d %-9d %-9d %-9d\n", get_opcode_name(cpu->code_memory[i].opcode),
+                   cpu->code_memory[i].rd, cpu->code_memory[i].rs1,
+                   cpu->code_memory[i].rs2, cpu->code_memory[i].imm);
+        }
+    }
+
+    /* To start fetch stage */
+    cpu->fetch.has_insn = TRUE;
+
+    cpu->checkpoint_file = config->checkpoint_file;
+    cpu->checkpoint_cycle = config->checkpoint_cycle;
+    if (config->restore_file)
+    {
+        int ret = APEX_checkpoint_restore(cpu, config->restore_file);
+
+        if (ret == CHECKPOINT_ERR_OPEN)
+        {
+            fprintf(stderr, "APEX_Error: Unable to open checkpoint %s: %s\n",
+                    config->restore_file, strerror(errno));
+            APEX_cpu_stop(cpu);
+            return NULL;
+        }
+        if (ret != 0)
+        {
+            fprintf(stderr, "APEX_Error: Checkpoint %s does not match this program and configuration\n",
+                    config->restore_file);
+            APEX_cpu_stop(cpu);
+            return NULL;
+        }
+        if (DEBUG_ON(cpu))
+        {
+            fprintf(stderr, "APEX_CPU: Restored checkpoint at cycle %d, PC %d\n",
+                    cpu->clock, cpu->pc);
+        }
+    }
+    return cpu;
+}
+
+/*
+ * Writes the per-branch counters as CSV, one row per branch that was fetched
+ * or executed
+ *
+ * Returns 0 on success, -1 if the file cannot be written
+ */
+static int
+write_branch_stats_csv(const APEX_CPU *cpu, const char *path)
+{
+    FILE *fp = fopen(path, "w");
+    int i;
+
+    if (!fp)
+    {
+        return -1;
+    }
+
+    fprintf(fp, "pc,opcode,lookups,btb_hits,executed,taken,pred_taken,"
+                "pred_not_taken,correct,incorrect,flush_cycles\n");
+    for (i = 0; i < cpu->code_memory_size; ++i)
+    {
+        const branch_stats *branch = &cpu->stats.branches[i];
+
+        if (branch->lookups == 0 && branch->executed == 0)
+        {
+            continue;
+        }
+        fprintf(fp, "%d,%s,%lu,%lu,%lu,%lu,%lu,%lu,%lu,%lu,%lu\n",
+                CODE_MEMORY_BASE + 4 * i, get_opcode_name(cpu->code_memory[i].opcode),
+                branch->lookups, branch->btb_hits, branch->executed,
+                branch->taken, branch->pred_taken, branch->pred_not_taken,
+                branch->correct, branch->incorrect, branch->flush_cycles);
+    }
+    fclose(fp);
+    return 0;
+}
+
+/* Stalled instructions listed at the end of a run */
+#define STALL_REPORT_ROWS 10
+
+/*
+ * Prints decode stall cycles by cause, then the instructions that stalled
+ * most with the pc they last waited for
+ */
+static void
+report_stall_stats(const APEX_CPU *cpu)
+{
+    const APEX_Stats *stats = &cpu->stats;
+    int top[STALL_REPORT_ROWS];
+    int rows = 0;
+    unsigned long total = 0;
+    int i, j, cause;
+
+    for (cause = 0; cause < STALL_NUM_CAUSES; ++cause)
+    {
+        total += stats->stall_cycles[cause];
+    }
+    printf("APEX_CPU: Decode stall cycles = %lu", total);
+    for (cause = 0; cause < STALL_NUM_CAUSES; ++cause)
+    {
+        printf("%s%s %lu", cause ? ", " : " (", stats_stall_name(cause),
+               stats->stall_cycles[cause]);
+    }
+    printf(")\n");
+    if (total == 0)
+    {
+        return;
+    }
+
+    /* Insertion into a short list kept sorted by stall cycles */
+    for (i = 0; i < stats->num_insns; ++i)
+    {
+        unsigned long cycles = stats_stall_total(&stats->stalls[i]);
+
+        if (cycles == 0
+            || (rows == STALL_REPORT_ROWS
+                && cycles <= stats_stall_total(&stats->stalls[top[rows - 1]])))
+        {
+            continue;
+        }
+        j = rows < STALL_REPORT_ROWS ? rows++ : rows - 1;
+        while (j > 0 && stats_stall_total(&stats->stalls[top[j - 1]]) < cycles)
+        {
+            top[j] = top[j - 1];
+            j--;
+        }
+        top[j] = i;
+    }
+
+    printf("%-6s %-6s %8s", "pc", "opcode", "stalls");
+    for (cause = 0; cause < STALL_NUM_CAUSES; ++cause)
+    {
+        printf(" %8s", stats_stall_name(cause));
+    }
+    printf(" %8s\n", "waits_on");
+    for (i = 0; i < rows; ++i)
+    {
+        const stall_stats *stall = &stats->stalls[top[i]];
+
+        printf("%-6d %-6s %8lu", CODE_MEMORY_BASE + 4 * top[i],
+               get_opcode_name(cpu->code_memory[top[i]].opcode), stats_stall_total(stall));
+        for (cause = 0; cause < STALL_NUM_CAUSES; ++cause)
+        {
+            printf(" %8lu", stall->cycles[cause]);
+        }
+        printf(" %8d\n", stall->producer);
+    }
+}
+
+/*
+ * Prints the target diversity and prediction accuracy of every JUMP and JALR
+ * that resolved, if there were any
+ */
+static void
+report_indirect_stats(const APEX_CPU *cpu)
+{
+    int printed = FALSE;
+    int i;
+
+    for (i = 0; i < cpu->code_memory_size; ++i)
+    {
+        const indirect_stats *site = &cpu->stats.indirect[i];
+        const branch_stats *branch = &cpu->stats.branches[i];
 
-                break;
-            }
-            case OPCODE_JALR:
-            {
-                if(cpu->regs_writing[cpu->memory.rd] == 0){
-                  cpu->regs_writing[cpu->memory.rd] = 1;
-                }
-            }
-            case OPCODE_JUMP:
-            {
-                break;
-            }
+        if (site->num_targets == 0)
+        {
+            continue;
+        }
+        if (!printed)
+        {
+            printf("APEX_CPU: Indirect predictor = %d base entries (%zu bytes)\n",
+                   cpu->indirect.bits ? 1 << cpu->indirect.bits : 0,
+                   indirect_storage_bytes(&cpu->indirect));
+            printf("%-6s %-6s %8s %8s %8s %8s %8s\n", "pc", "opcode", "executed",
+                   "targets", "changes", "correct", "wrong");
+            printed = TRUE;
         }
+        printf("%-6d %-6s %8lu %7d%s %8lu %8lu %8lu\n",
+               CODE_MEMORY_BASE + 4 * i, get_opcode_name(cpu->code_memory[i].opcode),
+               branch->executed, site->num_targets, site->more_targets ? "+" : " ",
+               site->changes, branch->correct, branch->incorrect);
+    }
+}
 
-        /* Copy data from memory latch to writeback latch*/
-        cpu->writeback = cpu->memory;
-        cpu->memory.has_insn = FALSE;
+/*
+ * Prints IPC, MPKI and the per-branch counters at the end of a run, and
+ * exports them when a stats file was configured
+ */
+static void
+report_branch_stats(const APEX_CPU *cpu)
+{
+    int i, cause;
+
+    printf("APEX_CPU: IPC = %.3f, MPKI = %.3f, mispredictions = %lu, flush cycles = %lu\n",
+           cpu->clock ? (double)cpu->insn_completed / cpu->clock : 0.0,
+           stats_mpki(&cpu->stats, cpu->insn_completed),
+           cpu->stats.mispredictions, cpu->stats.flush_cycles);
+    printf("APEX_CPU: Redirects");
+    for (cause = 0; cause < FLUSH_NUM_CAUSES; ++cause)
+    {
+        printf("%s%s %lu (%lu cycles)", cause ? ", " : " ", stats_flush_name(cause),
+               cpu->stats.redirects[cause], cpu->stats.redirect_cycles[cause]);
+    }
+    printf("\n");
+    if (cpu->stats.ras.calls || cpu->stats.ras.returns)
+    {
+        const ras_stats *ras = &cpu->stats.ras;
+
+        printf("APEX_CPU: RAS depth %d, calls = %lu returns = %lu (correct %lu, wrong %lu),"
+               " overflows = %lu underflows = %lu\n",
+               cpu->ras.depth, ras->calls, ras->returns, ras->correct, ras->incorrect,
+               ras->overflows, ras->underflows);
+    }
+    if (cpu->ftq.depth > 0)
+    {
+        const ftq_stats *ftq = &cpu->stats.ftq;
 
-        if (ENABLE_DEBUG_MESSAGES)
+        printf("APEX_CPU: FTQ depth %d, predictions = %lu (run ahead %lu, flushed %lu),"
+               " average occupancy = %.2f, empty fetch cycles = %lu\n",
+               cpu->ftq.depth, ftq->predictions, ftq->run_ahead, ftq->flushed,
+               cpu->clock ? (double)ftq->occupancy / cpu->clock : 0.0, ftq->empty);
+    }
+    if (cpu->ooo)
+    {
+        const APEX_OOO *ooo = cpu->ooo;
+        const ooo_stats *core = &ooo->stats;
+
+        printf("APEX_CPU: Out-of-order core width %d, ROB %d, IQ %d, %d physical registers,"
+               " %d branch checkpoints\n", ooo->width, ooo->rob_size, ooo->iq_size,
+               ooo->phys_regs, ooo->num_checkpoints);
+        printf("APEX_CPU: Renamed = %lu issued = %lu squashed = %lu (%lu recoveries),"
+               " average ROB occupancy = %.2f IQ occupancy = %.2f\n",
+               core->renamed, core->issued, core->squashed, core->recoveries,
+               cpu->clock ? (double)core->rob_occupancy / cpu->clock : 0.0,
+               cpu->clock ? (double)core->iq_occupancy / cpu->clock : 0.0);
+        printf("APEX_CPU: Rename stall cycles");
+        for (cause = 0; cause < OOO_NUM_STALLS; ++cause)
         {
-            print_stage_content("Memory", &cpu->memory);
+            printf("%s%s %lu", cause ? ", " : " ", ooo_stall_name(cause),
+                   core->rename_stalls[cause]);
+        }
+        printf("\n");
+    }
+    printf("%-6s %-6s %8s %8s %8s %8s %8s %8s %8s %8s %8s\n", "pc", "opcode",
+           "lookups", "btb_hits", "executed", "taken", "pred_t", "pred_nt",
+           "correct", "wrong", "flush");
+    for (i = 0; i < cpu->code_memory_size; ++i)
+    {
+        const branch_stats *branch = &cpu->stats.branches[i];
+
+        if (branch->lookups == 0 && branch->executed == 0)
+        {
+            continue;
         }
+        printf("%-6d %-6s %8lu %8lu %8lu %8lu %8lu %8lu %8lu %8lu %8lu\n",
+               CODE_MEMORY_BASE + 4 * i, get_opcode_name(cpu->code_memory[i].opcode),
+               branch->lookups, branch->btb_hits, branch->executed,
+               branch->taken, branch->pred_taken, branch->pred_not_taken,
+               branch->correct, branch->incorrect, branch->flush_cycles);
     }
 
+    report_indirect_stats(cpu);
+    report_stall_stats(cpu);
+
+    if (cpu->stats_file && write_branch_stats_csv(cpu, cpu->stats_file) != 0)
+    {
+        fprintf(stderr, "APEX_Error: Unable to write branch statistics to %s\n",
+                cpu->stats_file);
+    }
 }
 
 /*
- * Writeback Stage of APEX Pipeline
+ * Prints the end of run summary used by batch mode
+ */
+static void
+print_stats_summary(const APEX_CPU *cpu, int halted)
+{
+    printf("APEX_CPU: Simulation %s, cycles = %d instructions = %d\n",
+           halted && !cpu->fault ? "Complete" : "Stopped", cpu->clock, cpu->insn_completed);
+    if (cpu->insn_fast_forwarded)
+    {
+        printf("APEX_CPU: Fast forwarded instructions = %lu\n", cpu->insn_fast_forwarded);
+    }
+    printf("APEX_CPU: BTB = %dx%d %s, predictor = %s (%zu bytes)\n",
+           cpu->btb.sets, cpu->btb.ways, btb_policy_name(cpu->btb.policy),
+           cpu->predictor.ops->name, predictor_storage_bytes(&cpu->predictor));
+    report_branch_stats(cpu);
+}
+
+/*
+ * Advances the pipeline by one clock cycle
  *
- * Note: You are free to edit this function according to your implementation
+ * Returns TRUE if HALT retired or the run faulted
  */
 static int
-APEX_writeback(APEX_CPU *cpu)
+APEX_cpu_cycle(APEX_CPU *cpu)
 {
-    if (cpu->writeback.has_insn)
+    if (cpu->ooo)
     {
-        /* Write result to register file based on instruction type */
-        switch (cpu->writeback.opcode)
+        if (APEX_ooo_cycle(cpu))
         {
-          case OPCODE_ADD:
-          case OPCODE_ADDL:
-          case OPCODE_SUB:
-          case OPCODE_SUBL:
-          case OPCODE_MUL:
-          case OPCODE_AND:
-          case OPCODE_OR:
-          case OPCODE_XOR:
-            {
-                cpu->regs[cpu->writeback.rd] = cpu->writeback.result_buffer;
-                cpu->regs_writing[cpu->writeback.rd] = 0;
-                break;
-            }
+            return TRUE;
+        }
+    }
+    else
+    {
+        forward_clear(&cpu->forward);
+        if (APEX_writeback(cpu))
+        {
+            return TRUE;
+        }
 
-            case OPCODE_LOAD:
-            {
-                cpu->regs[cpu->writeback.rd] = cpu->writeback.result_buffer;
-                cpu->regs_writing[cpu->writeback.rd] = 0;
+        APEX_memory(cpu);
+        APEX_execute(cpu);
+        APEX_decode(cpu);
+        cpu->stats.ftq.occupancy += cpu->ftq.count;
+        APEX_fetch_slot(cpu);
+    }
 
-                break;
-            }
-            case OPCODE_LOADP:
-            {
-                cpu->regs[cpu->writeback.rd] = cpu->writeback.result_buffer;
-                cpu->regs[cpu->writeback.rs1]=cpu->writeback.rs1_value;
-                cpu->regs_writing[cpu->writeback.rd] = 0;
-                cpu->regs_writing[cpu->writeback.rs1] =0;
-                break;
-            }
-            case OPCODE_STOREP:
-            {
-                cpu->regs[cpu->writeback.rs2]=cpu->writeback.rs2_value;
-                cpu->regs_writing[cpu->writeback.rs2] = 0;
-                
-                break;
-            }
+    if (cpu->fault)
+    {
+        return TRUE;
+    }
 
-            case OPCODE_MOVC:
-            {
-                cpu->regs[cpu->writeback.rd] = cpu->writeback.result_buffer;
-                cpu->regs_writing[cpu->writeback.rd] = 0;
-                break;
-            }
-            case OPCODE_JALR:
-            {
-                cpu->regs[cpu->writeback.rd]= cpu->writeback.result_buffer;
-                cpu->regs_writing[cpu->writeback.rd] = 0;
-                break;
-            }
+    if (cpu->checkpoint_file && cpu->clock == cpu->checkpoint_cycle)
+    {
+        if (APEX_checkpoint_save(cpu, cpu->checkpoint_file) != 0)
+        {
+            fprintf(stderr, "APEX_Error: Unable to write checkpoint %s\n",
+                    cpu->checkpoint_file);
+        }
+        else
+        {
+            fprintf(stderr, "APEX_CPU: Checkpoint written to %s at cycle %d\n",
+                    cpu->checkpoint_file, cpu->clock);
         }
+    }
+    return FALSE;
+}
 
-        cpu->insn_completed++;
-        cpu->writeback.has_insn = FALSE;
+/*
+ * Stops fetching and clocks the pipeline until every instruction already
+ * fetched has retired or been squashed. cpu->pc is then the architectural
+ * next PC, so the functional interpreter can carry on from it.
+ *
+ * Returns TRUE if HALT retired while draining
+ */
+int
+APEX_cpu_drain(APEX_CPU *cpu)
+{
+    const ftq_entry *oldest = ftq_head(&cpu->ftq);
+    int halted = FALSE;
 
-         if (ENABLE_DEBUG_MESSAGES)
+    /* Predictions not fetched yet are dropped, the oldest one is next */
+    if (oldest)
+    {
+        cpu->pc = oldest->pc;
+    }
+    ftq_flush(&cpu->ftq);
+
+    cpu->draining = TRUE;
+    while (cpu->ooo ? ooo_busy(cpu->ooo)
+           : cpu->decode.has_insn || cpu->execute.has_insn
+             || cpu->memory.has_insn || cpu->writeback.has_insn)
+    {
+        cpu->clock++;
+        if (APEX_cpu_cycle(cpu))
         {
-            print_stage_content("Writeback", &cpu->writeback);
+            halted = TRUE;
+            break;
         }
-        if (cpu->writeback.opcode == OPCODE_HALT)
-            {
-                /* Stop the APEX simulator */
-                return TRUE;
-            }
+    }
+    cpu->draining = FALSE;
+    return halted;
+}
 
+/*
+ * Restarts the detailed pipeline at cpu->pc after a functional region. The
+ * latches, scoreboard, forwarding network, fetch target queue and the
+ * out-of-order core hold nothing from before; the architectural state, the
+ * predictor tables and the resolved return address stack carry over as they
+ * are, and fetch predicts returns from the latter.
+ */
+void
+APEX_cpu_resume_detailed(APEX_CPU *cpu)
+{
+    memset(&cpu->fetch, 0, sizeof(CPU_Stage));
+    memset(&cpu->decode, 0, sizeof(CPU_Stage));
+    memset(&cpu->execute, 0, sizeof(CPU_Stage));
+    memset(&cpu->memory, 0, sizeof(CPU_Stage));
+    memset(&cpu->writeback, 0, sizeof(CPU_Stage));
+    memset(cpu->regs_writing, 0, sizeof(cpu->regs_writing));
+
+    forward_clear(&cpu->forward);
+    ftq_flush(&cpu->ftq);
+    ras_copy(&cpu->ras, &cpu->ras_resolved);
+
+    if (cpu->ooo)
+    {
+        APEX_ooo_resume(cpu);
     }
 
-    /* Default */
-    return 0;
+    cpu->fetch_from_next_cycle = FALSE;
+    cpu->fetch.has_insn = TRUE;
 }
 
 /*
- * This function creates and initializes APEX cpu.
+ * Runs the configured number of instructions through the functional
+ * interpreter, warming the BTB and predictor, then hands the machine to the
+ * detailed pipeline. Instructions in flight, as after restoring a
+ * checkpoint, are drained first.
  *
- * Note: You are free to edit this function according to your implementation
+ * Returns TRUE if the program ended before the detailed region
  */
-APEX_CPU *
-APEX_cpu_init(const char *filename)
+static int
+run_fast_forward(APEX_CPU *cpu)
 {
-    int i;
-    APEX_CPU *cpu;
+    int ret;
 
-    if (!filename)
+    if (cpu->fast_forward == 0)
     {
-        return NULL;
+        return FALSE;
+    }
+    if (APEX_cpu_drain(cpu))
+    {
+        return TRUE;
     }
 
-    cpu = calloc(1, sizeof(APEX_CPU));
-
-    if (!cpu)
+    ret = APEX_functional_run(cpu, cpu->fast_forward, TRUE);
+    if (ret == FUNCTIONAL_FAULT)
     {
-        return NULL;
+        fprintf(stderr, "APEX_Error: Fast forward faulted at pc %d\n", cpu->pc);
+        cpu->fault = TRUE;
+        return TRUE;
+    }
+    if (ret == FUNCTIONAL_HALTED)
+    {
+        return TRUE;
     }
 
-    /* Initialize PC, Registers and all pipeline stages */
-    cpu->pc = 4000;
-    memset(cpu->regs, 0, sizeof(int) * REG_FILE_SIZE);
-    memset(cpu->data_memory, 0, sizeof(int) * DATA_MEMORY_SIZE);
-    cpu->single_step = ENABLE_SINGLE_STEP;
+    APEX_cpu_resume_detailed(cpu);
+    return FALSE;
+}
 
-    /* Parse input file and create code memory */
-    cpu->code_memory = create_code_memory(filename, &cpu->code_memory_size);
-    if (!cpu->code_memory)
+/*
+ * Runs the pipeline without printing anything until HALT retires or for
+ * max_cycles more detailed cycles (0 for no limit). Touches nothing outside
+ * cpu, so independent CPUs can be simulated from separate threads.
+ *
+ * With fast forwarding configured, the run starts with a functional region.
+ * With sampling also configured, every sample_cycles detailed cycles the
+ * pipeline is drained and another functional region follows, so only the
+ * samples are timed.
+ *
+ * Returns TRUE if the program halted
+ */
+int
+APEX_cpu_simulate(APEX_CPU *cpu, int max_cycles)
+{
+    int last_cycle = cpu->clock + max_cycles;
+    int window = 0;
+
+    if (run_fast_forward(cpu))
     {
-        free(cpu);
-        return NULL;
+        return TRUE;
     }
 
-    cpu->data_counter = 0;
-    if (ENABLE_DEBUG_MESSAGES)
+    while (max_cycles == 0 || cpu->clock < last_cycle)
     {
-        fprintf(stderr,
-                "APEX_CPU: Initialized APEX CPU, loaded %d instructions\n",
-                cpu->code_memory_size);
-        fprintf(stderr, "APEX_CPU: PC initialized to %d\n", cpu->pc);
-        fprintf(stderr, "APEX_CPU: Printing Code Memory\n");
-        printf("%-9s %-9s %-9s %-9s %-9s\n", "opcode_str", "rd", "rs1", "rs2",
-               "imm");
+        cpu->clock++;
+        if (APEX_cpu_cycle(cpu))
+        {
+            return TRUE;
+        }
 
-        for (i = 0; i < cpu->code_memory_size; ++i)
+        if (cpu->sample_cycles > 0 && cpu->fast_forward > 0
+            && ++window == cpu->sample_cycles)
         {
-            printf("%-9s %-9d %-9d %-9d %-9d\n", cpu->code_memory[i].opcode_str,
-                   cpu->code_memory[i].rd, cpu->code_memory[i].rs1,
-                   cpu->code_memory[i].rs2, cpu->code_memory[i].imm);
+            window = 0;
+            if (APEX_cpu_drain(cpu) || run_fast_forward(cpu))
+            {
+                return TRUE;
+            }
         }
     }
+    return FALSE;
+}
 
-    /* To start fetch stage */
-    cpu->fetch.has_insn = TRUE;
-    memset(&cpu->btb_queue, 0, sizeof(cpu->btb_queue)); // Initialize to all zeros
-    cpu->btb_queue.head = 0;
-    cpu->btb_queue.tail = 0;
-    cpu->btb_queue.size = 0;
-    return cpu;
+/* Writes the pipeline events kept so far to their file, when they are kept */
+static void
+dump_events(const APEX_CPU *cpu)
+{
+    if (!cpu->events)
+    {
+        return;
+    }
+    if (events_dump(cpu->events) != 0)
+    {
+        fprintf(stderr, "APEX_Error: Unable to write pipeline events to %s\n",
+                cpu->events->path);
+        return;
+    }
+    fprintf(stderr, "APEX_CPU: Pipeline events written to %s at cycle %d\n",
+            cpu->events->path, cpu->clock);
+}
+
+/*
+ * Batch mode simulation loop. Nothing is printed per cycle and the clock is
+ * never single stepped; the run ends when HALT retires or after max_cycles
+ * cycles (0 for no limit) and only the summary is written out.
+ */
+static void
+APEX_cpu_run_batch(APEX_CPU *cpu, int max_cycles)
+{
+    int halted = APEX_cpu_simulate(cpu, max_cycles);
+
+    print_stats_summary(cpu, halted);
+    dump_events(cpu);
 }
 
 /*
@@ -2187,71 +2091,108 @@ APEX_cpu_init(const char *filename)
  * Note: You are free to edit this function according to your implementation
  */
 void simulate_cpu_for_cycles(APEX_CPU *cpu, int num_cycles) {
-    for (int cycle = 1; cycle <= num_cycles; cycle++) {
-        if (ENABLE_DEBUG_MESSAGES) {
+    if (cpu->batch) {
+        APEX_cpu_run_batch(cpu, num_cycles);
+        return;
+    }
+
+    if (run_fast_forward(cpu)) {
+        print_stats_summary(cpu, TRUE);
+        dump_events(cpu);
+        return;
+    }
+
+    int last_cycle = cpu->clock + num_cycles;
+
+    while (cpu->clock < last_cycle) {
+        cpu->clock++;
+        if (DEBUG_ON(cpu)) {
             printf("--------------------------------------------\n");
-            printf("Clock Cycle #: %d\n", cycle);
+            printf("Clock Cycle #: %d\n", cpu->clock);
             printf("--------------------------------------------\n");
         }
 
-        if (APEX_writeback(cpu)) {
-            /* Halt in writeback stage */
-            printf("APEX_CPU: Simulation Complete, cycles = %d instructions = %d\n", cycle, cpu->insn_completed);
+        if (APEX_cpu_cycle(cpu)) {
+            /* Halt in writeback stage, or a fault */
+            if (cpu->ooo) {
+                /* HALT retired with the rest of its commit group, show what they wrote */
+                print_reg_file(cpu);
+            }
+            printf("APEX_CPU: Simulation %s, cycles = %d instructions = %d\n",
+                   cpu->fault ? "Stopped" : "Complete", cpu->clock, cpu->insn_completed);
+            report_branch_stats(cpu);
             break;
         }
 
-        APEX_memory(cpu);
-        APEX_execute(cpu);
-        APEX_decode(cpu);
-        APEX_fetch(cpu);
-
         print_reg_file(cpu);
 
     }
+    dump_events(cpu);
 }
 
 void
 APEX_cpu_run(APEX_CPU *cpu)
 {
     char user_prompt_val;
-    cpu->clock=1;
+
+    if (cpu->batch)
+    {
+        APEX_cpu_run_batch(cpu, 0);
+        return;
+    }
+
+    if (run_fast_forward(cpu))
+    {
+        print_stats_summary(cpu, TRUE);
+        dump_events(cpu);
+        return;
+    }
+
     while (TRUE)
     {
-        if (ENABLE_DEBUG_MESSAGES)
+        cpu->clock++;
+        if (DEBUG_ON(cpu))
         {
             printf("--------------------------------------------\n");
             printf("Clock Cycle #: %d\n", cpu->clock);
             printf("--------------------------------------------\n");
         }
 
-        if (APEX_writeback(cpu))
+        if (APEX_cpu_cycle(cpu))
         {
-            /* Halt in writeback stage */
-            printf("APEX_CPU: Simulation Complete, cycles = %d instructions = %d\n", cpu->clock, cpu->insn_completed);
+            /* Halt in writeback stage, or a fault */
+            if (cpu->ooo)
+            {
+                /* HALT retired with the rest of its commit group, show what they wrote */
+                print_reg_file(cpu);
+            }
+            printf("APEX_CPU: Simulation %s, cycles = %d instructions = %d\n",
+                   cpu->fault ? "Stopped" : "Complete", cpu->clock, cpu->insn_completed);
+            report_branch_stats(cpu);
             break;
         }
-        
-        APEX_memory(cpu);
-        APEX_execute(cpu);
-        APEX_decode(cpu);
-        APEX_fetch(cpu);
 
         print_reg_file(cpu);
         
         if (cpu->single_step)
         {
-            printf("Press any key to advance CPU Clock or <q> to quit:\n");
+            printf("Press any key to advance CPU Clock, <d> to dump pipeline events or <q> to quit:\n");
             scanf("%c", &user_prompt_val);
 
+            if (user_prompt_val == 'D' || user_prompt_val == 'd')
+            {
+                dump_events(cpu);
+            }
+
             if ((user_prompt_val == 'Q') || (user_prompt_val == 'q'))
             {
                 printf("APEX_CPU: Simulation Stopped, cycles = %d instructions = %d\n", cpu->clock, cpu->insn_completed);
+                report_branch_stats(cpu);
                 break;
             }
         }
-
-        cpu->clock++;
     }
+    dump_events(cpu);
 }
 
 /*
@@ -2262,6 +2203,40 @@ APEX_cpu_run(APEX_CPU *cpu)
 void
 APEX_cpu_stop(APEX_CPU *cpu)
 {
+    if (cpu->kanata)
+    {
+        if (kanata_close(cpu->kanata, cpu->clock) != 0)
+        {
+            fprintf(stderr, "APEX_Error: Kanata log is incomplete\n");
+        }
+        free(cpu->kanata);
+    }
+    if (cpu->events)
+    {
+        events_free(cpu->events);
+        free(cpu->events);
+    }
+    if (cpu->trace)
+    {
+        if (trace_close(cpu->trace) != 0)
+        {
+            fprintf(stderr, "APEX_Error: Branch trace is incomplete\n");
+        }
+        free(cpu->trace);
+    }
+    if (cpu->ooo)
+    {
+        ooo_free(cpu->ooo);
+        free(cpu->ooo);
+    }
+    stats_free(&cpu->stats);
+    predictor_free(&cpu->predictor);
+    indirect_free(&cpu->indirect);
+    ras_free(&cpu->ras);
+    ras_free(&cpu->ras_resolved);
+    ftq_free(&cpu->ftq);
+    btb_free(&cpu->btb);
+    memory_free(&cpu->data_memory);
     free(cpu->code_memory);
     free(cpu);
 }
@@ -8,22 +8,58 @@
  */
 #ifndef _APEX_CPU_H_
 #define _APEX_CPU_H_
-#define TAKEN 1
-#define NOT_TAKEN 0
 
 #include "apex_macros.h"
+#include "apex_opcodes.h"
+#include "apex_btb.h"
+#include "apex_predictor.h"
+#include "apex_stats.h"
+#include "apex_trace.h"
+#include "apex_memory.h"
+#include "apex_events.h"
+#include "apex_kanata.h"
+#include "apex_forward.h"
+#include "apex_ras.h"
+#include "apex_indirect.h"
+#include "apex_ftq.h"
 
-/* Format of an APEX instruction  */
+/* Per-cycle printing, removed entirely when ENABLE_DEBUG_MESSAGES is 0 and
+ * skipped at run time in batch mode */
+#define DEBUG_ON(cpu) (ENABLE_DEBUG_MESSAGES && (cpu)->debug_messages)
+
+/* Pipeline event recording, removed entirely when ENABLE_PIPELINE_EVENTS is 0
+ * and a single pointer test at run time when no ring was requested */
+#define RECORD_EVENT(cpu, type, pc, opcode, arg)                              \
+    do                                                                        \
+    {                                                                         \
+        if (ENABLE_PIPELINE_EVENTS && (cpu)->events)                          \
+        {                                                                     \
+            events_record((cpu)->events, (cpu)->clock, type, pc, opcode, arg); \
+        }                                                                     \
+    } while (0)
+
+/* Back ends the front end can drive */
+#define CORE_INORDER 0             /* five stage pipeline */
+#define CORE_OOO 1                 /* out-of-order core, see apex_ooo.h */
+
+/* Format of a pre-decoded APEX instruction, mnemonics live in apex_opcodes.c */
 typedef struct APEX_Instruction
 {
-    char opcode_str[128];
-    int opcode;
-    int rd;
-    int rs1;
-    int rs2;
+    unsigned char opcode;
+    unsigned char flags;         /* INSN_* operand classes */
+    unsigned char rd;
+    unsigned char rs1;
+    unsigned char rs2;
     int imm;
 } APEX_Instruction;
 
+/* Data memory word set by a .data directive before the program starts */
+typedef struct APEX_Data_Init
+{
+    int address;
+    int value;
+} APEX_Data_Init;
+
 // condition code struct
 typedef struct condition_code
 {
@@ -32,74 +68,106 @@ typedef struct condition_code
     int n;
 } condition_code;
 
-typedef struct forward_bus
-{
-    int reg;
-	int value;
-}forward_bus;
-
-typedef struct BTB  // stack max 4 enteries
-{
-    int inst_address;
-    int executed; // if it was taken and executed for the first time
-    int target_address;
-    int prediction_state; // Variable to store the prediction state
-    int history_state; //prediction history 
-    int num_executed; //number of times branch was executed irrespective of taken,  not taken
-} BTB;
-
-// Define the circular queue structure
-struct CircularQueue {
-    BTB data[4];
-    int head, tail;
-    unsigned int size;
-};
-
 /* Model of CPU stage latch */
 typedef struct CPU_Stage
 {
     int pc;
-    char opcode_str[128];
-    int opcode;
-    int rs1;
-    int rs2;
-    int rs1_f;   //flag if rs1 is found
-    int rs2_f;   // flag rs2 is found
-    int rd;
     int imm;
     int rs1_value;
     int rs2_value;
     int result_buffer;
     int memory_address;
-    int has_insn;
-    int stalled;
-    int btb_searched;
-    int type_of_branch;
+    int pred_target;             /* JUMP or JALR target fetch followed */
+    uint64_t pred_meta;          /* predictor state needed to train this branch or jump */
+    unsigned long seq;           /* fetch order, names the instruction in the Kanata log */
+    unsigned char opcode;
+    unsigned char flags;         /* INSN_* operand classes */
+    unsigned char rd;
+    unsigned char rs1;
+    unsigned char rs2;
+    unsigned char rs1_f;         //flag if rs1 is found
+    unsigned char rs2_f;         // flag rs2 is found
+    unsigned char has_insn;
+    unsigned char stalled;
+    unsigned char btb_searched;
+    unsigned char pred_taken;    /* direction predicted at fetch */
 } CPU_Stage;
 
+/* Run-time configuration of the simulated machine */
+typedef struct APEX_Config
+{
+    int btb_sets;                  /* Number of BTB sets, power of two */
+    int btb_ways;                  /* Entries per BTB set */
+    int btb_policy;                /* BTB_REPL_* replacement policy */
+    int predictor;                 /* PREDICTOR_* direction predictor */
+    int predictor_bits;            /* log2 entries of the predictor table */
+    int history_bits;              /* branch history length */
+    int ras_depth;                 /* Return address stack entries, 0 for none */
+    int indirect_bits;             /* log2 entries of the indirect target predictor, 0 for none */
+    int ftq_depth;                 /* Fetch target queue entries, 0 predicts in lock step with fetch */
+    int decode_redirect;           /* Decode sends fetch to predicted taken branches the BTB missed */
+    int core;                      /* CORE_* back end */
+    int ooo_width;                 /* Out-of-order core: instructions fetched, renamed, issued and committed per cycle */
+    int rob_size;                  /* Out-of-order core: reorder buffer entries */
+    int iq_size;                   /* Out-of-order core: issue queue entries */
+    int phys_regs;                 /* Out-of-order core: physical registers */
+    int branch_checkpoints;        /* Out-of-order core: rename maps saved for unresolved branches */
+    int batch;                     /* No per-cycle output, summary only */
+    int memory_size;               /* Data memory size in words */
+    int forward_ports;             /* Values forwarded per producer stage each cycle */
+    const char *stats_file;        /* CSV of per-branch counters, or NULL */
+    const char *trace_file;        /* Binary trace of resolved branches, or NULL */
+    int events;                    /* Pipeline events kept, 0 records none */
+    const char *events_file;       /* Where the kept events are dumped */
+    const char *kanata_file;       /* Kanata pipeline timeline, or NULL */
+    int counter_init;              /* Counter state of new branches, or COUNTER_INIT_BY_OPCODE */
+    unsigned long fast_forward;    /* Instructions run functionally before timing */
+    int sample_cycles;             /* Detailed cycles between fast forwards, 0 for one region */
+    const char *checkpoint_file;   /* Checkpoint written at checkpoint_cycle, or NULL */
+    int checkpoint_cycle;
+    const char *restore_file;      /* Checkpoint to resume from, or NULL */
+} APEX_Config;
+
 /* Model of APEX CPU */
 typedef struct APEX_CPU
 {
-    int pc;                        /* Current program counter */
+    int pc;                        /* Next program counter to predict */
     int clock;                     /* Clock cycles elapsed */
     int insn_completed;            /* Instructions retired */
+    unsigned long insn_fast_forwarded; /* Instructions run by the functional interpreter */
     int regs[REG_FILE_SIZE];       /* Integer register file */
     int regs_writing[REG_FILE_SIZE];//for knowing which register is writing currently
     int code_memory_size;          /* Number of instruction in the input file */
     APEX_Instruction *code_memory; /* Code Memory */
-    int data_memory[DATA_MEMORY_SIZE]; /* Data Memory */
+    APEX_Memory data_memory;       /* Data Memory */
     int single_step;               /* Wait for user input after every cycle */
+    int debug_messages;            /* Print stage contents every cycle */
+    int batch;                     /* Batch mode, see APEX_Config */
     int simulate;
     int zero_flag;                 /* {TRUE, FALSE} Used by BZ and BNZ to branch */
     int fetch_from_next_cycle;
     condition_code cc;            /*condition code flag for cmp,cml {1 (+), 0 (-)}*/
-    forward_bus fb;
-    struct forward_bus ex_fb;  //excution stage forward bus
-    struct forward_bus mem_fb; //memory stage forward bus
-    int mem_address[DATA_MEMORY_SIZE];
-    int data_counter;
-    BTB btb; 
-    struct CircularQueue btb_queue; // Circular Queue for BTB entries
+    APEX_Forward forward;          /* Results execute and memory produced this cycle */
+    APEX_BTB btb;                  /* Branch target buffer */
+    APEX_Predictor predictor;      /* Branch direction predictor */
+    APEX_Indirect indirect;        /* JUMP and JALR target predictor */
+    APEX_RAS ras;                  /* Return address stack fetch predicts from */
+    APEX_RAS ras_resolved;         /* Calls and returns that reached execute, restores ras on a redirect */
+    APEX_FTQ ftq;                  /* Predictions waiting for fetch */
+    int counter_init;              /* See APEX_Config */
+    int decode_redirect;           /* See APEX_Config */
+    unsigned long fast_forward;    /* See APEX_Config */
+    int sample_cycles;             /* See APEX_Config */
+    int draining;                  /* Fetch stopped while the pipeline empties */
+    int fault;                     /* Run ended by an invalid memory access or PC */
+    const char *checkpoint_file;   /* See APEX_Config */
+    int checkpoint_cycle;          /* See APEX_Config */
+    APEX_Stats stats;              /* Per-branch prediction statistics */
+    const char *stats_file;        /* See APEX_Config */
+    APEX_Trace *trace;             /* Branch trace being written, or NULL */
+    APEX_Events *events;           /* Recent pipeline events, or NULL */
+    APEX_Kanata *kanata;           /* Pipeline timeline being written, or NULL */
+    struct APEX_OOO *ooo;          /* Out-of-order back end, or NULL for the five stage pipeline */
 
     /* Pipeline stages */
     CPU_Stage fetch;
@@ -109,10 +177,22 @@ typedef struct APEX_CPU
     CPU_Stage writeback;
 } APEX_CPU;
 
-APEX_Instruction *create_code_memory(const char *filename, int *size);
-APEX_CPU *APEX_cpu_init(const char *filename);
+APEX_Instruction *create_code_memory(const char *filename, int *size,
+                                     APEX_Data_Init **data, int *data_size);
+void APEX_config_init(APEX_Config *config);
+APEX_CPU *APEX_cpu_init(const char *filename, const APEX_Config *config);
 void APEX_cpu_run(APEX_CPU *cpu);
 void APEX_cpu_stop(APEX_CPU *cpu);
 void simulate_cpu_for_cycles(APEX_CPU *cpu, int num_cycles);
-void initCircularQueue(struct CircularQueue *queue);
+int APEX_cpu_simulate(APEX_CPU *cpu, int max_cycles);
+int APEX_cpu_drain(APEX_CPU *cpu);
+void APEX_cpu_resume_detailed(APEX_CPU *cpu);
+
+/* Front end pieces the out-of-order back end shares */
+void APEX_fetch_slot(APEX_CPU *cpu);
+int APEX_decode_branch_target(APEX_CPU *cpu, CPU_Stage *stage);
+void record_branch_outcome(APEX_CPU *cpu, const CPU_Stage *stage, int predicted, int outcome,
+                           int target);
+int resolve_return_stack(APEX_CPU *cpu, const CPU_Stage *stage, int target);
+void print_stage_content(const char *name, const CPU_Stage *stage);
 #endif
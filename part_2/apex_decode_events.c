@@ -0,0 +1,125 @@
+/*
+ * apex_decode_events.c
+ * Prints a pipeline event file written by apex_sim --events as text
+ *
+ * Author:
+ * Copyright (c) 2020, Gaurav Kothari (gkothar1@binghamton.edu)
+ * State University of New York at Binghamton
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "apex_macros.h"
+#include "apex_opcodes.h"
+#include "apex_events.h"
+
+static void
+print_usage(const char *prog)
+{
+    fprintf(stderr, "APEX_Help: Usage %s <event_file> [--type <name>] [--pc <pc>]\n", prog);
+    fprintf(stderr, "  Options:\n");
+    fprintf(stderr, "    --type <name>       Only print events of this type (fetch, btb_hit, stall, fwd_ex, fwd_mem, flush, retire)\n");
+    fprintf(stderr, "    --pc <pc>           Only print events of the instruction at pc\n");
+}
+
+static int
+event_type_from_string(const char *name)
+{
+    int type;
+
+    for (type = 0; type < EVENT_NUM_TYPES; ++type)
+    {
+        if (strcmp(name, event_name(type)) == 0)
+        {
+            return type;
+        }
+    }
+    return -1;
+}
+
+int
+main(int argc, char const *argv[])
+{
+    events_header header;
+    pipeline_event event;
+    FILE *fp;
+    int type = -1;
+    int pc = -1;
+    uint32_t i;
+    int j;
+
+    if (argc < 2)
+    {
+        print_usage(argv[0]);
+        exit(1);
+    }
+    for (j = 2; j < argc; ++j)
+    {
+        if (strcmp(argv[j], "--type") == 0 && j + 1 < argc)
+        {
+            type = event_type_from_string(argv[++j]);
+            if (type < 0)
+            {
+                fprintf(stderr, "APEX_Error: Unknown event type %s\n", argv[j]);
+                exit(1);
+            }
+        }
+        else if (strcmp(argv[j], "--pc") == 0 && j + 1 < argc)
+        {
+            pc = atoi(argv[++j]);
+        }
+        else
+        {
+            print_usage(argv[0]);
+            exit(1);
+        }
+    }
+
+    fp = fopen(argv[1], "rb");
+    if (!fp)
+    {
+        fprintf(stderr, "APEX_Error: Unable to open %s\n", argv[1]);
+        exit(1);
+    }
+    if (fread(&header, sizeof(header), 1, fp) != 1
+        || memcmp(header.magic, EVENTS_MAGIC, 4) != 0
+        || header.version != EVENTS_VERSION
+        || header.record_size != sizeof(pipeline_event))
+    {
+        fprintf(stderr, "APEX_Error: %s is not an APEX event file\n", argv[1]);
+        fclose(fp);
+        exit(1);
+    }
+
+    printf("%u of %llu events\n", header.count, (unsigned long long)header.total);
+    printf("%-10s %-8s %-6s %-7s %s\n", "cycle", "event", "pc", "opcode", "arg");
+    for (i = 0; i < header.count; ++i)
+    {
+        if (fread(&event, sizeof(event), 1, fp) != 1)
+        {
+            fprintf(stderr, "APEX_Error: %s is truncated\n", argv[1]);
+            fclose(fp);
+            exit(1);
+        }
+        if ((type >= 0 && event.type != type) || (pc >= 0 && event.pc != pc))
+        {
+            continue;
+        }
+        printf("%-10u %-8s %-6d %-7s ", event.cycle, event_name(event.type), event.pc,
+               get_opcode_name(event.opcode));
+        switch (event.type)
+        {
+            case EVENT_STALL:
+            case EVENT_FORWARD_EX:
+            case EVENT_FORWARD_MEM:
+                printf("R%d\n", event.arg);
+                break;
+            default:
+                printf("%d\n", event.arg);
+                break;
+        }
+    }
+    fclose(fp);
+    return 0;
+}
@@ -0,0 +1,120 @@
+/*
+ * apex_events.c
+ * Contains APEX pipeline event ring buffer implementation
+ *
+ * Author:
+ * Copyright (c) 2020, Gaurav Kothari (gkothar1@binghamton.edu)
+ * State University of New York at Binghamton
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "apex_events.h"
+
+static const char *const event_names[EVENT_NUM_TYPES] = {
+    [EVENT_FETCH] = "fetch",
+    [EVENT_BTB_HIT] = "btb_hit",
+    [EVENT_STALL] = "stall",
+    [EVENT_FORWARD_EX] = "fwd_ex",
+    [EVENT_FORWARD_MEM] = "fwd_mem",
+    [EVENT_FLUSH] = "flush",
+    [EVENT_RETIRE] = "retire",
+};
+
+/*
+ * Creates a ring holding the last capacity events, to be written to path by
+ * events_dump. The ring itself is rounded up to a power of two so recording
+ * can index it with a mask.
+ *
+ * Returns 0 on success, -1 on a bad capacity or allocation failure
+ */
+int
+events_init(APEX_Events *events, int capacity, const char *path)
+{
+    uint32_t size = 1;
+
+    memset(events, 0, sizeof(APEX_Events));
+    if (capacity <= 0 || capacity > (1 << 30) || !path)
+    {
+        return -1;
+    }
+    while (size < (uint32_t)capacity)
+    {
+        size <<= 1;
+    }
+
+    events->ring = calloc(size, sizeof(pipeline_event));
+    if (!events->ring)
+    {
+        return -1;
+    }
+    events->mask = size - 1;
+    events->capacity = (uint32_t)capacity;
+    events->path = path;
+    return 0;
+}
+
+void
+events_free(APEX_Events *events)
+{
+    free(events->ring);
+    events->ring = NULL;
+}
+
+/*
+ * Writes the last capacity events recorded, oldest first, to the ring's path.
+ * The ring is left untouched so it can be dumped again later.
+ *
+ * Returns 0 on success, -1 if the file cannot be written
+ */
+int
+events_dump(const APEX_Events *events)
+{
+    events_header header;
+    uint64_t capacity = (uint64_t)events->mask + 1;
+    uint64_t count = events->head < events->capacity ? events->head : events->capacity;
+    uint64_t first = events->head - count;
+    uint64_t start = first & events->mask;
+    uint64_t wrapped = (start + count > capacity) ? start + count - capacity : 0;
+    FILE *fp;
+    int ret = 0;
+
+    fp = fopen(events->path, "wb");
+    if (!fp)
+    {
+        return -1;
+    }
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, EVENTS_MAGIC, 4);
+    header.version = EVENTS_VERSION;
+    header.record_size = sizeof(pipeline_event);
+    header.count = (uint32_t)count;
+    header.total = events->head;
+
+    /* The oldest event sits at start, the ring may wrap back to index 0 */
+    if (fwrite(&header, sizeof(header), 1, fp) != 1
+        || fwrite(&events->ring[start], sizeof(pipeline_event), count - wrapped, fp)
+           != count - wrapped
+        || fwrite(events->ring, sizeof(pipeline_event), wrapped, fp) != wrapped)
+    {
+        ret = -1;
+    }
+    if (fclose(fp) != 0)
+    {
+        ret = -1;
+    }
+    return ret;
+}
+
+/* Returns the short name printed for an event type */
+const char *
+event_name(int type)
+{
+    if (type < 0 || type >= EVENT_NUM_TYPES)
+    {
+        return "???";
+    }
+    return event_names[type];
+}
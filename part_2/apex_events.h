@@ -0,0 +1,82 @@
+/*
+ * apex_events.h
+ * Contains APEX pipeline event ring buffer declarations
+ *
+ * Author:
+ * Copyright (c) 2020, Gaurav Kothari (gkothar1@binghamton.edu)
+ * State University of New York at Binghamton
+ */
+#ifndef _APEX_EVENTS_H_
+#define _APEX_EVENTS_H_
+
+#include <stdint.h>
+#include <stdio.h>
+
+/*
+ * An event file is an events_header followed by the last count events the
+ * ring held, oldest first. Fields are in host byte order.
+ */
+#define EVENTS_MAGIC "APXE"
+#define EVENTS_VERSION 1
+
+/* Pipeline event types */
+#define EVENT_FETCH 0          /* arg: next fetch pc */
+#define EVENT_BTB_HIT 1        /* arg: BTB target */
+#define EVENT_STALL 2          /* arg: register decode waits for */
+#define EVENT_FORWARD_EX 3     /* arg: register read from the execute bus */
+#define EVENT_FORWARD_MEM 4    /* arg: register read from the memory bus */
+#define EVENT_FLUSH 5          /* arg: redirected pc */
+#define EVENT_RETIRE 6         /* arg: instructions retired so far */
+#define EVENT_NUM_TYPES 7
+
+typedef struct events_header
+{
+    char magic[4];
+    uint32_t version;
+    uint32_t record_size;
+    uint32_t count;
+    uint64_t total;                /* events recorded over the whole run */
+} events_header;
+
+typedef struct pipeline_event
+{
+    uint32_t cycle;
+    int32_t pc;
+    int32_t arg;
+    uint8_t type;
+    uint8_t opcode;
+    uint16_t reserved;
+} pipeline_event;
+
+/*
+ * Fixed size ring of the most recent events. The pipeline is its only
+ * writer and readers only look at it between cycles, so recording is a
+ * plain store and an increment with no locking.
+ */
+typedef struct APEX_Events
+{
+    pipeline_event *ring;
+    uint32_t mask;                 /* ring size - 1, the capacity rounded up to a power of two */
+    uint32_t capacity;             /* events kept for a dump */
+    uint64_t head;                 /* events recorded so far */
+    const char *path;              /* dump destination */
+} APEX_Events;
+
+int events_init(APEX_Events *events, int capacity, const char *path);
+void events_free(APEX_Events *events);
+int events_dump(const APEX_Events *events);
+const char *event_name(int type);
+
+static inline void
+events_record(APEX_Events *events, int cycle, int type, int pc, int opcode, int arg)
+{
+    pipeline_event *event = &events->ring[events->head++ & events->mask];
+
+    event->cycle = (uint32_t)cycle;
+    event->pc = pc;
+    event->arg = arg;
+    event->type = (uint8_t)type;
+    event->opcode = (uint8_t)opcode;
+    event->reserved = 0;
+}
+#endif
@@ -0,0 +1,97 @@
+/*
+ * apex_forward.c
+ * Contains APEX forwarding network implementation
+ *
+ * Author:
+ * Copyright (c) 2020, Gaurav Kothari (gkothar1@binghamton.edu)
+ * State University of New York at Binghamton
+ */
+#include <string.h>
+
+#include "apex_forward.h"
+
+/*
+ * Creates a network with ports destinations per producer stage
+ *
+ * Returns 0 on success, -1 if ports is out of range
+ */
+int
+forward_init(APEX_Forward *fwd, int ports)
+{
+    memset(fwd, 0, sizeof(APEX_Forward));
+
+    if (ports < 0 || ports > FORWARD_MAX_PORTS)
+    {
+        return -1;
+    }
+    fwd->ports = ports;
+    return 0;
+}
+
+/* Releases every port, called once at the start of each cycle */
+void
+forward_clear(APEX_Forward *fwd)
+{
+    memset(fwd->driven, 0, sizeof(fwd->driven));
+}
+
+/*
+ * Drives reg on the next port of stage. A destination driven later shadows
+ * an earlier one for the same register, as writeback would. ready is FALSE
+ * for a load in execute, whose value does not exist yet. Once every port of
+ * stage carries a value the register is still claimed, so an older value of
+ * it is never forwarded, but consumers wait for writeback.
+ *
+ * Returns 0 if the value is on the network, -1 if only the claim is
+ */
+int
+forward_drive(APEX_Forward *fwd, int stage, int reg, int value, int ready)
+{
+    forward_port *port;
+    int has_port;
+
+    if (fwd->driven[stage] >= FORWARD_MAX_PORTS)
+    {
+        return -1;
+    }
+    has_port = fwd->driven[stage] < fwd->ports;
+    port = &fwd->port[stage][fwd->driven[stage]++];
+    port->reg = reg;
+    port->value = value;
+    port->ready = ready && has_port;
+    return has_port ? 0 : -1;
+}
+
+/*
+ * Finds the youngest value of reg on the network, searching execute before
+ * memory and the last port driven in a stage first
+ *
+ * Returns the supplying FORWARD_* stage with the value in *value,
+ * FORWARD_PENDING if the youngest producer has not computed it yet, or
+ * FORWARD_MISS if no port carries reg
+ */
+int
+forward_lookup(const APEX_Forward *fwd, int reg, int *value)
+{
+    int stage, i;
+
+    for (stage = 0; stage < FORWARD_NUM_STAGES; ++stage)
+    {
+        for (i = fwd->driven[stage] - 1; i >= 0; --i)
+        {
+            const forward_port *port = &fwd->port[stage][i];
+
+            if (port->reg != reg)
+            {
+                continue;
+            }
+            if (!port->ready)
+            {
+                return FORWARD_PENDING;
+            }
+            *value = port->value;
+            return stage;
+        }
+    }
+    return FORWARD_MISS;
+}
@@ -0,0 +1,49 @@
+/*
+ * apex_forward.h
+ * Contains APEX forwarding network declarations
+ *
+ * Author:
+ * Copyright (c) 2020, Gaurav Kothari (gkothar1@binghamton.edu)
+ * State University of New York at Binghamton
+ */
+#ifndef _APEX_FORWARD_H_
+#define _APEX_FORWARD_H_
+
+/* Producer stages, youngest instruction first */
+#define FORWARD_EXECUTE 0
+#define FORWARD_MEMORY 1
+#define FORWARD_NUM_STAGES 2
+
+/* Values each producer stage can forward in one cycle */
+#define FORWARD_MAX_PORTS 4
+#define FORWARD_DEFAULT_PORTS 2
+
+/* forward_lookup results besides the supplying stage */
+#define FORWARD_MISS (-1)
+#define FORWARD_PENDING (-2)
+
+/* One destination register a producer stage drives this cycle */
+typedef struct forward_port
+{
+    int reg;
+    int value;
+    int ready;       /* FALSE while the value is still being computed */
+} forward_port;
+
+/*
+ * Values produced this cycle, indexed by stage. Every stage clears its ports
+ * when the cycle starts and drives one per destination register, so decode
+ * only ever sees results of instructions still in flight.
+ */
+typedef struct APEX_Forward
+{
+    int ports;                                 /* ports per stage, 0 disables forwarding */
+    int driven[FORWARD_NUM_STAGES];
+    forward_port port[FORWARD_NUM_STAGES][FORWARD_MAX_PORTS];
+} APEX_Forward;
+
+int forward_init(APEX_Forward *fwd, int ports);
+void forward_clear(APEX_Forward *fwd);
+int forward_drive(APEX_Forward *fwd, int stage, int reg, int value, int ready);
+int forward_lookup(const APEX_Forward *fwd, int reg, int *value);
+#endif
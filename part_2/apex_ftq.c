@@ -0,0 +1,147 @@
+/*
+ * apex_ftq.c
+ * Contains APEX fetch target queue implementation
+ *
+ * Author:
+ * Copyright (c) 2020, Gaurav Kothari (gkothar1@binghamton.edu)
+ * State University of New York at Binghamton
+ */
+#include <stdlib.h>
+#include <string.h>
+
+#include "apex_ftq.h"
+#include "apex_macros.h"
+
+/* Entries the queue can hold, a lock-stepped queue still holds one */
+static int
+ftq_capacity(const APEX_FTQ *ftq)
+{
+    return ftq->depth > 0 ? ftq->depth : 1;
+}
+
+/*
+ * Creates an empty queue of depth entries, depth 0 keeps prediction in lock
+ * step with fetch
+ *
+ * Returns 0 on success, -1 on a bad depth or allocation failure
+ */
+int
+ftq_init(APEX_FTQ *ftq, int depth)
+{
+    memset(ftq, 0, sizeof(APEX_FTQ));
+
+    if (depth < 0 || depth > FTQ_MAX_DEPTH)
+    {
+        return -1;
+    }
+    ftq->depth = depth;
+    ftq->entries = calloc(ftq_capacity(ftq), sizeof(ftq_entry));
+    if (!ftq->entries)
+    {
+        return -1;
+    }
+    return 0;
+}
+
+void
+ftq_free(APEX_FTQ *ftq)
+{
+    free(ftq->entries);
+    ftq->entries = NULL;
+}
+
+/*
+ * Drops every prediction and lets prediction restart, as after a redirect
+ *
+ * Returns the number of entries dropped
+ */
+int
+ftq_flush(APEX_FTQ *ftq)
+{
+    int dropped = ftq->count;
+
+    ftq->head = 0;
+    ftq->count = 0;
+    ftq->stopped = FALSE;
+    return dropped;
+}
+
+int
+ftq_full(const APEX_FTQ *ftq)
+{
+    return ftq->count == ftq_capacity(ftq);
+}
+
+/* Appends an entry for the caller to fill in, the queue must not be full */
+ftq_entry *
+ftq_push(APEX_FTQ *ftq)
+{
+    ftq_entry *entry = &ftq->entries[(ftq->head + ftq->count) % ftq_capacity(ftq)];
+
+    memset(entry, 0, sizeof(ftq_entry));
+    ftq->count++;
+    return entry;
+}
+
+/* Returns the oldest prediction, or NULL if the queue is empty */
+const ftq_entry *
+ftq_head(const APEX_FTQ *ftq)
+{
+    if (ftq->count == 0)
+    {
+        return NULL;
+    }
+    return &ftq->entries[ftq->head];
+}
+
+/* Drops the oldest prediction, if there is one */
+void
+ftq_pop(APEX_FTQ *ftq)
+{
+    if (ftq->count > 0)
+    {
+        ftq->head = (ftq->head + 1) % ftq_capacity(ftq);
+        ftq->count--;
+    }
+}
+
+/*
+ * Writes the depth, position and entries to fp
+ *
+ * Returns 0 on success, -1 on a write error
+ */
+int
+ftq_save(const APEX_FTQ *ftq, FILE *fp)
+{
+    int state[4] = {ftq->depth, ftq->head, ftq->count, ftq->stopped};
+    int capacity = ftq_capacity(ftq);
+
+    if (fwrite(state, sizeof(state), 1, fp) != 1
+        || fwrite(ftq->entries, sizeof(ftq_entry), capacity, fp) != (size_t)capacity)
+    {
+        return -1;
+    }
+    return 0;
+}
+
+/*
+ * Reads back a queue written by ftq_save into one of the same depth
+ *
+ * Returns 0 on success, -1 on a read error or a depth mismatch
+ */
+int
+ftq_load(APEX_FTQ *ftq, FILE *fp)
+{
+    int state[4];
+    int capacity = ftq_capacity(ftq);
+
+    if (fread(state, sizeof(state), 1, fp) != 1 || state[0] != ftq->depth
+        || fread(ftq->entries, sizeof(ftq_entry), capacity, fp) != (size_t)capacity)
+    {
+        return -1;
+    }
+    ftq->head = state[1];
+    ftq->count = state[2];
+    ftq->stopped = state[3];
+    return 0;
+}
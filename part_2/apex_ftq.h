@@ -0,0 +1,50 @@
+/*
+ * apex_ftq.h
+ * Contains APEX fetch target queue declarations
+ *
+ * Author:
+ * Copyright (c) 2020, Gaurav Kothari (gkothar1@binghamton.edu)
+ * State University of New York at Binghamton
+ */
+#ifndef _APEX_FTQ_H_
+#define _APEX_FTQ_H_
+
+#include <stdint.h>
+#include <stdio.h>
+
+/* Prediction made for one instruction ahead of fetch */
+typedef struct ftq_entry
+{
+    int pc;
+    int next_pc;                 /* where prediction carried on, pc + 4 or the target followed */
+    int pred_target;             /* JUMP or JALR target predicted */
+    int cycle;                   /* cycle the prediction was made in */
+    uint64_t pred_meta;          /* predictor state needed to train the branch or jump */
+    unsigned char pred_taken;    /* direction predicted */
+    unsigned char followed;      /* prediction carried on at a target */
+} ftq_entry;
+
+/*
+ * Circular queue between the branch prediction unit and fetch. With depth 0
+ * it holds the single prediction made in the cycle fetch consumes it, so the
+ * two run in lock step. stopped is set once a HALT has been predicted.
+ */
+typedef struct APEX_FTQ
+{
+    int depth;
+    int head;                    /* oldest entry, the next one fetched */
+    int count;
+    int stopped;
+    ftq_entry *entries;
+} APEX_FTQ;
+
+int ftq_init(APEX_FTQ *ftq, int depth);
+void ftq_free(APEX_FTQ *ftq);
+int ftq_flush(APEX_FTQ *ftq);
+int ftq_full(const APEX_FTQ *ftq);
+ftq_entry *ftq_push(APEX_FTQ *ftq);
+const ftq_entry *ftq_head(const APEX_FTQ *ftq);
+void ftq_pop(APEX_FTQ *ftq);
+int ftq_save(const APEX_FTQ *ftq, FILE *fp);
+int ftq_load(APEX_FTQ *ftq, FILE *fp);
+#endif
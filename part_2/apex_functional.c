@@ -0,0 +1,247 @@
+/*
+ * apex_functional.c
+ * Executes APEX instructions one at a time against the architectural state
+ * of an APEX_CPU, without modelling latches, stalls or forwarding. Used to
+ * fast forward to the region the detailed pipeline should time.
+ *
+ * Author:
+ * Copyright (c) 2020, Gaurav Kothari (gkothar1@binghamton.edu)
+ * State University of New York at Binghamton
+ */
+#include "apex_functional.h"
+
+static void
+set_condition_codes(APEX_CPU *cpu, int result)
+{
+    cpu->cc.z = (result == 0);
+    cpu->cc.p = (result > 0);
+    cpu->cc.n = (result < 0);
+    cpu->zero_flag = cpu->cc.z;
+}
+
+/*
+ * Trains the BTB and the direction predictor with a conditional branch the
+ * way decode (allocation) and execute (resolution) would have
+ */
+static void
+warm_branch_predictor(APEX_CPU *cpu, const APEX_Instruction *ins, int pc,
+                      int outcome, int target)
+{
+    uint64_t meta = 0;
+    BTB *entry = btb_lookup(&cpu->btb, pc);
+
+    predictor_predict(&cpu->predictor, pc, &meta);
+    if (entry == NULL)
+    {
+        entry = btb_allocate(&cpu->btb, pc);
+        predictor_install(&cpu->predictor, pc,
+                          predictor_seed_state(cpu->counter_init,
+                                               get_opcode_hint(ins->opcode)));
+    }
+    entry->num_executed++;
+    entry->target_address = target;
+    predictor_update(&cpu->predictor, pc, outcome, meta);
+}
+
+/*
+ * Applies a JUMP or JALR to the resolved return address stack, and trains
+ * the indirect predictor with it unless it is a return, as execute would
+ */
+static void
+warm_jump_predictors(APEX_CPU *cpu, const APEX_Instruction *ins, int target)
+{
+    uint64_t meta = 0;
+    int predicted;
+
+    if (ins->opcode == OPCODE_JALR)
+    {
+        ras_push(&cpu->ras_resolved, cpu->pc + 4, ins->rd);
+    }
+    else if (ras_is_return(&cpu->ras_resolved, ins->rs1))
+    {
+        ras_pop(&cpu->ras_resolved);
+        return;
+    }
+    indirect_predict(&cpu->indirect, cpu->pc, &predicted, &meta);
+    indirect_update(&cpu->indirect, cpu->pc, target, meta);
+}
+
+/* Moves the PC past a branch, optionally training the predictor with it */
+static void
+resolve_branch(APEX_CPU *cpu, const APEX_Instruction *ins, int outcome,
+               int target, int warm)
+{
+    int pc = cpu->pc;
+
+    if (warm && (ins->flags & INSN_PREDICTED))
+    {
+        warm_branch_predictor(cpu, ins, pc, outcome, target);
+    }
+    if (warm)
+    {
+        indirect_history(&cpu->indirect, outcome, target);
+    }
+    if (cpu->trace)
+    {
+        trace_write(cpu->trace, pc, target, ins->opcode, outcome,
+                    ins->rd, ins->rs1, ins->imm);
+    }
+    cpu->pc = (outcome == TAKEN) ? target : pc + 4;
+}
+
+static int
+branch_outcome(int condition)
+{
+    return condition ? TAKEN : NOT_TAKEN;
+}
+
+/*
+ * Executes up to max_insns instructions (0 for no limit) starting at cpu->pc.
+ * The pipeline latches must be empty. Registers, condition codes and data
+ * memory are updated exactly as the pipeline would update them; with warm
+ * set, BZ, BNZ, BP and BNP also train the BTB and the direction predictor,
+ * and JALR and JUMP the resolved return address stack and the indirect
+ * predictor, so the detailed region does not start cold.
+ *
+ * Returns FUNCTIONAL_DONE, FUNCTIONAL_HALTED or FUNCTIONAL_FAULT
+ */
+int
+APEX_functional_run(APEX_CPU *cpu, unsigned long max_insns, int warm)
+{
+    unsigned long executed;
+    int index;
+
+    for (executed = 0; max_insns == 0 || executed < max_insns; ++executed)
+    {
+        const APEX_Instruction *ins;
+        int *regs = cpu->regs;
+        int address;
+
+        index = (cpu->pc - CODE_MEMORY_BASE) / 4;
+        if (cpu->pc < CODE_MEMORY_BASE || index >= cpu->code_memory_size)
+        {
+            cpu->insn_fast_forwarded += executed;
+            return FUNCTIONAL_FAULT;
+        }
+        ins = &cpu->code_memory[index];
+
+        switch (ins->opcode)
+        {
+            case OPCODE_ADD:
+                regs[ins->rd] = regs[ins->rs1] + regs[ins->rs2];
+                set_condition_codes(cpu, regs[ins->rd]);
+                break;
+            case OPCODE_ADDL:
+                regs[ins->rd] = regs[ins->rs1] + ins->imm;
+                set_condition_codes(cpu, regs[ins->rd]);
+                break;
+            case OPCODE_SUB:
+                regs[ins->rd] = regs[ins->rs1] - regs[ins->rs2];
+                set_condition_codes(cpu, regs[ins->rd]);
+                break;
+            case OPCODE_SUBL:
+                regs[ins->rd] = regs[ins->rs1] - ins->imm;
+                set_condition_codes(cpu, regs[ins->rd]);
+                break;
+            case OPCODE_MUL:
+                regs[ins->rd] = regs[ins->rs1] * regs[ins->rs2];
+                set_condition_codes(cpu, regs[ins->rd]);
+                break;
+            case OPCODE_AND:
+                regs[ins->rd] = regs[ins->rs1] & regs[ins->rs2];
+                set_condition_codes(cpu, regs[ins->rd]);
+                break;
+            case OPCODE_OR:
+                regs[ins->rd] = regs[ins->rs1] | regs[ins->rs2];
+                set_condition_codes(cpu, regs[ins->rd]);
+                break;
+            case OPCODE_XOR:
+                regs[ins->rd] = regs[ins->rs1] ^ regs[ins->rs2];
+                set_condition_codes(cpu, regs[ins->rd]);
+                break;
+            case OPCODE_CMP:
+                set_condition_codes(cpu, regs[ins->rs1] - regs[ins->rs2]);
+                break;
+            case OPCODE_CML:
+                set_condition_codes(cpu, regs[ins->rs1] - ins->imm);
+                break;
+            case OPCODE_MOVC:
+                regs[ins->rd] = ins->imm;
+                break;
+            case OPCODE_LOAD:
+            case OPCODE_LOADP:
+            {
+                /* Writeback updates rd first, so rs1 wins when they match */
+                int base = regs[ins->rs1];
+
+                if (memory_read(&cpu->data_memory, base + ins->imm, &regs[ins->rd]) != 0)
+                {
+                    cpu->insn_fast_forwarded += executed;
+                    return FUNCTIONAL_FAULT;
+                }
+                if (ins->opcode == OPCODE_LOADP)
+                {
+                    regs[ins->rs1] = base + 4;
+                }
+                break;
+            }
+            case OPCODE_STORE:
+            case OPCODE_STOREP:
+                address = regs[ins->rs2] + ins->imm;
+                if (memory_write(&cpu->data_memory, address, regs[ins->rs1]) != 0)
+                {
+                    cpu->insn_fast_forwarded += executed;
+                    return FUNCTIONAL_FAULT;
+                }
+                if (ins->opcode == OPCODE_STOREP)
+                {
+                    regs[ins->rs2] += 4;
+                }
+                break;
+            case OPCODE_BZ:
+                resolve_branch(cpu, ins, branch_outcome(cpu->zero_flag), cpu->pc + ins->imm, warm);
+                continue;
+            case OPCODE_BNZ:
+                resolve_branch(cpu, ins, branch_outcome(!cpu->zero_flag), cpu->pc + ins->imm, warm);
+                continue;
+            case OPCODE_BP:
+                resolve_branch(cpu, ins, branch_outcome(cpu->cc.p), cpu->pc + ins->imm, warm);
+                continue;
+            case OPCODE_BNP:
+                resolve_branch(cpu, ins, branch_outcome(!cpu->cc.p), cpu->pc + ins->imm, warm);
+                continue;
+            case OPCODE_BN:
+                resolve_branch(cpu, ins, branch_outcome(cpu->cc.n), cpu->pc + ins->imm, warm);
+                continue;
+            case OPCODE_BNN:
+                resolve_branch(cpu, ins, branch_outcome(!cpu->cc.n), cpu->pc + ins->imm, warm);
+                continue;
+            case OPCODE_JUMP:
+            case OPCODE_JALR:
+            {
+                int target = regs[ins->rs1] + ins->imm;
+
+                if (warm)
+                {
+                    warm_jump_predictors(cpu, ins, target);
+                }
+                if (ins->opcode == OPCODE_JALR)
+                {
+                    regs[ins->rd] = cpu->pc + 4;
+                }
+                resolve_branch(cpu, ins, TAKEN, target, warm);
+                continue;
+            }
+            case OPCODE_HALT:
+                cpu->insn_fast_forwarded += executed + 1;
+                return FUNCTIONAL_HALTED;
+            default:
+                /* NOP, and DIV which the pipeline does not implement */
+                break;
+        }
+        cpu->pc += 4;
+    }
+
+    cpu->insn_fast_forwarded += executed;
+    return FUNCTIONAL_DONE;
+}
@@ -0,0 +1,20 @@
+/*
+ * apex_functional.h
+ * Contains the APEX functional (instruction level) interpreter declarations
+ *
+ * Author:
+ * Copyright (c) 2020, Gaurav Kothari (gkothar1@binghamton.edu)
+ * State University of New York at Binghamton
+ */
+#ifndef _APEX_FUNCTIONAL_H_
+#define _APEX_FUNCTIONAL_H_
+
+#include "apex_cpu.h"
+
+/* Results of APEX_functional_run */
+#define FUNCTIONAL_DONE 0          /* instruction budget used up */
+#define FUNCTIONAL_HALTED 1        /* HALT executed */
+#define FUNCTIONAL_FAULT (-1)      /* PC left code memory or bad data address */
+
+int APEX_functional_run(APEX_CPU *cpu, unsigned long max_insns, int warm);
+#endif
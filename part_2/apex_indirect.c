@@ -0,0 +1,390 @@
+/*
+ * apex_indirect.c
+ * Contains APEX indirect branch target predictor implementation
+ *
+ * Author:
+ * Copyright (c) 2020, Gaurav Kothari (gkothar1@binghamton.edu)
+ * State University of New York at Binghamton
+ */
+#include <stdlib.h>
+#include <string.h>
+
+#include "apex_indirect.h"
+#include "apex_macros.h"
+
+/* Usefulness counters are halved every this many updates */
+#define ITTAGE_DECAY_PERIOD (1u << 16)
+
+/* Path history bits of the shortest tagged table, each next one doubles it */
+#define ITTAGE_MIN_HISTORY 6
+
+static unsigned int
+mask_of(int bits)
+{
+    return bits >= 32 ? 0xffffffffu : ((1u << bits) - 1);
+}
+
+static unsigned int
+word_address(int pc)
+{
+    return (unsigned int)pc >> 2;
+}
+
+/* Folds the youngest len bits of history down to bits bits */
+static unsigned int
+fold_history(uint64_t history, int len, int bits)
+{
+    uint64_t h = len >= 64 ? history : history & (((uint64_t)1 << len) - 1);
+    unsigned int folded = 0;
+
+    while (h)
+    {
+        folded ^= (unsigned int)(h & mask_of(bits));
+        h >>= bits;
+    }
+    return folded;
+}
+
+static unsigned int
+base_index(const APEX_Indirect *ind, int pc)
+{
+    return word_address(pc) & mask_of(ind->bits);
+}
+
+static unsigned int
+tagged_index(const APEX_Indirect *ind, int table, int pc, uint64_t history)
+{
+    unsigned int addr = word_address(pc);
+
+    return (addr ^ (addr >> ind->tagged_bits)
+            ^ fold_history(history, ind->history_len[table], ind->tagged_bits)
+            ^ (unsigned int)table)
+           & mask_of(ind->tagged_bits);
+}
+
+/* Tags are stored off by one so that a cleared entry never matches */
+static unsigned short
+tagged_tag(const APEX_Indirect *ind, int table, int pc, uint64_t history)
+{
+    int len = ind->history_len[table];
+
+    return (unsigned short)(((word_address(pc)
+                              ^ fold_history(history, len, ITTAGE_TAG_BITS)
+                              ^ (fold_history(history, len, ITTAGE_TAG_BITS - 1) << 1))
+                             & mask_of(ITTAGE_TAG_BITS)) + 1);
+}
+
+/* Entry of table for pc, the base table being table -1 */
+static indirect_entry *
+component(const APEX_Indirect *ind, int table, int pc, uint64_t history)
+{
+    if (table < 0)
+    {
+        return &ind->base[base_index(ind, pc)];
+    }
+    return &ind->tagged[table][tagged_index(ind, table, pc, history)];
+}
+
+/* Finds the longest (provider) and next longest (alternate) matching tables */
+static void
+lookup(const APEX_Indirect *ind, int pc, uint64_t history, int *provider,
+       int *alternate)
+{
+    int table;
+
+    *provider = -1;
+    *alternate = -1;
+    for (table = ITTAGE_NUM_TABLES - 1; table >= 0; --table)
+    {
+        if (component(ind, table, pc, history)->tag == tagged_tag(ind, table, pc, history))
+        {
+            if (*provider < 0)
+            {
+                *provider = table;
+            }
+            else
+            {
+                *alternate = table;
+                break;
+            }
+        }
+    }
+}
+
+/*
+ * The provider's target, unless it was only just allocated and has no
+ * confidence yet, in which case the alternate's
+ */
+static int
+predicted_target(const APEX_Indirect *ind, int pc, uint64_t history,
+                 int provider, int alternate)
+{
+    const indirect_entry *entry = component(ind, provider, pc, history);
+
+    if (provider >= 0 && entry->conf == 0)
+    {
+        const indirect_entry *alt = component(ind, alternate, pc, history);
+
+        if (alt->target != 0)
+        {
+            return alt->target;
+        }
+    }
+    return entry->target;
+}
+
+/*
+ * Creates empty tables, a base table of 2^bits entries and tagged tables of a
+ * quarter of that. bits 0 gives a predictor that never predicts.
+ *
+ * Returns 0 on success, -1 on a bad size or allocation failure
+ */
+int
+indirect_init(APEX_Indirect *ind, int bits)
+{
+    int table;
+
+    memset(ind, 0, sizeof(APEX_Indirect));
+
+    if (bits < 0 || bits > INDIRECT_MAX_BITS)
+    {
+        return -1;
+    }
+    ind->bits = bits;
+    if (bits == 0)
+    {
+        return 0;
+    }
+
+    ind->tagged_bits = bits > 6 ? bits - 2 : 4;
+    ind->base = calloc((size_t)1 << bits, sizeof(indirect_entry));
+    if (!ind->base)
+    {
+        return -1;
+    }
+    for (table = 0; table < ITTAGE_NUM_TABLES; ++table)
+    {
+        ind->history_len[table] = ITTAGE_MIN_HISTORY << table;
+        ind->tagged[table] = calloc((size_t)1 << ind->tagged_bits, sizeof(indirect_entry));
+        if (!ind->tagged[table])
+        {
+            indirect_free(ind);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+void
+indirect_free(APEX_Indirect *ind)
+{
+    int table;
+
+    free(ind->base);
+    ind->base = NULL;
+    for (table = 0; table < ITTAGE_NUM_TABLES; ++table)
+    {
+        free(ind->tagged[table]);
+        ind->tagged[table] = NULL;
+    }
+}
+
+/*
+ * Predicts the target of the JUMP or JALR at pc. meta receives the history
+ * the prediction was made with, to be handed back to indirect_update.
+ *
+ * Returns TRUE with the target in *target, or FALSE if pc has none yet
+ */
+int
+indirect_predict(const APEX_Indirect *ind, int pc, int *target, uint64_t *meta)
+{
+    int provider, alternate;
+    int predicted;
+
+    *meta = ind->history;
+    if (ind->bits == 0)
+    {
+        return FALSE;
+    }
+
+    lookup(ind, pc, ind->history, &provider, &alternate);
+    predicted = predicted_target(ind, pc, ind->history, provider, alternate);
+    if (predicted == 0)
+    {
+        return FALSE;
+    }
+    *target = predicted;
+    return TRUE;
+}
+
+/* Trains the tables that predicted the jump at pc with its actual target */
+void
+indirect_update(APEX_Indirect *ind, int pc, int target, uint64_t meta)
+{
+    int provider, alternate;
+    int predicted;
+    indirect_entry *entry;
+    int table;
+
+    if (ind->bits == 0)
+    {
+        return;
+    }
+
+    lookup(ind, pc, meta, &provider, &alternate);
+    predicted = predicted_target(ind, pc, meta, provider, alternate);
+    entry = component(ind, provider, pc, meta);
+
+    if (provider >= 0
+        && entry->target != component(ind, alternate, pc, meta)->target)
+    {
+        if (entry->target == target && entry->useful < 3)
+        {
+            entry->useful++;
+        }
+        else if (entry->target != target && entry->useful > 0)
+        {
+            entry->useful--;
+        }
+    }
+
+    /* Gain confidence in a right target, replace a wrong one once it has none */
+    if (entry->target == target)
+    {
+        if (entry->conf < 3)
+        {
+            entry->conf++;
+        }
+    }
+    else if (entry->conf > 0)
+    {
+        entry->conf--;
+    }
+    else
+    {
+        entry->target = target;
+    }
+
+    /* On a misprediction claim an entry in a longer history table */
+    if (predicted != target && provider < ITTAGE_NUM_TABLES - 1)
+    {
+        int allocated = FALSE;
+
+        for (table = provider + 1; table < ITTAGE_NUM_TABLES; ++table)
+        {
+            indirect_entry *victim = component(ind, table, pc, meta);
+
+            if (victim->useful == 0)
+            {
+                victim->tag = tagged_tag(ind, table, pc, meta);
+                victim->target = target;
+                victim->conf = 0;
+                allocated = TRUE;
+                break;
+            }
+        }
+        if (!allocated)
+        {
+            for (table = provider + 1; table < ITTAGE_NUM_TABLES; ++table)
+            {
+                component(ind, table, pc, meta)->useful--;
+            }
+        }
+    }
+
+    if (++ind->clock % ITTAGE_DECAY_PERIOD == 0)
+    {
+        for (table = 0; table < ITTAGE_NUM_TABLES; ++table)
+        {
+            unsigned int i;
+
+            for (i = 0; i < (1u << ind->tagged_bits); ++i)
+            {
+                ind->tagged[table][i].useful >>= 1;
+            }
+        }
+    }
+}
+
+/*
+ * Shifts a resolved branch into the path history: three bits for its
+ * direction and, when taken, the low two bits of its target word
+ */
+void
+indirect_history(APEX_Indirect *ind, int outcome, int target)
+{
+    ind->history = (ind->history << 3)
+                   | (outcome == TAKEN ? 4u | (word_address(target) & 3) : 0);
+}
+
+size_t
+indirect_storage_bytes(const APEX_Indirect *ind)
+{
+    size_t entry_bits = 32 + 2;
+    size_t bits;
+
+    if (ind->bits == 0)
+    {
+        return 0;
+    }
+    bits = entry_bits << ind->bits;
+    bits += (size_t)ITTAGE_NUM_TABLES
+            * ((entry_bits + ITTAGE_TAG_BITS + 2) << ind->tagged_bits);
+    bits += ind->history_len[ITTAGE_NUM_TABLES - 1];
+    return (bits + 7) / 8;
+}
+
+static int
+transfer_block(void *ptr, size_t size, FILE *fp, int save)
+{
+    size_t done = save ? fwrite(ptr, size, 1, fp) : fread(ptr, size, 1, fp);
+
+    return done == 1 ? 0 : -1;
+}
+
+/*
+ * Reads or writes, depending on save, the size followed by the history and
+ * every table. On load the size read back must match ind's.
+ *
+ * Returns 0 on success, -1 on an I/O error or a size mismatch
+ */
+static int
+indirect_transfer(APEX_Indirect *ind, FILE *fp, int save)
+{
+    int bits = ind->bits;
+    int ret = 0;
+    int table;
+
+    if (transfer_block(&bits, sizeof(bits), fp, save) != 0 || bits != ind->bits)
+    {
+        return -1;
+    }
+    if (bits == 0)
+    {
+        return 0;
+    }
+
+    ret |= transfer_block(&ind->history, sizeof(ind->history), fp, save);
+    ret |= transfer_block(&ind->clock, sizeof(ind->clock), fp, save);
+    ret |= transfer_block(ind->base, sizeof(indirect_entry) << ind->bits, fp, save);
+    for (table = 0; table < ITTAGE_NUM_TABLES; ++table)
+    {
+        ret |= transfer_block(ind->tagged[table],
+                              sizeof(indirect_entry) << ind->tagged_bits, fp, save);
+    }
+    return ret;
+}
+
+/* Writes the predictor size, history and tables to fp */
+int
+indirect_save(const APEX_Indirect *ind, FILE *fp)
+{
+    return indirect_transfer((APEX_Indirect *)ind, fp, TRUE);
+}
+
+/* Reads back tables written by indirect_save into a predictor of the same size */
+int
+indirect_load(APEX_Indirect *ind, FILE *fp)
+{
+    return indirect_transfer(ind, fp, FALSE);
+}
@@ -0,0 +1,51 @@
+/*
+ * apex_indirect.h
+ * Contains APEX indirect branch target predictor declarations
+ *
+ * Author:
+ * Copyright (c) 2020, Gaurav Kothari (gkothar1@binghamton.edu)
+ * State University of New York at Binghamton
+ */
+#ifndef _APEX_INDIRECT_H_
+#define _APEX_INDIRECT_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/* ITTAGE-lite geometry */
+#define ITTAGE_NUM_TABLES 4
+#define ITTAGE_TAG_BITS 9
+
+typedef struct indirect_entry
+{
+    int target;            /* 0 marks an empty entry */
+    unsigned short tag;    /* tagged tables only, 0 never matches */
+    unsigned char conf;    /* 2 bit confidence in target */
+    unsigned char useful;  /* 2 bit usefulness counter */
+} indirect_entry;
+
+/*
+ * Target cache for JUMP and JALR: a tagless base table indexed by PC backed
+ * by tagged tables indexed with geometrically longer path histories
+ */
+typedef struct APEX_Indirect
+{
+    int bits;                              /* log2 entries of the base table, 0 disables */
+    int tagged_bits;                       /* log2 entries of each tagged table */
+    int history_len[ITTAGE_NUM_TABLES];    /* path history bits hashed by each table */
+    uint64_t history;                      /* path history, updated at resolve */
+    unsigned int clock;                    /* drives periodic usefulness decay */
+    indirect_entry *base;
+    indirect_entry *tagged[ITTAGE_NUM_TABLES];
+} APEX_Indirect;
+
+int indirect_init(APEX_Indirect *ind, int bits);
+void indirect_free(APEX_Indirect *ind);
+int indirect_predict(const APEX_Indirect *ind, int pc, int *target, uint64_t *meta);
+void indirect_update(APEX_Indirect *ind, int pc, int target, uint64_t meta);
+void indirect_history(APEX_Indirect *ind, int outcome, int target);
+size_t indirect_storage_bytes(const APEX_Indirect *ind);
+int indirect_save(const APEX_Indirect *ind, FILE *fp);
+int indirect_load(APEX_Indirect *ind, FILE *fp);
+#endif
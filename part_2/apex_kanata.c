@@ -0,0 +1,221 @@
+/*
+ * apex_kanata.c
+ * Contains APEX pipeline timeline export in the Kanata log format
+ *
+ * Author:
+ * Copyright (c) 2020, Gaurav Kothari (gkothar1@binghamton.edu)
+ * State University of New York at Binghamton
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "apex_kanata.h"
+#include "apex_macros.h"
+
+/* Large output buffer, a long run writes several lines per cycle */
+#define KANATA_BUFFER_SIZE (1 << 20)
+
+static const char *const stage_names[] = {"F", "D", "X", "M", "W"};
+
+static void
+end_stage(APEX_Kanata *kanata, const kanata_insn *insn)
+{
+    fprintf(kanata->fp, "E\t%lu\t0\t%s\n", insn->id, stage_names[insn->stage]);
+}
+
+/*
+ * Emits the C command moving the log forward to cycle, retiring what
+ * finished writeback in the cycle being left
+ */
+static void
+advance(APEX_Kanata *kanata, int cycle)
+{
+    int i;
+
+    if (cycle <= kanata->cycle)
+    {
+        return;
+    }
+    fprintf(kanata->fp, "C\t%d\n", cycle - kanata->cycle);
+    kanata->cycle = cycle;
+
+    for (i = 0; kanata->pending > 0 && i < KANATA_MAX_INFLIGHT; ++i)
+    {
+        kanata_insn *insn = &kanata->inflight[i];
+
+        if (insn->retiring)
+        {
+            end_stage(kanata, insn);
+            fprintf(kanata->fp, "R\t%lu\t%lu\t0\n", insn->id, kanata->retired++);
+            insn->stage = -1;
+            insn->retiring = FALSE;
+            kanata->pending--;
+        }
+    }
+}
+
+/* Returns the tracking slot of id if it is still in the pipeline */
+static kanata_insn *
+find_inflight(APEX_Kanata *kanata, unsigned long id)
+{
+    kanata_insn *insn = &kanata->inflight[id % KANATA_MAX_INFLIGHT];
+
+    if (insn->id != id || insn->stage < 0 || insn->retiring)
+    {
+        return NULL;
+    }
+    return insn;
+}
+
+/*
+ * Creates the log at path, starting at cycle
+ *
+ * Returns 0 on success, -1 if the file cannot be created
+ */
+int
+kanata_open(APEX_Kanata *kanata, const char *path, int cycle)
+{
+    int i;
+
+    memset(kanata, 0, sizeof(APEX_Kanata));
+    kanata->fp = fopen(path, "w");
+    if (!kanata->fp)
+    {
+        return -1;
+    }
+    setvbuf(kanata->fp, NULL, _IOFBF, KANATA_BUFFER_SIZE);
+    for (i = 0; i < KANATA_MAX_INFLIGHT; ++i)
+    {
+        kanata->inflight[i].stage = -1;
+    }
+    kanata->cycle = cycle;
+    fprintf(kanata->fp, "Kanata\t0004\nC=\t%d\n", cycle);
+    return 0;
+}
+
+/*
+ * Starts a new instruction in fetch, labelled with text
+ *
+ * Returns the id that names it in later calls
+ */
+unsigned long
+kanata_fetch(APEX_Kanata *kanata, int cycle, const char *text)
+{
+    unsigned long id = kanata->next_id++;
+    kanata_insn *insn = &kanata->inflight[id % KANATA_MAX_INFLIGHT];
+
+    advance(kanata, cycle);
+    insn->id = id;
+    insn->stage = KANATA_FETCH;
+    fprintf(kanata->fp, "I\t%lu\t%lu\t0\nL\t%lu\t0\t%s\nS\t%lu\t0\t%s\n", id, id, id,
+            text, id, stage_names[KANATA_FETCH]);
+    return id;
+}
+
+/*
+ * Moves id into stage. A stage it already passed is ignored, so latches
+ * that still hold a copy of an instruction that moved on are harmless.
+ */
+void
+kanata_stage(APEX_Kanata *kanata, int cycle, unsigned long id, int stage)
+{
+    kanata_insn *insn = find_inflight(kanata, id);
+
+    if (!insn || stage <= insn->stage)
+    {
+        return;
+    }
+    advance(kanata, cycle);
+    end_stage(kanata, insn);
+    insn->stage = stage;
+    fprintf(kanata->fp, "S\t%lu\t0\t%s\n", id, stage_names[stage]);
+}
+
+/* Retires id once the log moves past its writeback cycle */
+void
+kanata_retire(APEX_Kanata *kanata, int cycle, unsigned long id)
+{
+    kanata_insn *insn = find_inflight(kanata, id);
+
+    if (!insn)
+    {
+        return;
+    }
+    advance(kanata, cycle);
+    insn->retiring = TRUE;
+    kanata->pending++;
+}
+
+/* Squashes id if it has not reached execute yet */
+void
+kanata_flush(APEX_Kanata *kanata, int cycle, unsigned long id)
+{
+    kanata_insn *insn = find_inflight(kanata, id);
+
+    if (!insn || insn->stage >= KANATA_EXECUTE)
+    {
+        return;
+    }
+    kanata_squash(kanata, cycle, id);
+}
+
+/*
+ * Squashes id in whatever stage it is, for a back end that keeps no stale
+ * copies of an instruction once it moved on
+ */
+void
+kanata_squash(APEX_Kanata *kanata, int cycle, unsigned long id)
+{
+    kanata_insn *insn = find_inflight(kanata, id);
+
+    if (!insn)
+    {
+        return;
+    }
+    advance(kanata, cycle);
+    end_stage(kanata, insn);
+    fprintf(kanata->fp, "R\t%lu\t0\t1\n", id);
+    insn->stage = -1;
+}
+
+/*
+ * Ends the log after cycle, showing instructions still in the pipeline as
+ * squashed
+ *
+ * Returns 0 on success, -1 if the log could not be written completely
+ */
+int
+kanata_close(APEX_Kanata *kanata, int cycle)
+{
+    int ret = 0;
+    int i;
+
+    if (!kanata->fp)
+    {
+        return 0;
+    }
+
+    advance(kanata, cycle + 1);
+    for (i = 0; i < KANATA_MAX_INFLIGHT; ++i)
+    {
+        kanata_insn *insn = &kanata->inflight[i];
+
+        if (insn->stage >= 0)
+        {
+            end_stage(kanata, insn);
+            fprintf(kanata->fp, "R\t%lu\t0\t1\n", insn->id);
+            insn->stage = -1;
+        }
+    }
+    if (ferror(kanata->fp))
+    {
+        ret = -1;
+    }
+    if (fclose(kanata->fp) != 0)
+    {
+        ret = -1;
+    }
+    kanata->fp = NULL;
+    return ret;
+}
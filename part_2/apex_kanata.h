@@ -0,0 +1,55 @@
+/*
+ * apex_kanata.h
+ * Contains APEX pipeline timeline export in the Kanata log format
+ *
+ * Author:
+ * Copyright (c) 2020, Gaurav Kothari (gkothar1@binghamton.edu)
+ * State University of New York at Binghamton
+ */
+#ifndef _APEX_KANATA_H_
+#define _APEX_KANATA_H_
+
+#include <stdio.h>
+
+/* Stages as lanes of the timeline */
+#define KANATA_FETCH 0
+#define KANATA_DECODE 1
+#define KANATA_EXECUTE 2
+#define KANATA_MEMORY 3
+#define KANATA_WRITEBACK 4
+
+/* Instructions tracked at once, well above the pipeline depth and the
+ * largest reorder buffer */
+#define KANATA_MAX_INFLIGHT 1024
+
+typedef struct kanata_insn
+{
+    unsigned long id;
+    int stage;                     /* -1 once retired or flushed */
+    int retiring;                  /* retires when the log leaves this cycle */
+} kanata_insn;
+
+/*
+ * Writes one Kanata log line per pipeline event as it happens: I and L when
+ * fetch reads an instruction, S each time it enters a later stage, R when it
+ * is squashed or at the end of its writeback cycle. Instructions are named
+ * by fetch order.
+ */
+typedef struct APEX_Kanata
+{
+    FILE *fp;
+    int cycle;                     /* cycle of the last C command */
+    unsigned long next_id;
+    unsigned long retired;
+    int pending;                   /* instructions with retiring set */
+    kanata_insn inflight[KANATA_MAX_INFLIGHT];
+} APEX_Kanata;
+
+int kanata_open(APEX_Kanata *kanata, const char *path, int cycle);
+unsigned long kanata_fetch(APEX_Kanata *kanata, int cycle, const char *text);
+void kanata_stage(APEX_Kanata *kanata, int cycle, unsigned long id, int stage);
+void kanata_retire(APEX_Kanata *kanata, int cycle, unsigned long id);
+void kanata_flush(APEX_Kanata *kanata, int cycle, unsigned long id);
+void kanata_squash(APEX_Kanata *kanata, int cycle, unsigned long id);
+int kanata_close(APEX_Kanata *kanata, int cycle);
+#endif
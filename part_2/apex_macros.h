@@ -12,9 +12,58 @@
 #define FALSE 0x0
 #define TRUE 0x1
 
-/* Integers */
+/* Branch outcomes */
+#define TAKEN 1
+#define NOT_TAKEN 0
+
+/* Default data memory size in words */
 #define DATA_MEMORY_SIZE 4096
 
+/* Address of the first instruction, code memory is word addressed from here */
+#define CODE_MEMORY_BASE 4000
+
+/* Fetch cycles lost when execute redirects the front end */
+#define EXECUTE_REDIRECT_PENALTY 2
+
+/* Fetch cycles lost when decode sends fetch to a branch target the BTB missed */
+#define DECODE_REDIRECT_PENALTY 1
+
+/* Default BTB geometry, a 4 entry fully associative buffer */
+#define BTB_DEFAULT_SETS 1
+#define BTB_DEFAULT_WAYS 4
+#define BTB_MAX_WAYS 32
+
+/* Default return address stack depth, 0 disables return prediction */
+#define RAS_DEFAULT_DEPTH 8
+#define RAS_MAX_DEPTH 64
+
+/* Default indirect target predictor size, log2 base table entries, 0 disables it */
+#define INDIRECT_DEFAULT_BITS 8
+#define INDIRECT_MAX_BITS 20
+
+/* Default fetch target queue depth, 0 predicts in lock step with fetch */
+#define FTQ_DEFAULT_DEPTH 4
+#define FTQ_MAX_DEPTH 64
+
+/* Default out-of-order core, see apex_ooo.h */
+#define OOO_DEFAULT_WIDTH 4
+#define OOO_MAX_WIDTH 8
+#define OOO_DEFAULT_ROB 64
+#define OOO_MAX_ROB 256
+#define OOO_DEFAULT_IQ 32
+#define OOO_DEFAULT_PHYS_REGS 128
+#define OOO_MAX_PHYS_REGS 1024
+#define OOO_DEFAULT_CHECKPOINTS 8
+#define OOO_MAX_CHECKPOINTS 32
+
+/* Cycles from issue to result, loads compute their address then read memory */
+#define OOO_ALU_LATENCY 1
+#define OOO_LOAD_LATENCY 2
+
+/* Default direction predictor sizing */
+#define PREDICTOR_DEFAULT_BITS 12
+#define PREDICTOR_DEFAULT_HISTORY 8
+
 /* Size of integer register file */
 #define REG_FILE_SIZE 32
 
@@ -45,6 +94,7 @@
 #define OPCODE_JUMP 0x18
 #define OPCODE_JALR 0x19
 #define OPCODE_HALT 0x1a
+#define NUM_OPCODES 0x1b
 
 
 
@@ -53,5 +103,8 @@
 
 /* Set this flag to 1 to enable cycle single-step mode */
 #define ENABLE_SINGLE_STEP 1
+
+/* Set this flag to 0 to compile pipeline event recording out entirely */
+#define ENABLE_PIPELINE_EVENTS 1
 #define SIMULATE_STEP 0
 #endif
@@ -0,0 +1,264 @@
+/*
+ * apex_memory.c
+ * Contains APEX paged data memory implementation
+ *
+ * Author:
+ * Copyright (c) 2020, Gaurav Kothari (gkothar1@binghamton.edu)
+ * State University of New York at Binghamton
+ */
+#include <stdlib.h>
+#include <string.h>
+
+#include "apex_memory.h"
+
+/*
+ * Creates an empty memory of size words, only the page table is allocated
+ *
+ * Returns 0 on success, -1 on a bad size or allocation failure
+ */
+int
+memory_init(APEX_Memory *mem, int size)
+{
+    memset(mem, 0, sizeof(APEX_Memory));
+    if (size <= 0)
+    {
+        return -1;
+    }
+
+    mem->size = size;
+    mem->num_pages = (int)(((long)size + MEMORY_PAGE_WORDS - 1) >> MEMORY_PAGE_BITS);
+    mem->pages = calloc(mem->num_pages, sizeof(memory_page *));
+    if (!mem->pages)
+    {
+        return -1;
+    }
+    return 0;
+}
+
+void
+memory_free(APEX_Memory *mem)
+{
+    int page;
+
+    if (mem->pages)
+    {
+        for (page = 0; page < mem->num_pages; ++page)
+        {
+            free(mem->pages[page]);
+        }
+    }
+    free(mem->pages);
+    free(mem->dirty);
+    mem->pages = NULL;
+    mem->dirty = NULL;
+    mem->pages_allocated = 0;
+    mem->num_dirty = 0;
+    mem->dirty_capacity = 0;
+}
+
+/*
+ * Reads the word at address into value
+ *
+ * Returns 0 on success, -1 if address is outside the memory
+ */
+int
+memory_read(const APEX_Memory *mem, int address, int *value)
+{
+    const memory_page *page;
+
+    if (address < 0 || address >= mem->size)
+    {
+        return -1;
+    }
+    page = mem->pages[address >> MEMORY_PAGE_BITS];
+    *value = page ? page->words[address & (MEMORY_PAGE_WORDS - 1)] : 0;
+    return 0;
+}
+
+/*
+ * Appends address to the dirty list, growing it geometrically up to the
+ * memory size
+ *
+ * Returns 0 on success, -1 on allocation failure
+ */
+static int
+append_dirty(APEX_Memory *mem, int address)
+{
+    if (mem->num_dirty == mem->dirty_capacity)
+    {
+        int capacity = mem->dirty_capacity ? mem->dirty_capacity * 2 : 64;
+        int *dirty;
+
+        if (capacity > mem->size)
+        {
+            capacity = mem->size;
+        }
+        dirty = realloc(mem->dirty, capacity * sizeof(int));
+        if (!dirty)
+        {
+            return -1;
+        }
+        mem->dirty = dirty;
+        mem->dirty_capacity = capacity;
+    }
+    mem->dirty[mem->num_dirty++] = address;
+    return 0;
+}
+
+/*
+ * Writes value to the word at address, allocating its page if needed. The
+ * first write to a word adds it to the dirty list.
+ *
+ * Returns 0 on success, -1 if address is outside the memory or the page
+ * cannot be allocated
+ */
+int
+memory_write(APEX_Memory *mem, int address, int value)
+{
+    memory_page **page;
+    int word = address & (MEMORY_PAGE_WORDS - 1);
+    uint32_t bit = 1u << (word & 31);
+
+    if (address < 0 || address >= mem->size)
+    {
+        return -1;
+    }
+    page = &mem->pages[address >> MEMORY_PAGE_BITS];
+    if (!*page)
+    {
+        *page = calloc(1, sizeof(memory_page));
+        if (!*page)
+        {
+            return -1;
+        }
+        mem->pages_allocated++;
+    }
+    if (!((*page)->dirty[word >> 5] & bit))
+    {
+        if (append_dirty(mem, address) != 0)
+        {
+            return -1;
+        }
+        (*page)->dirty[word >> 5] |= bit;
+    }
+    (*page)->words[word] = value;
+    return 0;
+}
+
+/* Returns the word at address for display, 0 when it is out of range */
+int
+memory_peek(const APEX_Memory *mem, int address)
+{
+    int value = 0;
+
+    memory_read(mem, address, &value);
+    return value;
+}
+
+/* Prints every word ever stored, in the order each was first written */
+void
+memory_dump(const APEX_Memory *mem, FILE *fp)
+{
+    int i;
+
+    for (i = 0; i < mem->num_dirty; ++i)
+    {
+        fprintf(fp, "\nMemory[%d]= %d\n", mem->dirty[i], memory_peek(mem, mem->dirty[i]));
+    }
+}
+
+/*
+ * Writes the size, every allocated page preceded by its number, and the dirty
+ * list to fp
+ *
+ * Returns 0 on success, -1 on a write error
+ */
+int
+memory_save(const APEX_Memory *mem, FILE *fp)
+{
+    int page;
+
+    if (fwrite(&mem->size, sizeof(mem->size), 1, fp) != 1
+        || fwrite(&mem->pages_allocated, sizeof(mem->pages_allocated), 1, fp) != 1)
+    {
+        return -1;
+    }
+    for (page = 0; page < mem->num_pages; ++page)
+    {
+        if (!mem->pages[page])
+        {
+            continue;
+        }
+        if (fwrite(&page, sizeof(page), 1, fp) != 1
+            || fwrite(mem->pages[page], sizeof(memory_page), 1, fp) != 1)
+        {
+            return -1;
+        }
+    }
+    if (fwrite(&mem->num_dirty, sizeof(mem->num_dirty), 1, fp) != 1
+        || fwrite(mem->dirty, sizeof(int), mem->num_dirty, fp) != (size_t)mem->num_dirty)
+    {
+        return -1;
+    }
+    return 0;
+}
+
+/*
+ * Reads back pages written by memory_save into an empty memory of the same
+ * size
+ *
+ * Returns 0 on success, -1 on a read error, size mismatch or allocation
+ * failure
+ */
+int
+memory_load(APEX_Memory *mem, FILE *fp)
+{
+    int size, count, page, i;
+    int *dirty;
+
+    if (fread(&size, sizeof(size), 1, fp) != 1 || size != mem->size
+        || fread(&count, sizeof(count), 1, fp) != 1
+        || count < 0 || count > mem->num_pages)
+    {
+        return -1;
+    }
+    for (i = 0; i < count; ++i)
+    {
+        if (fread(&page, sizeof(page), 1, fp) != 1
+            || page < 0 || page >= mem->num_pages)
+        {
+            return -1;
+        }
+        if (!mem->pages[page])
+        {
+            mem->pages[page] = malloc(sizeof(memory_page));
+            if (!mem->pages[page])
+            {
+                return -1;
+            }
+            mem->pages_allocated++;
+        }
+        if (fread(mem->pages[page], sizeof(memory_page), 1, fp) != 1)
+        {
+            return -1;
+        }
+    }
+
+    if (fread(&count, sizeof(count), 1, fp) != 1 || count < 0 || count > mem->size)
+    {
+        return -1;
+    }
+    dirty = realloc(mem->dirty, (count ? count : 1) * sizeof(int));
+    if (!dirty)
+    {
+        return -1;
+    }
+    mem->dirty = dirty;
+    mem->dirty_capacity = count ? count : 1;
+    mem->num_dirty = count;
+    if (fread(mem->dirty, sizeof(int), count, fp) != (size_t)count)
+    {
+        return -1;
+    }
+    return 0;
+}
@@ -0,0 +1,52 @@
+/*
+ * apex_memory.h
+ * Contains APEX paged data memory declarations
+ *
+ * Author:
+ * Copyright (c) 2020, Gaurav Kothari (gkothar1@binghamton.edu)
+ * State University of New York at Binghamton
+ */
+#ifndef _APEX_MEMORY_H_
+#define _APEX_MEMORY_H_
+
+#include <stdint.h>
+#include <stdio.h>
+
+/* Words per data memory page */
+#define MEMORY_PAGE_BITS 10
+#define MEMORY_PAGE_WORDS (1 << MEMORY_PAGE_BITS)
+
+typedef struct memory_page
+{
+    int words[MEMORY_PAGE_WORDS];
+    uint32_t dirty[MEMORY_PAGE_WORDS / 32]; /* one bit per word ever stored */
+} memory_page;
+
+/*
+ * Word addressed data memory of size words. Pages are allocated on the first
+ * store into them; words of pages never stored to read as zero.
+ *
+ * Every stored word is recorded once, in the order it was first written, so
+ * the written words can be listed in time proportional to their number. The
+ * list never holds more than size entries.
+ */
+typedef struct APEX_Memory
+{
+    int size;                      /* addressable words */
+    int num_pages;
+    int pages_allocated;
+    memory_page **pages;           /* num_pages entries, NULL until written */
+    int *dirty;                    /* addresses in first write order */
+    int num_dirty;
+    int dirty_capacity;
+} APEX_Memory;
+
+int memory_init(APEX_Memory *mem, int size);
+void memory_free(APEX_Memory *mem);
+int memory_read(const APEX_Memory *mem, int address, int *value);
+int memory_write(APEX_Memory *mem, int address, int value);
+int memory_peek(const APEX_Memory *mem, int address);
+void memory_dump(const APEX_Memory *mem, FILE *fp);
+int memory_save(const APEX_Memory *mem, FILE *fp);
+int memory_load(APEX_Memory *mem, FILE *fp);
+#endif
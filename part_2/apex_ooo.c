@@ -0,0 +1,1028 @@
+/*
+ * apex_ooo.c
+ * Contains the APEX out-of-order back end: register renaming, issue queue,
+ * reorder buffer and branch checkpoint recovery, driven by the same front
+ * end and predictors as the five stage pipeline
+ *
+ * Author:
+ * Copyright (c) 2020, Gaurav Kothari (gkothar1@binghamton.edu)
+ * State University of New York at Binghamton
+ */
+#include <stdlib.h>
+#include <string.h>
+
+#include "apex_ooo.h"
+
+/* Condition codes held in a physical register, one bit per flag */
+#define CC_Z 0x1
+#define CC_P 0x2
+#define CC_N 0x4
+
+static int
+cc_from_result(int result)
+{
+    return (result == 0 ? CC_Z : 0) | (result > 0 ? CC_P : 0) | (result < 0 ? CC_N : 0);
+}
+
+/* Returns the i-th oldest reorder buffer entry */
+static rob_entry *
+rob_at(APEX_OOO *ooo, int i)
+{
+    return &ooo->rob[(ooo->rob_head + i) % ooo->rob_size];
+}
+
+static int
+fetch_queue_full(const APEX_OOO *ooo)
+{
+    return ooo->fq_count == 2 * ooo->width;
+}
+
+/* BZ, BNZ, BP, BNP, BN and BNN read the condition codes */
+static int
+reads_cc(int opcode)
+{
+    switch (opcode)
+    {
+        case OPCODE_BZ:
+        case OPCODE_BNZ:
+        case OPCODE_BP:
+        case OPCODE_BNP:
+        case OPCODE_BN:
+        case OPCODE_BNN:
+            return TRUE;
+        default:
+            return FALSE;
+    }
+}
+
+/* ALU operations and compares set them */
+static int
+writes_cc(int opcode)
+{
+    switch (opcode)
+    {
+        case OPCODE_ADD:
+        case OPCODE_ADDL:
+        case OPCODE_SUB:
+        case OPCODE_SUBL:
+        case OPCODE_MUL:
+        case OPCODE_AND:
+        case OPCODE_OR:
+        case OPCODE_XOR:
+        case OPCODE_CMP:
+        case OPCODE_CML:
+            return TRUE;
+        default:
+            return FALSE;
+    }
+}
+
+/* NOP, HALT and DIV have nothing to execute and complete at rename */
+static int
+needs_issue(int opcode)
+{
+    return opcode != OPCODE_NOP && opcode != OPCODE_HALT && opcode != OPCODE_DIV;
+}
+
+static int
+is_jump(int opcode)
+{
+    return opcode == OPCODE_JUMP || opcode == OPCODE_JALR;
+}
+
+static int
+is_store(int opcode)
+{
+    return opcode == OPCODE_STORE || opcode == OPCODE_STOREP;
+}
+
+static int
+is_load(int opcode)
+{
+    return opcode == OPCODE_LOAD || opcode == OPCODE_LOADP;
+}
+
+/* Fills arch with the architectural register behind each OOO_DEST_* slot */
+static int
+dest_registers(const CPU_Stage *insn, int arch[OOO_NUM_DESTS])
+{
+    int count = 0;
+    int d;
+
+    arch[OOO_DEST_RD] = (insn->flags & INSN_WRITES_RD) ? insn->rd : -1;
+    arch[OOO_DEST_ADDR] = (insn->flags & INSN_WRITES_RS1) ? insn->rs1
+                          : (insn->flags & INSN_WRITES_RS2) ? insn->rs2 : -1;
+    arch[OOO_DEST_CC] = writes_cc(insn->opcode) ? OOO_CC_REG : -1;
+    for (d = 0; d < OOO_NUM_DESTS; ++d)
+    {
+        count += arch[d] >= 0;
+    }
+    return count;
+}
+
+/*
+ * Creates an empty core. Rename needs a free physical register for every
+ * destination of one instruction beyond the architectural ones, and at least
+ * one checkpoint so branches can rename.
+ *
+ * Returns 0 on success, -1 on a bad size or allocation failure
+ */
+int
+ooo_init(APEX_OOO *ooo, int width, int rob_size, int iq_size, int phys_regs,
+         int num_checkpoints)
+{
+    memset(ooo, 0, sizeof(APEX_OOO));
+
+    if (width < 1 || width > OOO_MAX_WIDTH || rob_size < 1 || rob_size > OOO_MAX_ROB
+        || iq_size < 1 || iq_size > rob_size
+        || phys_regs < OOO_ARCH_REGS + OOO_NUM_DESTS || phys_regs > OOO_MAX_PHYS_REGS
+        || num_checkpoints < 1 || num_checkpoints > OOO_MAX_CHECKPOINTS)
+    {
+        return -1;
+    }
+    ooo->width = width;
+    ooo->rob_size = rob_size;
+    ooo->iq_size = iq_size;
+    ooo->phys_regs = phys_regs;
+    ooo->num_checkpoints = num_checkpoints;
+
+    ooo->prf = calloc(phys_regs, sizeof(int));
+    ooo->prf_ready = calloc(phys_regs, sizeof(unsigned char));
+    ooo->free_list = calloc(phys_regs, sizeof(int));
+    ooo->rob = calloc(rob_size, sizeof(rob_entry));
+    ooo->checkpoints = calloc(num_checkpoints, sizeof(ooo_checkpoint));
+    if (!ooo->prf || !ooo->prf_ready || !ooo->free_list || !ooo->rob || !ooo->checkpoints)
+    {
+        ooo_free(ooo);
+        return -1;
+    }
+    return 0;
+}
+
+void
+ooo_free(APEX_OOO *ooo)
+{
+    free(ooo->prf);
+    free(ooo->prf_ready);
+    free(ooo->free_list);
+    free(ooo->rob);
+    free(ooo->checkpoints);
+    ooo->prf = NULL;
+    ooo->prf_ready = NULL;
+    ooo->free_list = NULL;
+    ooo->rob = NULL;
+    ooo->checkpoints = NULL;
+}
+
+/* TRUE while any fetched instruction has not retired or been squashed */
+int
+ooo_busy(const APEX_OOO *ooo)
+{
+    return ooo->rob_count > 0 || ooo->fq_count > 0;
+}
+
+const char *
+ooo_stall_name(int cause)
+{
+    static const char *const names[OOO_NUM_STALLS] = {"rob", "iq", "regs", "checkpoints"};
+
+    return (cause >= 0 && cause < OOO_NUM_STALLS) ? names[cause] : "???";
+}
+
+/*
+ * Empties the core and maps every architectural register, and the condition
+ * codes, onto a physical register holding its current value. Used when the
+ * CPU is created and when detailed simulation resumes after a functional
+ * region.
+ */
+void
+APEX_ooo_resume(APEX_CPU *cpu)
+{
+    APEX_OOO *ooo = cpu->ooo;
+    int i;
+
+    for (i = 0; i < REG_FILE_SIZE; ++i)
+    {
+        ooo->rat[i] = i;
+        ooo->prf[i] = cpu->regs[i];
+    }
+    ooo->rat[OOO_CC_REG] = OOO_CC_REG;
+    ooo->prf[OOO_CC_REG] = (cpu->cc.z ? CC_Z : 0) | (cpu->cc.p ? CC_P : 0)
+                           | (cpu->cc.n ? CC_N : 0);
+    memset(ooo->prf_ready, TRUE, ooo->phys_regs);
+
+    for (i = OOO_ARCH_REGS; i < ooo->phys_regs; ++i)
+    {
+        ooo->free_list[i - OOO_ARCH_REGS] = i;
+    }
+    ooo->free_head = 0;
+    ooo->free_count = ooo->phys_regs - OOO_ARCH_REGS;
+
+    ooo->rob_head = 0;
+    ooo->rob_count = 0;
+    ooo->iq_count = 0;
+    ooo->fq_head = 0;
+    ooo->fq_count = 0;
+    memset(ooo->checkpoints, 0, sizeof(ooo_checkpoint) * ooo->num_checkpoints);
+}
+
+static int
+allocate_register(APEX_OOO *ooo)
+{
+    int phys = ooo->free_list[ooo->free_head];
+
+    ooo->free_head = (ooo->free_head + 1) % ooo->phys_regs;
+    ooo->free_count--;
+    ooo->prf_ready[phys] = FALSE;
+    return phys;
+}
+
+static void
+release_register(APEX_OOO *ooo, int phys)
+{
+    ooo->free_list[(ooo->free_head + ooo->free_count) % ooo->phys_regs] = phys;
+    ooo->free_count++;
+}
+
+/* Returns an unused checkpoint, or -1 if every one belongs to a branch */
+static int
+find_checkpoint(const APEX_OOO *ooo)
+{
+    int i;
+
+    for (i = 0; i < ooo->num_checkpoints; ++i)
+    {
+        if (!ooo->checkpoints[i].valid)
+        {
+            return i;
+        }
+    }
+    return -1;
+}
+
+/*
+ * Rebuilds the return address stack fetch predicts from: the calls and
+ * returns that retired, then those still in the reorder buffer in program
+ * order, which is the state fetch had after the youngest of them
+ */
+static void
+rebuild_return_stack(APEX_CPU *cpu)
+{
+    APEX_OOO *ooo = cpu->ooo;
+    int i;
+
+    ras_copy(&cpu->ras, &cpu->ras_resolved);
+    for (i = 0; i < ooo->rob_count; ++i)
+    {
+        const CPU_Stage *insn = &rob_at(ooo, i)->insn;
+
+        if (insn->opcode == OPCODE_JALR)
+        {
+            ras_push(&cpu->ras, insn->pc + 4, insn->rd);
+        }
+        else if (insn->opcode == OPCODE_JUMP && ras_is_return(&cpu->ras, insn->rs1))
+        {
+            ras_pop(&cpu->ras);
+        }
+    }
+}
+
+/*
+ * Sends fetch to new_pc behind insn, the youngest instruction left in the
+ * reorder buffer, charging the cycles fetch spent on the wrong path to cause.
+ * Everything in the fetch queue and the fetch target queue is dropped.
+ */
+static void
+redirect_front_end(APEX_CPU *cpu, const CPU_Stage *insn, int new_pc, int cause,
+                   int cycles)
+{
+    APEX_OOO *ooo = cpu->ooo;
+
+    stats_record_flush(&cpu->stats, insn->pc, cause, cycles);
+    RECORD_EVENT(cpu, EVENT_FLUSH, insn->pc, insn->opcode, new_pc);
+
+    for (; ooo->fq_count > 0; ooo->fq_count--)
+    {
+        if (cpu->kanata)
+        {
+            kanata_squash(cpu->kanata, cpu->clock, ooo->fetch_queue[ooo->fq_head].insn.seq);
+        }
+        ooo->fq_head = (ooo->fq_head + 1) % OOO_FETCH_QUEUE_SIZE;
+    }
+
+    cpu->pc = new_pc;
+    cpu->fetch_from_next_cycle = TRUE;
+    cpu->stats.ftq.flushed += ftq_flush(&cpu->ftq);
+    rebuild_return_stack(cpu);
+    cpu->fetch.has_insn = TRUE;
+}
+
+/*
+ * Squashes every reorder buffer entry younger than the one at position,
+ * with their issue queue slots and checkpoints. Their physical registers
+ * were allocated after position's checkpoint and go back with it.
+ */
+static void
+squash_younger(APEX_CPU *cpu, int position)
+{
+    APEX_OOO *ooo = cpu->ooo;
+    int i;
+
+    for (i = ooo->rob_count - 1; i > position; --i)
+    {
+        rob_entry *entry = rob_at(ooo, i);
+
+        if (entry->in_iq)
+        {
+            ooo->iq_count--;
+        }
+        if (entry->checkpoint >= 0)
+        {
+            ooo->checkpoints[entry->checkpoint].valid = FALSE;
+        }
+        if (cpu->kanata)
+        {
+            kanata_squash(cpu->kanata, cpu->clock, entry->insn.seq);
+        }
+        ooo->stats.squashed++;
+    }
+    ooo->rob_count = position + 1;
+}
+
+/*
+ * Checks the path fetch took past the branch at position, which just
+ * completed. Its checkpoint is no longer needed; when the path was wrong
+ * the rename map is restored from it, everything younger is squashed and
+ * fetch restarts on the right path.
+ */
+static void
+resolve_branch(APEX_CPU *cpu, int position)
+{
+    APEX_OOO *ooo = cpu->ooo;
+    rob_entry *entry = rob_at(ooo, position);
+    const CPU_Stage *insn = &entry->insn;
+    ooo_checkpoint *checkpoint = &ooo->checkpoints[entry->checkpoint];
+    int followed = insn->btb_searched
+                   && (!is_jump(insn->opcode) || insn->pred_target == entry->target);
+    int cause;
+
+    checkpoint->valid = FALSE;
+    entry->checkpoint = -1;
+    if (followed == (entry->outcome == TAKEN))
+    {
+        return;
+    }
+
+    if (is_jump(insn->opcode))
+    {
+        cause = FLUSH_TARGET;
+    }
+    else if (entry->outcome == TAKEN && insn->pred_taken == TAKEN)
+    {
+        /* Predicted taken but not followed means there was no target */
+        cause = FLUSH_BTB_MISS;
+    }
+    else
+    {
+        cause = FLUSH_DIRECTION;
+    }
+
+    memcpy(ooo->rat, checkpoint->rat, sizeof(ooo->rat));
+    ooo->free_count += (ooo->free_head - checkpoint->free_head + ooo->phys_regs)
+                       % ooo->phys_regs;
+    ooo->free_head = checkpoint->free_head;
+    ooo->stats.recoveries++;
+
+    squash_younger(cpu, position);
+    redirect_front_end(cpu, insn, entry->outcome == TAKEN ? entry->target : insn->pc + 4,
+                       cause, cpu->clock - entry->fetch_cycle);
+}
+
+/*
+ * Looks up the registers the instruction in entry reads under the current
+ * map, then maps each register it writes to a new physical register. A
+ * branch or jump saves the map as it stands after it.
+ */
+static void
+rename_registers(APEX_OOO *ooo, rob_entry *entry)
+{
+    const CPU_Stage *insn = &entry->insn;
+    int arch[OOO_NUM_DESTS];
+    int d;
+
+    entry->src[OOO_SRC_RS1] = (insn->flags & INSN_READS_RS1) ? ooo->rat[insn->rs1] : -1;
+    entry->src[OOO_SRC_RS2] = (insn->flags & INSN_READS_RS2) ? ooo->rat[insn->rs2] : -1;
+    entry->src[OOO_SRC_CC] = reads_cc(insn->opcode) ? ooo->rat[OOO_CC_REG] : -1;
+
+    /* In slot order, so LOADP's address register wins over rd as in writeback */
+    dest_registers(insn, arch);
+    for (d = 0; d < OOO_NUM_DESTS; ++d)
+    {
+        entry->dest[d].arch = arch[d];
+        if (arch[d] < 0)
+        {
+            continue;
+        }
+        entry->dest[d].old_phys = ooo->rat[arch[d]];
+        entry->dest[d].phys = allocate_register(ooo);
+        ooo->rat[arch[d]] = entry->dest[d].phys;
+    }
+
+    entry->checkpoint = -1;
+    if (insn->flags & INSN_BRANCH)
+    {
+        ooo_checkpoint *checkpoint;
+
+        entry->checkpoint = find_checkpoint(ooo);
+        checkpoint = &ooo->checkpoints[entry->checkpoint];
+        checkpoint->valid = TRUE;
+        checkpoint->free_head = ooo->free_head;
+        memcpy(checkpoint->rat, ooo->rat, sizeof(ooo->rat));
+    }
+}
+
+/* Returns the OOO_STALL_* structure insn finds full, or -1 if it can rename */
+static int
+rename_blocked(const APEX_OOO *ooo, const CPU_Stage *insn)
+{
+    int arch[OOO_NUM_DESTS];
+
+    if (ooo->rob_count == ooo->rob_size)
+    {
+        return OOO_STALL_ROB;
+    }
+    if (needs_issue(insn->opcode) && ooo->iq_count == ooo->iq_size)
+    {
+        return OOO_STALL_IQ;
+    }
+    if (dest_registers(insn, arch) > ooo->free_count)
+    {
+        return OOO_STALL_REGS;
+    }
+    if ((insn->flags & INSN_BRANCH) && find_checkpoint(ooo) < 0)
+    {
+        return OOO_STALL_CHECKPOINTS;
+    }
+    return -1;
+}
+
+/*
+ * Rename stage, also decode for the BTB: moves up to width instructions from
+ * the fetch queue into the reorder buffer in program order, stopping at the
+ * first one a structure has no room for. A taken branch the BTB missed sends
+ * fetch to its target from here, as decode does in the five stage pipeline.
+ */
+static void
+rename_stage(APEX_CPU *cpu)
+{
+    APEX_OOO *ooo = cpu->ooo;
+    int n;
+
+    for (n = 0; n < ooo->width && ooo->fq_count > 0; ++n)
+    {
+        const ooo_fetched *next = &ooo->fetch_queue[ooo->fq_head];
+        int cause = rename_blocked(ooo, &next->insn);
+        rob_entry *entry;
+
+        if (cause >= 0)
+        {
+            ooo->stats.rename_stalls[cause]++;
+            return;
+        }
+
+        entry = rob_at(ooo, ooo->rob_count++);
+        memset(entry, 0, sizeof(rob_entry));
+        entry->insn = next->insn;
+        entry->fetch_cycle = next->cycle;
+        ooo->fq_head = (ooo->fq_head + 1) % OOO_FETCH_QUEUE_SIZE;
+        ooo->fq_count--;
+
+        rename_registers(ooo, entry);
+        if (needs_issue(entry->insn.opcode))
+        {
+            entry->in_iq = TRUE;
+            ooo->iq_count++;
+        }
+        else
+        {
+            entry->completed = TRUE;
+        }
+        ooo->stats.renamed++;
+
+        if (cpu->kanata)
+        {
+            kanata_stage(cpu->kanata, cpu->clock, entry->insn.seq, KANATA_DECODE);
+        }
+        if (DEBUG_ON(cpu))
+        {
+            print_stage_content("Rename", &entry->insn);
+        }
+
+        if ((entry->insn.flags & INSN_PREDICTED) && entry->insn.btb_searched == 0
+            && APEX_decode_branch_target(cpu, &entry->insn))
+        {
+            /* What is left in the fetch queue is the fall through path */
+            redirect_front_end(cpu, &entry->insn, entry->insn.pred_target, FLUSH_BTB_MISS,
+                               cpu->clock - entry->fetch_cycle);
+            return;
+        }
+    }
+}
+
+/* ADD, ADDL, SUB, SUBL, MUL, AND, OR, EXOR and the CMP, CML subtraction */
+static int
+alu_result(const CPU_Stage *insn)
+{
+    int a = insn->rs1_value;
+    int b = (insn->flags & INSN_READS_RS2) ? insn->rs2_value : insn->imm;
+
+    switch (insn->opcode)
+    {
+        case OPCODE_ADD:
+        case OPCODE_ADDL:
+            return a + b;
+        case OPCODE_MUL:
+            return a * b;
+        case OPCODE_AND:
+            return a & b;
+        case OPCODE_OR:
+            return a | b;
+        case OPCODE_XOR:
+            return a ^ b;
+        default:
+            return a - b;
+    }
+}
+
+/*
+ * A load may issue once no older store has an unknown address, so it never
+ * has to be replayed
+ */
+static int
+older_stores_resolved(APEX_OOO *ooo, int position)
+{
+    int i;
+
+    for (i = 0; i < position; ++i)
+    {
+        const rob_entry *older = rob_at(ooo, i);
+
+        if (is_store(older->insn.opcode) && !older->completed)
+        {
+            return FALSE;
+        }
+    }
+    return TRUE;
+}
+
+/*
+ * Reads the word a load at position wants: from the youngest older store to
+ * the same address still in the reorder buffer, otherwise from data memory.
+ * An address outside data memory only faults if the load commits.
+ */
+static int
+load_value(APEX_CPU *cpu, rob_entry *entry, int position)
+{
+    int address = entry->insn.memory_address;
+    int value = 0;
+    int i;
+
+    for (i = position - 1; i >= 0; --i)
+    {
+        const rob_entry *older = rob_at(cpu->ooo, i);
+
+        if (is_store(older->insn.opcode) && older->insn.memory_address == address)
+        {
+            return older->insn.rs1_value;
+        }
+    }
+    if (memory_read(&cpu->data_memory, address, &value) != 0)
+    {
+        entry->fault = TRUE;
+    }
+    return value;
+}
+
+/*
+ * Executes the instruction at position with the source values it issued
+ * with. Results are held in the entry until ready_cycle, when they are
+ * written to the physical registers; branches find their outcome and target.
+ */
+static void
+execute_entry(APEX_CPU *cpu, int position)
+{
+    APEX_OOO *ooo = cpu->ooo;
+    rob_entry *entry = rob_at(ooo, position);
+    CPU_Stage *insn = &entry->insn;
+    ooo_dest *dest = entry->dest;
+    int cc = 0;
+    int result;
+
+    if (entry->src[OOO_SRC_RS1] >= 0)
+    {
+        insn->rs1_value = ooo->prf[entry->src[OOO_SRC_RS1]];
+    }
+    if (entry->src[OOO_SRC_RS2] >= 0)
+    {
+        insn->rs2_value = ooo->prf[entry->src[OOO_SRC_RS2]];
+    }
+    if (entry->src[OOO_SRC_CC] >= 0)
+    {
+        cc = ooo->prf[entry->src[OOO_SRC_CC]];
+    }
+    entry->ready_cycle = cpu->clock + OOO_ALU_LATENCY;
+    entry->target = insn->pc + insn->imm;
+
+    switch (insn->opcode)
+    {
+        case OPCODE_ADD:
+        case OPCODE_ADDL:
+        case OPCODE_SUB:
+        case OPCODE_SUBL:
+        case OPCODE_MUL:
+        case OPCODE_AND:
+        case OPCODE_OR:
+        case OPCODE_XOR:
+            result = alu_result(insn);
+            dest[OOO_DEST_RD].value = result;
+            dest[OOO_DEST_CC].value = cc_from_result(result);
+            break;
+        case OPCODE_CMP:
+        case OPCODE_CML:
+            dest[OOO_DEST_CC].value = cc_from_result(alu_result(insn));
+            break;
+        case OPCODE_MOVC:
+            dest[OOO_DEST_RD].value = insn->imm;
+            break;
+        case OPCODE_LOAD:
+        case OPCODE_LOADP:
+            insn->memory_address = insn->rs1_value + insn->imm;
+            dest[OOO_DEST_RD].value = load_value(cpu, entry, position);
+            dest[OOO_DEST_ADDR].value = insn->rs1_value + 4;
+            entry->ready_cycle = cpu->clock + OOO_LOAD_LATENCY;
+            break;
+        case OPCODE_STORE:
+        case OPCODE_STOREP:
+            insn->memory_address = insn->rs2_value + insn->imm;
+            dest[OOO_DEST_ADDR].value = insn->rs2_value + 4;
+            break;
+        case OPCODE_BZ:
+            entry->outcome = (cc & CC_Z) ? TAKEN : NOT_TAKEN;
+            break;
+        case OPCODE_BNZ:
+            entry->outcome = (cc & CC_Z) ? NOT_TAKEN : TAKEN;
+            break;
+        case OPCODE_BP:
+            entry->outcome = (cc & CC_P) ? TAKEN : NOT_TAKEN;
+            break;
+        case OPCODE_BNP:
+            entry->outcome = (cc & CC_P) ? NOT_TAKEN : TAKEN;
+            break;
+        case OPCODE_BN:
+            entry->outcome = (cc & CC_N) ? TAKEN : NOT_TAKEN;
+            break;
+        case OPCODE_BNN:
+            entry->outcome = (cc & CC_N) ? NOT_TAKEN : TAKEN;
+            break;
+        case OPCODE_JALR:
+            dest[OOO_DEST_RD].value = insn->pc + 4;
+            /* fall through */
+        case OPCODE_JUMP:
+            entry->target = insn->rs1_value + insn->imm;
+            entry->outcome = TAKEN;
+            break;
+    }
+}
+
+/*
+ * Issue stage: selects, oldest first, up to width instructions in the issue
+ * queue whose source registers have all been written, and executes them
+ */
+static void
+issue_stage(APEX_CPU *cpu)
+{
+    APEX_OOO *ooo = cpu->ooo;
+    int issued = 0;
+    int i, s;
+
+    for (i = 0; i < ooo->rob_count && issued < ooo->width; ++i)
+    {
+        rob_entry *entry = rob_at(ooo, i);
+        int ready = entry->in_iq;
+
+        for (s = 0; ready && s < OOO_NUM_SRCS; ++s)
+        {
+            ready = entry->src[s] < 0 || ooo->prf_ready[entry->src[s]];
+        }
+        if (!ready || (is_load(entry->insn.opcode) && !older_stores_resolved(ooo, i)))
+        {
+            continue;
+        }
+
+        execute_entry(cpu, i);
+        entry->in_iq = FALSE;
+        entry->issued = TRUE;
+        ooo->iq_count--;
+        issued++;
+
+        if (cpu->kanata)
+        {
+            kanata_stage(cpu->kanata, cpu->clock, entry->insn.seq, KANATA_EXECUTE);
+        }
+        if (DEBUG_ON(cpu))
+        {
+            print_stage_content("Issue", &entry->insn);
+        }
+    }
+    ooo->stats.issued += issued;
+}
+
+/*
+ * Writeback stage: every issued instruction whose latency is up writes its
+ * physical registers, which wakes the instructions waiting on them, and
+ * branches resolve. The oldest are handled first, so a mispredicted branch
+ * squashes the younger ones before they resolve.
+ */
+static void
+complete_stage(APEX_CPU *cpu)
+{
+    APEX_OOO *ooo = cpu->ooo;
+    int i, d;
+
+    for (i = 0; i < ooo->rob_count; ++i)
+    {
+        rob_entry *entry = rob_at(ooo, i);
+
+        if (!entry->issued || entry->completed || entry->ready_cycle > cpu->clock)
+        {
+            continue;
+        }
+        for (d = 0; d < OOO_NUM_DESTS; ++d)
+        {
+            if (entry->dest[d].arch >= 0)
+            {
+                ooo->prf[entry->dest[d].phys] = entry->dest[d].value;
+                ooo->prf_ready[entry->dest[d].phys] = TRUE;
+            }
+        }
+        entry->completed = TRUE;
+
+        if (cpu->kanata)
+        {
+            kanata_stage(cpu->kanata, cpu->clock, entry->insn.seq, KANATA_WRITEBACK);
+        }
+        if (DEBUG_ON(cpu))
+        {
+            print_stage_content("Writeback", &entry->insn);
+        }
+        if (entry->insn.flags & INSN_BRANCH)
+        {
+            resolve_branch(cpu, i);
+        }
+    }
+}
+
+/*
+ * Trains the BTB, the direction and indirect predictors and the resolved
+ * return address stack with a retiring branch or jump, in program order, as
+ * execute does in the five stage pipeline
+ */
+static void
+train_branch(APEX_CPU *cpu, const rob_entry *entry)
+{
+    const CPU_Stage *insn = &entry->insn;
+    int followed = insn->btb_searched
+                   && (!is_jump(insn->opcode) || insn->pred_target == entry->target);
+    BTB *btb_entry;
+
+    if (is_jump(insn->opcode))
+    {
+        stats_record_target(&cpu->stats, insn->pc, entry->target);
+        if (!resolve_return_stack(cpu, insn, entry->target))
+        {
+            indirect_update(&cpu->indirect, insn->pc, entry->target, insn->pred_meta);
+        }
+    }
+    record_branch_outcome(cpu, insn, followed ? TAKEN : NOT_TAKEN, entry->outcome,
+                          entry->target);
+
+    if (!(insn->flags & INSN_PREDICTED))
+    {
+        return;
+    }
+    btb_entry = btb_lookup(&cpu->btb, insn->pc);
+    if (btb_entry != NULL)
+    {
+        btb_entry->num_executed++;
+        btb_entry->target_address = entry->target;
+        predictor_update(&cpu->predictor, insn->pc, entry->outcome, insn->pred_meta);
+    }
+}
+
+/*
+ * Commit stage: retires up to width completed instructions from the head of
+ * the reorder buffer. Stores write data memory, results become architectural
+ * and free the physical registers they replace, and branches train the
+ * predictors.
+ *
+ * Returns TRUE if HALT retired or a memory access faulted
+ */
+static int
+commit_stage(APEX_CPU *cpu)
+{
+    APEX_OOO *ooo = cpu->ooo;
+    int n, d;
+
+    for (n = 0; n < ooo->width && ooo->rob_count > 0; ++n)
+    {
+        rob_entry *entry = rob_at(ooo, 0);
+        const CPU_Stage *insn = &entry->insn;
+
+        if (!entry->completed)
+        {
+            break;
+        }
+        if (entry->fault
+            || (is_store(insn->opcode)
+                && memory_write(&cpu->data_memory, insn->memory_address, insn->rs1_value) != 0))
+        {
+            fprintf(stderr, "APEX_Error: Data memory address %d out of range (size %d) at pc %d\n",
+                    insn->memory_address, cpu->data_memory.size, insn->pc);
+            cpu->fault = TRUE;
+            return TRUE;
+        }
+
+        for (d = 0; d < OOO_NUM_DESTS; ++d)
+        {
+            const ooo_dest *dest = &entry->dest[d];
+
+            if (dest->arch < 0)
+            {
+                continue;
+            }
+            if (dest->arch == OOO_CC_REG)
+            {
+                cpu->cc.z = (dest->value & CC_Z) != 0;
+                cpu->cc.p = (dest->value & CC_P) != 0;
+                cpu->cc.n = (dest->value & CC_N) != 0;
+                cpu->zero_flag = cpu->cc.z;
+            }
+            else
+            {
+                cpu->regs[dest->arch] = dest->value;
+            }
+            release_register(ooo, dest->old_phys);
+        }
+        if (insn->flags & INSN_BRANCH)
+        {
+            train_branch(cpu, entry);
+        }
+
+        ooo->rob_head = (ooo->rob_head + 1) % ooo->rob_size;
+        ooo->rob_count--;
+        cpu->insn_completed++;
+        RECORD_EVENT(cpu, EVENT_RETIRE, insn->pc, insn->opcode, cpu->insn_completed);
+        if (cpu->kanata)
+        {
+            kanata_retire(cpu->kanata, cpu->clock, insn->seq);
+        }
+        if (DEBUG_ON(cpu))
+        {
+            print_stage_content("Commit", insn);
+        }
+        if (insn->opcode == OPCODE_HALT)
+        {
+            return TRUE;
+        }
+    }
+    return FALSE;
+}
+
+/*
+ * Runs up to width fetch slots of the shared front end, queueing what each
+ * delivers for rename. A fetch group ends after an instruction fetch
+ * followed to a target, or at a slot that delivered nothing.
+ */
+static void
+fetch_stage(APEX_CPU *cpu)
+{
+    APEX_OOO *ooo = cpu->ooo;
+    int n;
+
+    cpu->stats.ftq.occupancy += cpu->ftq.count;
+    if (cpu->draining)
+    {
+        return;
+    }
+
+    for (n = 0; n < ooo->width; ++n)
+    {
+        ooo_fetched *slot;
+
+        cpu->fetch.stalled = fetch_queue_full(ooo);
+        cpu->decode.has_insn = FALSE;
+        APEX_fetch_slot(cpu);
+        if (cpu->fetch.stalled || !cpu->decode.has_insn)
+        {
+            return;
+        }
+
+        slot = &ooo->fetch_queue[(ooo->fq_head + ooo->fq_count) % OOO_FETCH_QUEUE_SIZE];
+        slot->insn = cpu->decode;
+        slot->cycle = cpu->clock;
+        ooo->fq_count++;
+        cpu->decode.has_insn = FALSE;
+        if (slot->insn.btb_searched)
+        {
+            return;
+        }
+    }
+}
+
+/*
+ * Advances the out-of-order core by one cycle, its stages in reverse order
+ * like the five stage pipeline's
+ *
+ * Returns TRUE if HALT retired or the run faulted
+ */
+int
+APEX_ooo_cycle(APEX_CPU *cpu)
+{
+    APEX_OOO *ooo = cpu->ooo;
+
+    if (commit_stage(cpu))
+    {
+        return TRUE;
+    }
+    complete_stage(cpu);
+    issue_stage(cpu);
+    rename_stage(cpu);
+    fetch_stage(cpu);
+
+    ooo->stats.rob_occupancy += ooo->rob_count;
+    ooo->stats.iq_occupancy += ooo->iq_count;
+    return FALSE;
+}
+
+static int
+transfer_block(void *ptr, size_t size, FILE *fp, int save)
+{
+    size_t done = save ? fwrite(ptr, size, 1, fp) : fread(ptr, size, 1, fp);
+
+    return done == 1 ? 0 : -1;
+}
+
+/*
+ * Reads or writes, depending on save, the sizes followed by the rename
+ * state, the reorder buffer, checkpoints, fetch queue and counters. On load
+ * the sizes read back must match ooo's.
+ *
+ * Returns 0 on success, -1 on an I/O error or a size mismatch
+ */
+static int
+ooo_transfer(APEX_OOO *ooo, FILE *fp, int save)
+{
+    int sizes[5] = {ooo->width, ooo->rob_size, ooo->iq_size, ooo->phys_regs,
+                    ooo->num_checkpoints};
+    int expected[5];
+    int ret = 0;
+
+    memcpy(expected, sizes, sizeof(sizes));
+    if (transfer_block(sizes, sizeof(sizes), fp, save) != 0
+        || memcmp(sizes, expected, sizeof(sizes)) != 0)
+    {
+        return -1;
+    }
+
+    ret |= transfer_block(ooo->rat, sizeof(ooo->rat), fp, save);
+    ret |= transfer_block(ooo->prf, sizeof(int) * ooo->phys_regs, fp, save);
+    ret |= transfer_block(ooo->prf_ready, sizeof(unsigned char) * ooo->phys_regs, fp, save);
+    ret |= transfer_block(ooo->free_list, sizeof(int) * ooo->phys_regs, fp, save);
+    ret |= transfer_block(&ooo->free_head, sizeof(ooo->free_head), fp, save);
+    ret |= transfer_block(&ooo->free_count, sizeof(ooo->free_count), fp, save);
+    ret |= transfer_block(ooo->rob, sizeof(rob_entry) * ooo->rob_size, fp, save);
+    ret |= transfer_block(&ooo->rob_head, sizeof(ooo->rob_head), fp, save);
+    ret |= transfer_block(&ooo->rob_count, sizeof(ooo->rob_count), fp, save);
+    ret |= transfer_block(&ooo->iq_count, sizeof(ooo->iq_count), fp, save);
+    ret |= transfer_block(ooo->checkpoints, sizeof(ooo_checkpoint) * ooo->num_checkpoints,
+                          fp, save);
+    ret |= transfer_block(ooo->fetch_queue, sizeof(ooo->fetch_queue), fp, save);
+    ret |= transfer_block(&ooo->fq_head, sizeof(ooo->fq_head), fp, save);
+    ret |= transfer_block(&ooo->fq_count, sizeof(ooo->fq_count), fp, save);
+    ret |= transfer_block(&ooo->stats, sizeof(ooo->stats), fp, save);
+    return ret;
+}
+
+/* Writes the complete state of the core to fp */
+int
+ooo_save(const APEX_OOO *ooo, FILE *fp)
+{
+    return ooo_transfer((APEX_OOO *)ooo, fp, TRUE);
+}
+
+/* Reads back a core written by ooo_save into one of the same sizes */
+int
+ooo_load(APEX_OOO *ooo, FILE *fp)
+{
+    return ooo_transfer(ooo, fp, FALSE);
+}
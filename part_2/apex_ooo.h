@@ -0,0 +1,141 @@
+/*
+ * apex_ooo.h
+ * Contains the APEX out-of-order back end declarations
+ *
+ * Author:
+ * Copyright (c) 2020, Gaurav Kothari (gkothar1@binghamton.edu)
+ * State University of New York at Binghamton
+ */
+#ifndef _APEX_OOO_H_
+#define _APEX_OOO_H_
+
+#include <stdio.h>
+
+#include "apex_cpu.h"
+
+/* The condition codes are renamed like one more architectural register */
+#define OOO_CC_REG REG_FILE_SIZE
+#define OOO_ARCH_REGS (REG_FILE_SIZE + 1)
+
+/* Registers an instruction reads: rs1, rs2 and the condition codes */
+#define OOO_SRC_RS1 0
+#define OOO_SRC_RS2 1
+#define OOO_SRC_CC 2
+#define OOO_NUM_SRCS 3
+
+/* Registers an instruction writes: rd, the address register LOADP and
+ * STOREP bump, and the condition codes */
+#define OOO_DEST_RD 0
+#define OOO_DEST_ADDR 1
+#define OOO_DEST_CC 2
+#define OOO_NUM_DESTS 3
+
+/* Why rename held the oldest instruction waiting for it */
+#define OOO_STALL_ROB 0            /* reorder buffer full */
+#define OOO_STALL_IQ 1             /* issue queue full */
+#define OOO_STALL_REGS 2           /* no free physical register */
+#define OOO_STALL_CHECKPOINTS 3    /* branch with no free rename map checkpoint */
+#define OOO_NUM_STALLS 4
+
+/* Instructions fetch delivers per slot wait here for rename, two groups deep */
+#define OOO_FETCH_QUEUE_SIZE (2 * OOO_MAX_WIDTH)
+
+/* Instruction fetch delivered, waiting for rename */
+typedef struct ooo_fetched
+{
+    CPU_Stage insn;
+    int cycle;                     /* cycle fetch delivered it */
+} ooo_fetched;
+
+/* Renamed destination, arch is -1 when the slot is unused */
+typedef struct ooo_dest
+{
+    int arch;
+    int phys;
+    int old_phys;                  /* previous mapping, freed when this commits */
+    int value;
+} ooo_dest;
+
+typedef struct rob_entry
+{
+    CPU_Stage insn;                /* as fetch delivered it, with its prediction */
+    int fetch_cycle;
+    int src[OOO_NUM_SRCS];         /* physical registers read, -1 when not read */
+    ooo_dest dest[OOO_NUM_DESTS];
+    int checkpoint;                /* rename map saved until it resolves, or -1 */
+    int ready_cycle;               /* cycle its result is written */
+    int target;                    /* resolved target of a branch or jump */
+    unsigned char outcome;         /* TAKEN or NOT_TAKEN for a branch */
+    unsigned char in_iq;           /* waiting to issue */
+    unsigned char issued;
+    unsigned char completed;       /* result written, may commit */
+    unsigned char fault;           /* data address out of range, raised at commit */
+} rob_entry;
+
+/* Rename map saved at a branch, restored when it resolves mispredicted */
+typedef struct ooo_checkpoint
+{
+    int valid;
+    int free_head;                 /* free list position after the branch renamed */
+    int rat[OOO_ARCH_REGS];
+} ooo_checkpoint;
+
+typedef struct ooo_stats
+{
+    unsigned long rob_occupancy;   /* sum over cycles of the instructions in the ROB */
+    unsigned long iq_occupancy;    /* sum over cycles of the instructions waiting to issue */
+    unsigned long renamed;
+    unsigned long issued;
+    unsigned long squashed;        /* renamed on a wrong path */
+    unsigned long recoveries;      /* checkpoints restored */
+    unsigned long rename_stalls[OOO_NUM_STALLS];
+} ooo_stats;
+
+/*
+ * Out-of-order back end behind the shared front end. Fetch delivers up to
+ * width instructions a cycle into the fetch queue; rename maps them onto
+ * physical registers and places them in the reorder buffer and issue queue;
+ * the oldest ready ones issue, up to width, and write their results
+ * ready_cycle later, waking their consumers; commit retires the oldest
+ * completed ones in program order to the architectural state. Branches
+ * resolve when they complete, a misprediction restores the rename map saved
+ * at the branch and squashes everything younger.
+ */
+typedef struct APEX_OOO
+{
+    int width;
+    int rob_size;
+    int iq_size;
+    int phys_regs;
+    int num_checkpoints;
+
+    int rat[OOO_ARCH_REGS];        /* speculative rename map */
+    int *prf;                      /* physical register values */
+    unsigned char *prf_ready;
+    int *free_list;                /* circular, phys_regs entries */
+    int free_head;
+    int free_count;
+
+    rob_entry *rob;                /* circular, rob_size entries */
+    int rob_head;
+    int rob_count;
+    int iq_count;
+    ooo_checkpoint *checkpoints;
+
+    ooo_fetched fetch_queue[OOO_FETCH_QUEUE_SIZE];
+    int fq_head;
+    int fq_count;
+
+    ooo_stats stats;
+} APEX_OOO;
+
+int ooo_init(APEX_OOO *ooo, int width, int rob_size, int iq_size, int phys_regs,
+             int num_checkpoints);
+void ooo_free(APEX_OOO *ooo);
+int ooo_busy(const APEX_OOO *ooo);
+const char *ooo_stall_name(int cause);
+int ooo_save(const APEX_OOO *ooo, FILE *fp);
+int ooo_load(APEX_OOO *ooo, FILE *fp);
+void APEX_ooo_resume(APEX_CPU *cpu);
+int APEX_ooo_cycle(APEX_CPU *cpu);
+#endif
@@ -0,0 +1,192 @@
+/*
+ * apex_opcodes.c
+ * Contains APEX opcode mnemonics and operand classes
+ *
+ * Author:
+ * Copyright (c) 2020, Gaurav Kothari (gkothar1@binghamton.edu)
+ * State University of New York at Binghamton
+ */
+#include <string.h>
+
+#include "apex_macros.h"
+#include "apex_opcodes.h"
+
+typedef struct opcode_info
+{
+    const char *name;
+    int flags;
+} opcode_info;
+
+/* Indexed by the numeric OPCODE_* value, only used for display and decode */
+static const opcode_info opcode_table[NUM_OPCODES] = {
+    [OPCODE_NOP] = {"NOP", 0},
+    [OPCODE_ADD] = {"ADD", INSN_READS_RS1 | INSN_READS_RS2 | INSN_WRITES_RD},
+    [OPCODE_SUB] = {"SUB", INSN_READS_RS1 | INSN_READS_RS2 | INSN_WRITES_RD},
+    [OPCODE_MUL] = {"MUL", INSN_READS_RS1 | INSN_READS_RS2 | INSN_WRITES_RD},
+    [OPCODE_DIV] = {"DIV", 0},   /* parsed, but no stage implements it */
+    [OPCODE_AND] = {"AND", INSN_READS_RS1 | INSN_READS_RS2 | INSN_WRITES_RD},
+    [OPCODE_OR] = {"OR", INSN_READS_RS1 | INSN_READS_RS2 | INSN_WRITES_RD},
+    [OPCODE_XOR] = {"EXOR", INSN_READS_RS1 | INSN_READS_RS2 | INSN_WRITES_RD},
+    [OPCODE_MOVC] = {"MOVC", INSN_WRITES_RD},
+    [OPCODE_LOAD] = {"LOAD", INSN_READS_RS1 | INSN_WRITES_RD | INSN_MEMORY},
+    [OPCODE_STORE] = {"STORE", INSN_READS_RS1 | INSN_READS_RS2 | INSN_MEMORY},
+    [OPCODE_BZ] = {"BZ", INSN_BRANCH | INSN_PREDICTED},
+    [OPCODE_BNZ] = {"BNZ", INSN_BRANCH | INSN_PREDICTED},
+    [OPCODE_ADDL] = {"ADDL", INSN_READS_RS1 | INSN_WRITES_RD},
+    [OPCODE_SUBL] = {"SUBL", INSN_READS_RS1 | INSN_WRITES_RD},
+    [OPCODE_LOADP] = {"LOADP", INSN_READS_RS1 | INSN_WRITES_RD | INSN_WRITES_RS1 | INSN_MEMORY},
+    [OPCODE_STOREP] = {"STOREP", INSN_READS_RS1 | INSN_READS_RS2 | INSN_WRITES_RS2 | INSN_MEMORY},
+    [OPCODE_CML] = {"CML", INSN_READS_RS1},
+    [OPCODE_CMP] = {"CMP", INSN_READS_RS1 | INSN_READS_RS2},
+    [OPCODE_BP] = {"BP", INSN_BRANCH | INSN_PREDICTED},
+    [OPCODE_BNP] = {"BNP", INSN_BRANCH | INSN_PREDICTED},
+    [OPCODE_BN] = {"BN", INSN_BRANCH},
+    [OPCODE_BNN] = {"BNN", INSN_BRANCH},
+    [OPCODE_JUMP] = {"JUMP", INSN_READS_RS1 | INSN_BRANCH},
+    [OPCODE_JALR] = {"JALR", INSN_READS_RS1 | INSN_WRITES_RD | INSN_BRANCH},
+    [OPCODE_HALT] = {"HALT", 0},
+};
+
+/* Returns the mnemonic printed for opcode */
+const char *
+get_opcode_name(int opcode)
+{
+    if (opcode < 0 || opcode >= NUM_OPCODES || !opcode_table[opcode].name)
+    {
+        return "???";
+    }
+    return opcode_table[opcode].name;
+}
+
+/*
+ * Maps a mnemonic of len characters (not necessarily NUL terminated) to its
+ * opcode. The switch on length and one or two characters picks the only
+ * possible candidate, so a lookup costs a single compare.
+ *
+ * Returns the OPCODE_* value, or -1 if name is not a mnemonic
+ */
+int
+get_opcode_from_name(const char *name, int len)
+{
+    const char *candidate;
+    int opcode = -1;
+
+    switch (len)
+    {
+        case 2:
+            switch (name[0] == 'B' ? name[1] : name[0])
+            {
+                case 'O':
+                    opcode = OPCODE_OR;
+                    break;
+                case 'Z':
+                    opcode = OPCODE_BZ;
+                    break;
+                case 'P':
+                    opcode = OPCODE_BP;
+                    break;
+                case 'N':
+                    opcode = OPCODE_BN;
+                    break;
+            }
+            break;
+        case 3:
+            switch (name[0])
+            {
+                case 'A':
+                    opcode = name[1] == 'D' ? OPCODE_ADD : OPCODE_AND;
+                    break;
+                case 'S':
+                    opcode = OPCODE_SUB;
+                    break;
+                case 'M':
+                    opcode = OPCODE_MUL;
+                    break;
+                case 'D':
+                    opcode = OPCODE_DIV;
+                    break;
+                case 'N':
+                    opcode = OPCODE_NOP;
+                    break;
+                case 'B':
+                    opcode = name[2] == 'Z' ? OPCODE_BNZ
+                             : name[2] == 'P' ? OPCODE_BNP : OPCODE_BNN;
+                    break;
+                case 'C':
+                    opcode = name[2] == 'L' ? OPCODE_CML : OPCODE_CMP;
+                    break;
+            }
+            break;
+        case 4:
+            switch (name[0])
+            {
+                case 'E':
+                    opcode = OPCODE_XOR;
+                    break;
+                case 'M':
+                    opcode = OPCODE_MOVC;
+                    break;
+                case 'L':
+                    opcode = OPCODE_LOAD;
+                    break;
+                case 'A':
+                    opcode = OPCODE_ADDL;
+                    break;
+                case 'S':
+                    opcode = OPCODE_SUBL;
+                    break;
+                case 'H':
+                    opcode = OPCODE_HALT;
+                    break;
+                case 'J':
+                    opcode = name[1] == 'U' ? OPCODE_JUMP : OPCODE_JALR;
+                    break;
+            }
+            break;
+        case 5:
+            switch (name[0])
+            {
+                case 'S':
+                    opcode = OPCODE_STORE;
+                    break;
+                case 'L':
+                    opcode = OPCODE_LOADP;
+                    break;
+                case 'E':
+                    /* Alternate spelling of EXOR */
+                    return memcmp(name, "EX-OR", 5) == 0 ? OPCODE_XOR : -1;
+            }
+            break;
+        case 6:
+            opcode = OPCODE_STOREP;
+            break;
+    }
+
+    if (opcode < 0)
+    {
+        return -1;
+    }
+    candidate = opcode_table[opcode].name;
+    return memcmp(name, candidate, len) == 0 ? opcode : -1;
+}
+
+/* Returns the INSN_* operand class flags of opcode */
+int
+get_opcode_flags(int opcode)
+{
+    if (opcode < 0 || opcode >= NUM_OPCODES)
+    {
+        return 0;
+    }
+    return opcode_table[opcode].flags;
+}
+
+/*
+ * Returns the static direction hint of a conditional branch. BNZ and BP
+ * usually close loops and are hinted taken, everything else not taken.
+ */
+int
+get_opcode_hint(int opcode)
+{
+    return (opcode == OPCODE_BNZ || opcode == OPCODE_BP) ? TAKEN : NOT_TAKEN;
+}
@@ -0,0 +1,27 @@
+/*
+ * apex_opcodes.h
+ * Contains APEX opcode properties shared by the parser, the pipeline and the
+ * disassembly printers
+ *
+ * Author:
+ * Copyright (c) 2020, Gaurav Kothari (gkothar1@binghamton.edu)
+ * State University of New York at Binghamton
+ */
+#ifndef _APEX_OPCODES_H_
+#define _APEX_OPCODES_H_
+
+/* Operand class flags of a pre-decoded instruction */
+#define INSN_READS_RS1 0x01
+#define INSN_READS_RS2 0x02
+#define INSN_WRITES_RD 0x04
+#define INSN_WRITES_RS1 0x08   /* LOADP address register update */
+#define INSN_WRITES_RS2 0x10   /* STOREP address register update */
+#define INSN_MEMORY 0x20
+#define INSN_BRANCH 0x40       /* Any control transfer */
+#define INSN_PREDICTED 0x80    /* Conditional branch tracked by the BTB */
+
+const char *get_opcode_name(int opcode);
+int get_opcode_from_name(const char *name, int len);
+int get_opcode_flags(int opcode);
+int get_opcode_hint(int opcode);
+#endif
@@ -0,0 +1,739 @@
+/*
+ * apex_predictor.c
+ * Contains APEX branch direction predictor implementations
+ *
+ * Author:
+ * Copyright (c) 2020, Gaurav Kothari (gkothar1@binghamton.edu)
+ * State University of New York at Binghamton
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "apex_macros.h"
+#include "apex_predictor.h"
+
+/* Usefulness counters of TAGE are halved every this many updates */
+#define TAGE_DECAY_PERIOD (1u << 18)
+
+static unsigned int
+mask_of(int bits)
+{
+    return bits >= 32 ? 0xffffffffu : ((1u << bits) - 1);
+}
+
+static uint64_t
+history_mask(int bits)
+{
+    return bits >= 64 ? ~(uint64_t)0 : (((uint64_t)1 << bits) - 1);
+}
+
+static unsigned int
+word_address(int pc)
+{
+    return (unsigned int)pc >> 2;
+}
+
+/* 2 bit saturating counter, 0/1 predict not taken and 2/3 predict taken */
+static void
+counter_update(unsigned char *counter, int outcome)
+{
+    if (outcome == TAKEN && *counter < 3)
+    {
+        (*counter)++;
+    }
+    else if (outcome == NOT_TAKEN && *counter > 0)
+    {
+        (*counter)--;
+    }
+}
+
+static int
+counter_taken(unsigned char counter)
+{
+    return counter >= 2 ? TAKEN : NOT_TAKEN;
+}
+
+/* Folds the youngest len bits of history down to bits bits */
+static unsigned int
+fold_history(uint64_t history, int len, int bits)
+{
+    uint64_t h = history & history_mask(len);
+    unsigned int folded = 0;
+
+    while (h)
+    {
+        folded ^= (unsigned int)(h & mask_of(bits));
+        h >>= bits;
+    }
+    return folded;
+}
+
+/*
+ * Bimodal: one 2 bit counter per branch address
+ */
+static unsigned int
+bimodal_index(const APEX_Predictor *pred, int pc)
+{
+    return word_address(pc) & mask_of(pred->table_bits);
+}
+
+static int
+bimodal_predict(APEX_Predictor *pred, int pc, uint64_t *meta)
+{
+    *meta = 0;
+    return counter_taken(pred->counters[bimodal_index(pred, pc)]);
+}
+
+static void
+bimodal_update(APEX_Predictor *pred, int pc, int outcome, uint64_t meta)
+{
+    (void)meta;
+    counter_update(&pred->counters[bimodal_index(pred, pc)], outcome);
+}
+
+static void
+bimodal_install(APEX_Predictor *pred, int pc, int state)
+{
+    pred->counters[bimodal_index(pred, pc)] = state;
+}
+
+static size_t
+bimodal_storage_bits(const APEX_Predictor *pred)
+{
+    return (size_t)2 << pred->table_bits;
+}
+
+/*
+ * Gshare: counters indexed by branch address XOR global history
+ */
+static unsigned int
+gshare_index(const APEX_Predictor *pred, int pc, uint64_t history)
+{
+    return (word_address(pc)
+            ^ fold_history(history, pred->history_bits, pred->table_bits))
+           & mask_of(pred->table_bits);
+}
+
+static int
+gshare_predict(APEX_Predictor *pred, int pc, uint64_t *meta)
+{
+    *meta = pred->ghr;
+    return counter_taken(pred->counters[gshare_index(pred, pc, pred->ghr)]);
+}
+
+static void
+gshare_update(APEX_Predictor *pred, int pc, int outcome, uint64_t meta)
+{
+    counter_update(&pred->counters[gshare_index(pred, pc, meta)], outcome);
+}
+
+static size_t
+gshare_storage_bits(const APEX_Predictor *pred)
+{
+    return ((size_t)2 << pred->table_bits) + pred->history_bits;
+}
+
+/*
+ * Two-level local: a per-address history table selecting a counter in a
+ * single pattern table (PAg) or in one of several per-address tables (PAp)
+ */
+static unsigned int
+local_pattern_index(const APEX_Predictor *pred, int pc, unsigned int history)
+{
+    unsigned int index = history & mask_of(pred->history_bits);
+
+    if (pred->kind == PREDICTOR_LOCAL_PAP)
+    {
+        index |= (word_address(pc) & mask_of(PAP_ADDRESS_BITS))
+                 << pred->history_bits;
+    }
+    return index;
+}
+
+static int
+local_predict(APEX_Predictor *pred, int pc, uint64_t *meta)
+{
+    unsigned int history = pred->local_history[bimodal_index(pred, pc)];
+
+    *meta = history;
+    return counter_taken(pred->counters[local_pattern_index(pred, pc, history)]);
+}
+
+static void
+local_update(APEX_Predictor *pred, int pc, int outcome, uint64_t meta)
+{
+    unsigned int *history = &pred->local_history[bimodal_index(pred, pc)];
+
+    counter_update(&pred->counters[local_pattern_index(pred, pc, (unsigned int)meta)],
+                   outcome);
+    *history = ((*history << 1) | (outcome == TAKEN)) & mask_of(pred->history_bits);
+}
+
+static size_t
+local_storage_bits(const APEX_Predictor *pred)
+{
+    int pattern_bits = pred->history_bits;
+
+    if (pred->kind == PREDICTOR_LOCAL_PAP)
+    {
+        pattern_bits += PAP_ADDRESS_BITS;
+    }
+    return ((size_t)pred->history_bits << pred->table_bits)
+           + ((size_t)2 << pattern_bits);
+}
+
+/*
+ * Tournament: bimodal and gshare components with a per-address chooser
+ */
+static int
+tournament_predict(APEX_Predictor *pred, int pc, uint64_t *meta)
+{
+    unsigned int index = bimodal_index(pred, pc);
+
+    *meta = pred->ghr;
+    if (pred->chooser[index] >= 2)
+    {
+        return counter_taken(pred->counters2[gshare_index(pred, pc, pred->ghr)]);
+    }
+    return counter_taken(pred->counters[index]);
+}
+
+static void
+tournament_update(APEX_Predictor *pred, int pc, int outcome, uint64_t meta)
+{
+    unsigned int index = bimodal_index(pred, pc);
+    unsigned char *local = &pred->counters[index];
+    unsigned char *global = &pred->counters2[gshare_index(pred, pc, meta)];
+    int local_correct = counter_taken(*local) == outcome;
+    int global_correct = counter_taken(*global) == outcome;
+
+    /* Train the chooser towards whichever component was right */
+    if (local_correct != global_correct)
+    {
+        counter_update(&pred->chooser[index], global_correct ? TAKEN : NOT_TAKEN);
+    }
+    counter_update(local, outcome);
+    counter_update(global, outcome);
+}
+
+static size_t
+tournament_storage_bits(const APEX_Predictor *pred)
+{
+    return ((size_t)6 << pred->table_bits) + pred->history_bits;
+}
+
+/*
+ * TAGE-lite: a bimodal base predictor backed by tagged tables indexed with
+ * geometrically increasing global history lengths
+ */
+static unsigned int
+tage_index(const APEX_Predictor *pred, int table, int pc, uint64_t history)
+{
+    unsigned int addr = word_address(pc);
+
+    return (addr ^ (addr >> pred->tage_bits)
+            ^ fold_history(history, pred->tage_history[table], pred->tage_bits)
+            ^ (unsigned int)table)
+           & mask_of(pred->tage_bits);
+}
+
+/* Tags are stored off by one so that a cleared entry never matches */
+static unsigned short
+tage_tag(const APEX_Predictor *pred, int table, int pc, uint64_t history)
+{
+    int len = pred->tage_history[table];
+
+    return (unsigned short)(((word_address(pc)
+                              ^ fold_history(history, len, TAGE_TAG_BITS)
+                              ^ (fold_history(history, len, TAGE_TAG_BITS - 1) << 1))
+                             & mask_of(TAGE_TAG_BITS)) + 1);
+}
+
+/* Finds the longest (provider) and next longest (alternate) matching tables */
+static void
+tage_lookup(const APEX_Predictor *pred, int pc, uint64_t history,
+            int *provider, int *alternate)
+{
+    int table;
+
+    *provider = -1;
+    *alternate = -1;
+    for (table = TAGE_NUM_TABLES - 1; table >= 0; --table)
+    {
+        const tage_entry *entry
+            = &pred->tage[table][tage_index(pred, table, pc, history)];
+
+        if (entry->tag == tage_tag(pred, table, pc, history))
+        {
+            if (*provider < 0)
+            {
+                *provider = table;
+            }
+            else
+            {
+                *alternate = table;
+                break;
+            }
+        }
+    }
+}
+
+static int
+tage_component_prediction(const APEX_Predictor *pred, int table, int pc,
+                          uint64_t history)
+{
+    if (table < 0)
+    {
+        return counter_taken(pred->counters[bimodal_index(pred, pc)]);
+    }
+    return pred->tage[table][tage_index(pred, table, pc, history)].ctr >= 0
+               ? TAKEN
+               : NOT_TAKEN;
+}
+
+static int
+tage_predict(APEX_Predictor *pred, int pc, uint64_t *meta)
+{
+    int provider, alternate;
+
+    *meta = pred->ghr;
+    tage_lookup(pred, pc, pred->ghr, &provider, &alternate);
+    return tage_component_prediction(pred, provider, pc, pred->ghr);
+}
+
+static void
+tage_update(APEX_Predictor *pred, int pc, int outcome, uint64_t meta)
+{
+    int provider, alternate;
+    int provider_pred, alternate_pred;
+    int table;
+
+    tage_lookup(pred, pc, meta, &provider, &alternate);
+    provider_pred = tage_component_prediction(pred, provider, pc, meta);
+    alternate_pred = tage_component_prediction(pred, alternate, pc, meta);
+
+    if (provider < 0)
+    {
+        counter_update(&pred->counters[bimodal_index(pred, pc)], outcome);
+    }
+    else
+    {
+        tage_entry *entry = &pred->tage[provider][tage_index(pred, provider, pc, meta)];
+
+        if (outcome == TAKEN && entry->ctr < 3)
+        {
+            entry->ctr++;
+        }
+        else if (outcome == NOT_TAKEN && entry->ctr > -4)
+        {
+            entry->ctr--;
+        }
+        if (provider_pred != alternate_pred)
+        {
+            if (provider_pred == outcome && entry->useful < 3)
+            {
+                entry->useful++;
+            }
+            else if (provider_pred != outcome && entry->useful > 0)
+            {
+                entry->useful--;
+            }
+        }
+    }
+
+    /* On a misprediction claim an entry in a longer history table */
+    if (provider_pred != outcome && provider < TAGE_NUM_TABLES - 1)
+    {
+        int allocated = FALSE;
+
+        for (table = provider + 1; table < TAGE_NUM_TABLES; ++table)
+        {
+            tage_entry *entry = &pred->tage[table][tage_index(pred, table, pc, meta)];
+
+            if (entry->useful == 0)
+            {
+                entry->tag = tage_tag(pred, table, pc, meta);
+                entry->ctr = outcome == TAKEN ? 0 : -1;
+                allocated = TRUE;
+                break;
+            }
+        }
+        if (!allocated)
+        {
+            for (table = provider + 1; table < TAGE_NUM_TABLES; ++table)
+            {
+                pred->tage[table][tage_index(pred, table, pc, meta)].useful--;
+            }
+        }
+    }
+
+    if (++pred->tage_clock % TAGE_DECAY_PERIOD == 0)
+    {
+        for (table = 0; table < TAGE_NUM_TABLES; ++table)
+        {
+            unsigned int i;
+
+            for (i = 0; i < (1u << pred->tage_bits); ++i)
+            {
+                pred->tage[table][i].useful >>= 1;
+            }
+        }
+    }
+}
+
+static size_t
+tage_storage_bits(const APEX_Predictor *pred)
+{
+    return ((size_t)2 << pred->table_bits)
+           + (size_t)TAGE_NUM_TABLES * ((size_t)(3 + TAGE_TAG_BITS + 2) << pred->tage_bits)
+           + pred->tage_history[TAGE_NUM_TABLES - 1];
+}
+
+static void
+tage_reset(APEX_Predictor *pred)
+{
+    int table;
+    unsigned int i;
+
+    for (table = 0; table < TAGE_NUM_TABLES; ++table)
+    {
+        for (i = 0; i < (1u << pred->tage_bits); ++i)
+        {
+            pred->tage[table][i].ctr = 0;
+            pred->tage[table][i].useful = 0;
+            pred->tage[table][i].tag = 0;
+        }
+    }
+    pred->tage_clock = 0;
+}
+
+static void
+generic_reset(APEX_Predictor *pred)
+{
+    (void)pred;
+}
+
+static const predictor_ops predictor_table[PREDICTOR_NUM_KINDS] = {
+    [PREDICTOR_BIMODAL] = {"bimodal", bimodal_predict, bimodal_update,
+                           bimodal_install, generic_reset, bimodal_storage_bits},
+    [PREDICTOR_GSHARE] = {"gshare", gshare_predict, gshare_update,
+                          NULL, generic_reset, gshare_storage_bits},
+    [PREDICTOR_LOCAL_PAG] = {"pag", local_predict, local_update,
+                             NULL, generic_reset, local_storage_bits},
+    [PREDICTOR_LOCAL_PAP] = {"pap", local_predict, local_update,
+                             NULL, generic_reset, local_storage_bits},
+    [PREDICTOR_TOURNAMENT] = {"tournament", tournament_predict, tournament_update,
+                              bimodal_install, generic_reset, tournament_storage_bits},
+    [PREDICTOR_TAGE] = {"tage", tage_predict, tage_update,
+                        bimodal_install, tage_reset, tage_storage_bits},
+};
+
+/*
+ * Creates a direction predictor. table_bits is log2 of the number of entries
+ * in the main counter table, history_bits the global or local history length.
+ *
+ * Returns 0 on success, -1 on bad parameters or allocation failure
+ */
+int
+predictor_init(APEX_Predictor *pred, int kind, int table_bits, int history_bits)
+{
+    size_t pattern_entries;
+    int table;
+
+    memset(pred, 0, sizeof(APEX_Predictor));
+    if (kind < 0 || kind >= PREDICTOR_NUM_KINDS || table_bits < 1
+        || table_bits > 24 || history_bits < 1 || history_bits > 64)
+    {
+        return -1;
+    }
+    if ((kind == PREDICTOR_LOCAL_PAG || kind == PREDICTOR_LOCAL_PAP)
+        && history_bits > 20)
+    {
+        return -1;
+    }
+
+    pred->ops = &predictor_table[kind];
+    pred->kind = kind;
+    pred->table_bits = table_bits;
+    pred->history_bits = history_bits;
+
+    switch (kind)
+    {
+        case PREDICTOR_LOCAL_PAG:
+        case PREDICTOR_LOCAL_PAP:
+        {
+            pattern_entries = (size_t)1 << history_bits;
+            if (kind == PREDICTOR_LOCAL_PAP)
+            {
+                pattern_entries <<= PAP_ADDRESS_BITS;
+            }
+            pred->counters = calloc(pattern_entries, 1);
+            pred->local_history = calloc((size_t)1 << table_bits, sizeof(unsigned int));
+            if (!pred->counters || !pred->local_history)
+            {
+                predictor_free(pred);
+                return -1;
+            }
+            break;
+        }
+        case PREDICTOR_TOURNAMENT:
+        {
+            pred->counters = calloc((size_t)1 << table_bits, 1);
+            pred->counters2 = calloc((size_t)1 << table_bits, 1);
+            pred->chooser = calloc((size_t)1 << table_bits, 1);
+            if (!pred->counters || !pred->counters2 || !pred->chooser)
+            {
+                predictor_free(pred);
+                return -1;
+            }
+            break;
+        }
+        case PREDICTOR_TAGE:
+        {
+            pred->counters = calloc((size_t)1 << table_bits, 1);
+            pred->tage_bits = table_bits > 6 ? table_bits - 2 : 4;
+            for (table = 0; table < TAGE_NUM_TABLES; ++table)
+            {
+                int len = (history_bits << table) >> (TAGE_NUM_TABLES - 1);
+
+                pred->tage_history[table] = len > 0 ? len : 1;
+                pred->tage[table] = calloc((size_t)1 << pred->tage_bits, sizeof(tage_entry));
+                if (!pred->tage[table])
+                {
+                    predictor_free(pred);
+                    return -1;
+                }
+            }
+            if (!pred->counters)
+            {
+                predictor_free(pred);
+                return -1;
+            }
+            break;
+        }
+        default:
+        {
+            pred->counters = calloc((size_t)1 << table_bits, 1);
+            if (!pred->counters)
+            {
+                predictor_free(pred);
+                return -1;
+            }
+            break;
+        }
+    }
+
+    predictor_reset(pred);
+    return 0;
+}
+
+void
+predictor_free(APEX_Predictor *pred)
+{
+    int table;
+
+    free(pred->counters);
+    free(pred->counters2);
+    free(pred->chooser);
+    free(pred->local_history);
+    for (table = 0; table < TAGE_NUM_TABLES; ++table)
+    {
+        free(pred->tage[table]);
+        pred->tage[table] = NULL;
+    }
+    pred->counters = NULL;
+    pred->counters2 = NULL;
+    pred->chooser = NULL;
+    pred->local_history = NULL;
+}
+
+int
+predictor_predict(APEX_Predictor *pred, int pc, uint64_t *meta)
+{
+    return pred->ops->predict(pred, pc, meta);
+}
+
+/* Trains the predictor with a resolved outcome and shifts it into the history */
+void
+predictor_update(APEX_Predictor *pred, int pc, int outcome, uint64_t meta)
+{
+    pred->ops->update(pred, pc, outcome, meta);
+    pred->ghr = (pred->ghr << 1) | (outcome == TAKEN);
+}
+
+/*
+ * Seeds the per-branch 2 bit counter of a newly allocated BTB entry with
+ * state (0 strongly not taken .. 3 strongly taken). Predictors without
+ * per-address counters ignore it.
+ */
+void
+predictor_install(APEX_Predictor *pred, int pc, int state)
+{
+    if (pred->ops->install)
+    {
+        pred->ops->install(pred, pc, state);
+    }
+}
+
+/*
+ * Picks the counter state a new branch is installed with. counter_init is a
+ * fixed state 0..3, or COUNTER_INIT_BY_OPCODE to start branches with a taken
+ * hint (BNZ, BP) strongly taken and the others strongly not taken.
+ */
+int
+predictor_seed_state(int counter_init, int hint)
+{
+    if (counter_init >= 0)
+    {
+        return counter_init;
+    }
+    return hint == TAKEN ? 3 : 0;
+}
+
+/* Number of entries in counters (and counters2, chooser when present) */
+static size_t
+counter_entries(const APEX_Predictor *pred)
+{
+    size_t entries = (size_t)1 << pred->table_bits;
+
+    if (pred->kind == PREDICTOR_LOCAL_PAG || pred->kind == PREDICTOR_LOCAL_PAP)
+    {
+        entries = (size_t)1 << pred->history_bits;
+        if (pred->kind == PREDICTOR_LOCAL_PAP)
+        {
+            entries <<= PAP_ADDRESS_BITS;
+        }
+    }
+    return entries;
+}
+
+/* Clears all tables and history, counters restart at strongly not taken */
+void
+predictor_reset(APEX_Predictor *pred)
+{
+    size_t entries = counter_entries(pred);
+
+    if (pred->local_history)
+    {
+        memset(pred->local_history, 0, sizeof(unsigned int) << pred->table_bits);
+    }
+    memset(pred->counters, 0, entries);
+    if (pred->counters2)
+    {
+        memset(pred->counters2, 0, entries);
+    }
+    if (pred->chooser)
+    {
+        /* Start weakly preferring the bimodal side */
+        memset(pred->chooser, 1, entries);
+    }
+    pred->ghr = 0;
+    pred->ops->reset(pred);
+}
+
+static int
+transfer_block(void *ptr, size_t size, FILE *fp, int save)
+{
+    size_t done = save ? fwrite(ptr, size, 1, fp) : fread(ptr, size, 1, fp);
+
+    return done == 1 ? 0 : -1;
+}
+
+/*
+ * Reads or writes, depending on save, the configuration followed by every
+ * table of pred. On load the configuration read back must match pred's.
+ *
+ * Returns 0 on success, -1 on an I/O error or a configuration mismatch
+ */
+static int
+predictor_transfer(APEX_Predictor *pred, FILE *fp, int save)
+{
+    int config[3] = {pred->kind, pred->table_bits, pred->history_bits};
+    int stored[3];
+    size_t entries = counter_entries(pred);
+    int ret = 0;
+    int table;
+
+    memcpy(stored, config, sizeof(config));
+    if (transfer_block(stored, sizeof(stored), fp, save) != 0
+        || memcmp(stored, config, sizeof(config)) != 0)
+    {
+        return -1;
+    }
+
+    ret |= transfer_block(&pred->ghr, sizeof(pred->ghr), fp, save);
+    ret |= transfer_block(&pred->tage_clock, sizeof(pred->tage_clock), fp, save);
+    ret |= transfer_block(pred->counters, entries, fp, save);
+    if (pred->counters2)
+    {
+        ret |= transfer_block(pred->counters2, entries, fp, save);
+    }
+    if (pred->chooser)
+    {
+        ret |= transfer_block(pred->chooser, entries, fp, save);
+    }
+    if (pred->local_history)
+    {
+        ret |= transfer_block(pred->local_history,
+                              sizeof(unsigned int) << pred->table_bits, fp, save);
+    }
+    for (table = 0; table < TAGE_NUM_TABLES; ++table)
+    {
+        if (pred->tage[table])
+        {
+            ret |= transfer_block(pred->tage[table],
+                                  sizeof(tage_entry) << pred->tage_bits, fp, save);
+        }
+    }
+    return ret;
+}
+
+/* Writes the predictor configuration and tables to fp */
+int
+predictor_save(const APEX_Predictor *pred, FILE *fp)
+{
+    return predictor_transfer((APEX_Predictor *)pred, fp, TRUE);
+}
+
+/*
+ * Reads back tables written by predictor_save into a predictor created with
+ * the same kind and sizes
+ */
+int
+predictor_load(APEX_Predictor *pred, FILE *fp)
+{
+    return predictor_transfer(pred, fp, FALSE);
+}
+
+size_t
+predictor_storage_bytes(const APEX_Predictor *pred)
+{
+    return (pred->ops->storage_bits(pred) + 7) / 8;
+}
+
+/* Returns the PREDICTOR_* value for name, or -1 if it is not recognised */
+int
+predictor_kind_from_string(const char *name)
+{
+    int kind;
+
+    for (kind = 0; kind < PREDICTOR_NUM_KINDS; ++kind)
+    {
+        if (strcmp(name, predictor_table[kind].name) == 0)
+        {
+            return kind;
+        }
+    }
+    return -1;
+}
+
+const char *
+predictor_name(int kind)
+{
+    if (kind < 0 || kind >= PREDICTOR_NUM_KINDS)
+    {
+        return "unknown";
+    }
+    return predictor_table[kind].name;
+}
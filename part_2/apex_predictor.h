@@ -0,0 +1,88 @@
+/*
+ * apex_predictor.h
+ * Contains APEX branch direction predictor declarations
+ *
+ * Author:
+ * Copyright (c) 2020, Gaurav Kothari (gkothar1@binghamton.edu)
+ * State University of New York at Binghamton
+ */
+#ifndef _APEX_PREDICTOR_H_
+#define _APEX_PREDICTOR_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/* Direction predictor kinds */
+#define PREDICTOR_BIMODAL 0
+#define PREDICTOR_GSHARE 1
+#define PREDICTOR_LOCAL_PAG 2
+#define PREDICTOR_LOCAL_PAP 3
+#define PREDICTOR_TOURNAMENT 4
+#define PREDICTOR_TAGE 5
+#define PREDICTOR_NUM_KINDS 6
+
+/* TAGE-lite geometry */
+#define TAGE_NUM_TABLES 4
+#define TAGE_TAG_BITS 8
+
+/* Seed new counters from the opcode's static hint rather than a fixed state */
+#define COUNTER_INIT_BY_OPCODE (-1)
+
+/* Number of address bits selecting a pattern table in PAp */
+#define PAP_ADDRESS_BITS 4
+
+typedef struct APEX_Predictor APEX_Predictor;
+
+/*
+ * Operations every direction predictor implements. predict returns TAKEN or
+ * NOT_TAKEN and fills meta with whatever the predictor needs to train the same
+ * entries later; update receives that meta back once the branch resolves.
+ */
+typedef struct predictor_ops
+{
+    const char *name;
+    int (*predict)(APEX_Predictor *pred, int pc, uint64_t *meta);
+    void (*update)(APEX_Predictor *pred, int pc, int outcome, uint64_t meta);
+    void (*install)(APEX_Predictor *pred, int pc, int state);
+    void (*reset)(APEX_Predictor *pred);
+    size_t (*storage_bits)(const APEX_Predictor *pred);
+} predictor_ops;
+
+typedef struct tage_entry
+{
+    signed char ctr;       /* 3 bit signed counter, >= 0 predicts taken */
+    unsigned short tag;    /* 0 marks an empty entry */
+    unsigned char useful;  /* 2 bit usefulness counter */
+} tage_entry;
+
+struct APEX_Predictor
+{
+    const predictor_ops *ops;
+    int kind;
+    int table_bits;                /* log2 of the main counter table size */
+    int history_bits;              /* global or local history length */
+    uint64_t ghr;                  /* global history, updated at resolve */
+    unsigned char *counters;       /* 2 bit counters: bimodal, gshare, PHT, TAGE base */
+    unsigned char *counters2;      /* tournament: gshare side */
+    unsigned char *chooser;        /* tournament: 2 bit selector, >= 2 picks gshare */
+    unsigned int *local_history;   /* PAg / PAp branch history table */
+    tage_entry *tage[TAGE_NUM_TABLES];
+    int tage_bits;                 /* log2 entries per tagged table */
+    int tage_history[TAGE_NUM_TABLES];
+    unsigned int tage_clock;       /* drives periodic usefulness decay */
+};
+
+int predictor_init(APEX_Predictor *pred, int kind, int table_bits, int history_bits);
+void predictor_free(APEX_Predictor *pred);
+int predictor_predict(APEX_Predictor *pred, int pc, uint64_t *meta);
+void predictor_update(APEX_Predictor *pred, int pc, int outcome, uint64_t meta);
+void predictor_install(APEX_Predictor *pred, int pc, int state);
+int predictor_seed_state(int counter_init, int hint);
+void predictor_reset(APEX_Predictor *pred);
+int predictor_save(const APEX_Predictor *pred, FILE *fp);
+int predictor_load(APEX_Predictor *pred, FILE *fp);
+size_t predictor_storage_bytes(const APEX_Predictor *pred);
+int predictor_kind_from_string(const char *name);
+const char *predictor_name(int kind);
+#endif
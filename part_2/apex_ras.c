@@ -0,0 +1,159 @@
+/*
+ * apex_ras.c
+ * Contains APEX return address stack implementation
+ *
+ * Author:
+ * Copyright (c) 2020, Gaurav Kothari (gkothar1@binghamton.edu)
+ * State University of New York at Binghamton
+ */
+#include <stdlib.h>
+#include <string.h>
+
+#include "apex_ras.h"
+#include "apex_macros.h"
+
+/*
+ * Creates an empty stack of depth entries, depth 0 gives a stack that never
+ * predicts
+ *
+ * Returns 0 on success, -1 on a bad depth or allocation failure
+ */
+int
+ras_init(APEX_RAS *ras, int depth)
+{
+    memset(ras, 0, sizeof(APEX_RAS));
+
+    if (depth < 0 || depth > RAS_MAX_DEPTH)
+    {
+        return -1;
+    }
+    ras->depth = depth;
+    ras->entries = calloc(depth > 0 ? depth : 1, sizeof(ras_entry));
+    if (!ras->entries)
+    {
+        return -1;
+    }
+    return 0;
+}
+
+void
+ras_free(APEX_RAS *ras)
+{
+    free(ras->entries);
+    ras->entries = NULL;
+}
+
+/* Empties the stack, keeping its depth */
+void
+ras_reset(APEX_RAS *ras)
+{
+    ras->top = 0;
+    ras->count = 0;
+    ras->link_regs = 0;
+}
+
+/* Makes dst, of the same depth, hold the entries of src */
+void
+ras_copy(APEX_RAS *dst, const APEX_RAS *src)
+{
+    dst->top = src->top;
+    dst->count = src->count;
+    dst->link_regs = src->link_regs;
+    memcpy(dst->entries, src->entries, sizeof(ras_entry) * src->depth);
+}
+
+/*
+ * Pushes the return address of a call that linked through register link
+ *
+ * Returns TRUE if the stack was full and its oldest entry was dropped
+ */
+int
+ras_push(APEX_RAS *ras, int address, int link)
+{
+    int overflow;
+
+    if (ras->depth == 0)
+    {
+        return FALSE;
+    }
+    ras->entries[ras->top].address = address;
+    ras->entries[ras->top].link = link;
+    ras->top = (ras->top + 1) % ras->depth;
+    ras->link_regs |= 1u << link;
+
+    overflow = ras->count == ras->depth;
+    if (!overflow)
+    {
+        ras->count++;
+    }
+    return overflow;
+}
+
+/* A JUMP through reg is a return if some call has linked through reg */
+int
+ras_is_return(const APEX_RAS *ras, int reg)
+{
+    return ras->depth > 0 && (ras->link_regs & (1u << reg)) != 0;
+}
+
+/* Returns the most recent call, or NULL if the stack is empty */
+const ras_entry *
+ras_top(const APEX_RAS *ras)
+{
+    if (ras->count == 0)
+    {
+        return NULL;
+    }
+    return &ras->entries[(ras->top + ras->depth - 1) % ras->depth];
+}
+
+/* Drops the most recent call, if there is one */
+void
+ras_pop(APEX_RAS *ras)
+{
+    if (ras->count > 0)
+    {
+        ras->top = (ras->top + ras->depth - 1) % ras->depth;
+        ras->count--;
+    }
+}
+
+/*
+ * Writes the depth and entries to fp
+ *
+ * Returns 0 on success, -1 on a write error
+ */
+int
+ras_save(const APEX_RAS *ras, FILE *fp)
+{
+    int state[3] = {ras->depth, ras->top, ras->count};
+
+    if (fwrite(state, sizeof(state), 1, fp) != 1
+        || fwrite(&ras->link_regs, sizeof(ras->link_regs), 1, fp) != 1
+        || fwrite(ras->entries, sizeof(ras_entry), ras->depth, fp) != (size_t)ras->depth)
+    {
+        return -1;
+    }
+    return 0;
+}
+
+/*
+ * Reads back a stack written by ras_save into one of the same depth
+ *
+ * Returns 0 on success, -1 on a read error or a depth mismatch
+ */
+int
+ras_load(APEX_RAS *ras, FILE *fp)
+{
+    int state[3];
+
+    if (fread(state, sizeof(state), 1, fp) != 1 || state[0] != ras->depth
+        || fread(&ras->link_regs, sizeof(ras->link_regs), 1, fp) != 1
+        || fread(ras->entries, sizeof(ras_entry), ras->depth, fp) != (size_t)ras->depth)
+    {
+        return -1;
+    }
+    ras->top = state[1];
+    ras->count = state[2];
+    return 0;
+}
@@ -0,0 +1,45 @@
+/*
+ * apex_ras.h
+ * Contains APEX return address stack declarations
+ *
+ * Author:
+ * Copyright (c) 2020, Gaurav Kothari (gkothar1@binghamton.edu)
+ * State University of New York at Binghamton
+ */
+#ifndef _APEX_RAS_H_
+#define _APEX_RAS_H_
+
+#include <stdio.h>
+
+/* Return address pushed by a JALR */
+typedef struct ras_entry
+{
+    int address;         /* pc of the instruction after the call */
+    int link;            /* register the call wrote it to */
+} ras_entry;
+
+/*
+ * Circular stack of the most recent calls. When it is full a push drops the
+ * oldest entry. link_regs has a bit for every register a call has linked
+ * through, so a return can be recognised even with the stack empty.
+ */
+typedef struct APEX_RAS
+{
+    int depth;           /* 0 disables return prediction */
+    int top;             /* slot of the next push */
+    int count;           /* valid entries, at most depth */
+    unsigned int link_regs;
+    ras_entry *entries;
+} APEX_RAS;
+
+int ras_init(APEX_RAS *ras, int depth);
+void ras_free(APEX_RAS *ras);
+void ras_reset(APEX_RAS *ras);
+void ras_copy(APEX_RAS *dst, const APEX_RAS *src);
+int ras_push(APEX_RAS *ras, int address, int link);
+int ras_is_return(const APEX_RAS *ras, int reg);
+const ras_entry *ras_top(const APEX_RAS *ras);
+void ras_pop(APEX_RAS *ras);
+int ras_save(const APEX_RAS *ras, FILE *fp);
+int ras_load(APEX_RAS *ras, FILE *fp);
+#endif
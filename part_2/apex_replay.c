@@ -0,0 +1,314 @@
+/*
+ * apex_replay.c
+ * Drives a BTB and direction predictor straight from a branch trace written
+ * by apex_sim --trace, without modelling the pipeline
+ *
+ * Author:
+ * Copyright (c) 2020, Gaurav Kothari (gkothar1@binghamton.edu)
+ * State University of New York at Binghamton
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "apex_macros.h"
+#include "apex_opcodes.h"
+#include "apex_btb.h"
+#include "apex_predictor.h"
+#include "apex_indirect.h"
+#include "apex_ras.h"
+#include "apex_trace.h"
+
+typedef struct replay_result
+{
+    unsigned long branches;        /* every record in the trace */
+    unsigned long conditional;     /* records of BTB tracked branches */
+    unsigned long btb_hits;
+    unsigned long taken;
+    unsigned long returns;         /* JUMPs the return address stack treated as returns */
+    unsigned long returns_correct;
+    unsigned long mispredictions;  /* conditional, jumps and untracked */
+} replay_result;
+
+/*
+ * Replays one conditional branch the way the pipeline sees it: fetch follows
+ * the BTB target when the entry has a target and the predictor says taken,
+ * decode allocates an entry on a miss and execute trains both structures.
+ *
+ * Returns the direction fetch would have followed
+ */
+static int
+replay_conditional(APEX_BTB *btb, APEX_Predictor *pred, int counter_init,
+                   const trace_record *record, replay_result *result)
+{
+    uint64_t meta = 0;
+    BTB *entry = btb_lookup(btb, record->pc);
+    int taken = predictor_predict(pred, record->pc, &meta);
+    int predicted = NOT_TAKEN;
+
+    if (entry != NULL)
+    {
+        result->btb_hits++;
+        if (taken == TAKEN && entry->num_executed > 0 && entry->target_address != 0)
+        {
+            predicted = TAKEN;
+        }
+    }
+    else
+    {
+        entry = btb_allocate(btb, record->pc);
+        predictor_install(pred, record->pc,
+                          predictor_seed_state(counter_init, get_opcode_hint(record->opcode)));
+    }
+
+    entry->num_executed++;
+    entry->target_address = record->target;
+    predictor_update(pred, record->pc, record->outcome, meta);
+    return predicted;
+}
+
+/*
+ * Replays a JUMP or JALR the way fetch predicts it: a JALR pushes its return
+ * address and a JUMP through a register some JALR linked through returns to
+ * the most recent call; every other jump takes the indirect predictor's
+ * target and trains it, as execute does.
+ *
+ * Returns TAKEN if fetch would have followed the resolved target
+ */
+static int
+replay_jump(APEX_Indirect *ind, APEX_RAS *ras, const trace_record *record,
+            replay_result *result)
+{
+    const ras_entry *top;
+    uint64_t meta = 0;
+    int predicted_target = 0;
+    int followed = indirect_predict(ind, record->pc, &predicted_target, &meta);
+    int is_return = FALSE;
+
+    if (record->opcode == OPCODE_JALR)
+    {
+        ras_push(ras, record->pc + 4, record->rd);
+    }
+    else if (ras_is_return(ras, record->rs1))
+    {
+        top = ras_top(ras);
+        if (top)
+        {
+            followed = TRUE;
+            predicted_target = top->address + record->imm;
+        }
+        ras_pop(ras);
+        is_return = TRUE;
+        result->returns++;
+        if (followed && predicted_target == record->target)
+        {
+            result->returns_correct++;
+        }
+    }
+    if (!is_return)
+    {
+        indirect_update(ind, record->pc, record->target, meta);
+    }
+    return followed && predicted_target == record->target ? TAKEN : NOT_TAKEN;
+}
+
+static void
+replay_trace(APEX_Trace *trace, APEX_BTB *btb, APEX_Predictor *pred, APEX_Indirect *ind,
+             APEX_RAS *ras, int counter_init, replay_result *result)
+{
+    const trace_record *record;
+    int predicted;
+
+    while ((record = trace_read(trace)) != NULL)
+    {
+        result->branches++;
+        if (record->outcome == TAKEN)
+        {
+            result->taken++;
+        }
+
+        /* BN and BNN bypass the BTB and always fall through */
+        predicted = NOT_TAKEN;
+        if (get_opcode_flags(record->opcode) & INSN_PREDICTED)
+        {
+            result->conditional++;
+            predicted = replay_conditional(btb, pred, counter_init, record, result);
+        }
+        else if (record->opcode == OPCODE_JUMP || record->opcode == OPCODE_JALR)
+        {
+            predicted = replay_jump(ind, ras, record, result);
+        }
+        indirect_history(ind, record->outcome, record->target);
+        if (predicted != record->outcome)
+        {
+            result->mispredictions++;
+        }
+    }
+}
+
+static void
+print_usage(const char *prog)
+{
+    fprintf(stderr, "APEX_Help: Usage %s <trace_file> [options]\n", prog);
+    fprintf(stderr, "  Options:\n");
+    fprintf(stderr, "    --btb-sets <n>      Number of BTB sets, power of two (default %d)\n", BTB_DEFAULT_SETS);
+    fprintf(stderr, "    --btb-ways <n>      Entries per BTB set (default %d)\n", BTB_DEFAULT_WAYS);
+    fprintf(stderr, "    --btb-repl <policy> BTB replacement: fifo, lru or plru (default fifo)\n");
+    fprintf(stderr, "    --predictor <name>  Direction predictor: bimodal, gshare, pag, pap, tournament or tage (default bimodal)\n");
+    fprintf(stderr, "    --predictor-bits <n> log2 entries of the predictor table (default %d)\n", PREDICTOR_DEFAULT_BITS);
+    fprintf(stderr, "    --history-bits <n>  Branch history length (default %d)\n", PREDICTOR_DEFAULT_HISTORY);
+    fprintf(stderr, "    --counter-init <s>  Counter state of new branches, 0-3 or opcode (default opcode)\n");
+    fprintf(stderr, "    --indirect-bits <n> log2 entries of the JUMP/JALR target predictor, 0 disables it (default %d)\n", INDIRECT_DEFAULT_BITS);
+    fprintf(stderr, "    --ras-depth <n>     Return address stack entries, 0 disables return prediction (default %d)\n", RAS_DEFAULT_DEPTH);
+}
+
+int
+main(int argc, char const *argv[])
+{
+    APEX_Trace *trace;
+    APEX_BTB btb;
+    APEX_Predictor pred;
+    APEX_Indirect ind;
+    APEX_RAS ras;
+    replay_result result;
+    struct timespec start, end;
+    double seconds;
+    int btb_sets = BTB_DEFAULT_SETS;
+    int btb_ways = BTB_DEFAULT_WAYS;
+    int btb_policy = BTB_REPL_FIFO;
+    int kind = PREDICTOR_BIMODAL;
+    int table_bits = PREDICTOR_DEFAULT_BITS;
+    int history_bits = PREDICTOR_DEFAULT_HISTORY;
+    int counter_init = COUNTER_INIT_BY_OPCODE;
+    int indirect_bits = INDIRECT_DEFAULT_BITS;
+    int ras_depth = RAS_DEFAULT_DEPTH;
+    int i;
+
+    if (argc < 2)
+    {
+        print_usage(argv[0]);
+        exit(1);
+    }
+
+    for (i = 2; i < argc; ++i)
+    {
+        if (strcmp(argv[i], "--btb-sets") == 0 && i + 1 < argc)
+        {
+            btb_sets = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--btb-ways") == 0 && i + 1 < argc)
+        {
+            btb_ways = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--btb-repl") == 0 && i + 1 < argc)
+        {
+            btb_policy = btb_policy_from_string(argv[++i]);
+            if (btb_policy < 0)
+            {
+                fprintf(stderr, "APEX_Error: Unknown BTB replacement policy %s\n", argv[i]);
+                exit(1);
+            }
+        }
+        else if (strcmp(argv[i], "--predictor") == 0 && i + 1 < argc)
+        {
+            kind = predictor_kind_from_string(argv[++i]);
+            if (kind < 0)
+            {
+                fprintf(stderr, "APEX_Error: Unknown branch predictor %s\n", argv[i]);
+                exit(1);
+            }
+        }
+        else if (strcmp(argv[i], "--predictor-bits") == 0 && i + 1 < argc)
+        {
+            table_bits = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--history-bits") == 0 && i + 1 < argc)
+        {
+            history_bits = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--counter-init") == 0 && i + 1 < argc)
+        {
+            ++i;
+            counter_init = strcmp(argv[i], "opcode") == 0
+                           ? COUNTER_INIT_BY_OPCODE : atoi(argv[i]);
+            if (counter_init < COUNTER_INIT_BY_OPCODE || counter_init > 3)
+            {
+                fprintf(stderr, "APEX_Error: Invalid counter initial state %s\n", argv[i]);
+                exit(1);
+            }
+        }
+        else if (strcmp(argv[i], "--indirect-bits") == 0 && i + 1 < argc)
+        {
+            indirect_bits = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--ras-depth") == 0 && i + 1 < argc)
+        {
+            ras_depth = atoi(argv[++i]);
+        }
+        else
+        {
+            print_usage(argv[0]);
+            exit(1);
+        }
+    }
+
+    if (btb_init(&btb, btb_sets, btb_ways, btb_policy) != 0)
+    {
+        fprintf(stderr, "APEX_Error: Invalid BTB geometry %dx%d (%s)\n",
+                btb_sets, btb_ways, btb_policy_name(btb_policy));
+        exit(1);
+    }
+    if (predictor_init(&pred, kind, table_bits, history_bits) != 0)
+    {
+        fprintf(stderr, "APEX_Error: Invalid %s predictor with %d table bits, %d history bits\n",
+                predictor_name(kind), table_bits, history_bits);
+        exit(1);
+    }
+    if (indirect_init(&ind, indirect_bits) != 0)
+    {
+        fprintf(stderr, "APEX_Error: Invalid indirect predictor size of %d bits (0 to %d)\n",
+                indirect_bits, INDIRECT_MAX_BITS);
+        exit(1);
+    }
+    if (ras_init(&ras, ras_depth) != 0)
+    {
+        fprintf(stderr, "APEX_Error: Invalid return address stack depth %d (0 to %d)\n",
+                ras_depth, RAS_MAX_DEPTH);
+        exit(1);
+    }
+
+    trace = malloc(sizeof(APEX_Trace));
+    if (!trace || trace_open_read(trace, argv[1]) != 0)
+    {
+        fprintf(stderr, "APEX_Error: %s is not an APEX branch trace\n", argv[1]);
+        exit(1);
+    }
+
+    memset(&result, 0, sizeof(result));
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    replay_trace(trace, &btb, &pred, &ind, &ras, counter_init, &result);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    seconds = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+
+    printf("APEX_Replay: BTB = %dx%d %s, predictor = %s (%zu bytes)\n",
+           btb.sets, btb.ways, btb_policy_name(btb.policy), pred.ops->name,
+           predictor_storage_bytes(&pred));
+    printf("APEX_Replay: branches = %lu conditional = %lu taken = %lu\n",
+           result.branches, result.conditional, result.taken);
+    printf("APEX_Replay: RAS depth %d, returns = %lu (correct %lu)\n",
+           ras.depth, result.returns, result.returns_correct);
+    printf("APEX_Replay: BTB hits = %lu, mispredictions = %lu, accuracy = %.2f%%\n",
+           result.btb_hits, result.mispredictions,
+           result.branches ? 100.0 * (result.branches - result.mispredictions) / result.branches : 0.0);
+    printf("APEX_Replay: %.3f s, %.1f M branches/s\n", seconds,
+           seconds > 0 ? result.branches / seconds / 1e6 : 0.0);
+
+    trace_close(trace);
+    free(trace);
+    ras_free(&ras);
+    indirect_free(&ind);
+    predictor_free(&pred);
+    btb_free(&btb);
+    return 0;
+}
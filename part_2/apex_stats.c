@@ -0,0 +1,317 @@
+/*
+ * apex_stats.c
+ * Contains APEX branch statistics implementation
+ *
+ * Author:
+ * Copyright (c) 2020, Gaurav Kothari (gkothar1@binghamton.edu)
+ * State University of New York at Binghamton
+ */
+#include <stdlib.h>
+#include <string.h>
+
+#include "apex_stats.h"
+#include "apex_macros.h"
+
+/*
+ * Creates zeroed counters for a program of num_insns instructions
+ *
+ * Returns 0 on success, -1 on allocation failure
+ */
+int
+stats_init(APEX_Stats *stats, int num_insns)
+{
+    memset(stats, 0, sizeof(APEX_Stats));
+
+    stats->branches = calloc(num_insns > 0 ? num_insns : 1, sizeof(branch_stats));
+    stats->stalls = calloc(num_insns > 0 ? num_insns : 1, sizeof(stall_stats));
+    stats->indirect = calloc(num_insns > 0 ? num_insns : 1, sizeof(indirect_stats));
+    if (!stats->branches || !stats->stalls || !stats->indirect)
+    {
+        stats_free(stats);
+        return -1;
+    }
+    stats->num_insns = num_insns;
+    return 0;
+}
+
+void
+stats_free(APEX_Stats *stats)
+{
+    free(stats->branches);
+    free(stats->stalls);
+    free(stats->indirect);
+    stats->branches = NULL;
+    stats->stalls = NULL;
+    stats->indirect = NULL;
+}
+
+void
+stats_reset(APEX_Stats *stats)
+{
+    memset(stats->branches, 0, sizeof(branch_stats) * stats->num_insns);
+    memset(stats->stalls, 0, sizeof(stall_stats) * stats->num_insns);
+    memset(stats->indirect, 0, sizeof(indirect_stats) * stats->num_insns);
+    memset(stats->redirects, 0, sizeof(stats->redirects));
+    memset(stats->redirect_cycles, 0, sizeof(stats->redirect_cycles));
+    memset(stats->stall_cycles, 0, sizeof(stats->stall_cycles));
+    memset(&stats->ras, 0, sizeof(stats->ras));
+    memset(&stats->ftq, 0, sizeof(stats->ftq));
+    stats->mispredictions = 0;
+    stats->flush_cycles = 0;
+}
+
+/*
+ * Returns the counters of the branch at pc, or NULL when pc lies outside code
+ * memory (wrong path fetches can run past the end of the program)
+ */
+branch_stats *
+stats_branch(APEX_Stats *stats, int pc)
+{
+    int index = (pc - CODE_MEMORY_BASE) / 4;
+
+    if (pc < CODE_MEMORY_BASE || index >= stats->num_insns)
+    {
+        return NULL;
+    }
+    return &stats->branches[index];
+}
+
+void
+stats_record_lookup(APEX_Stats *stats, int pc, int hit)
+{
+    branch_stats *branch = stats_branch(stats, pc);
+
+    if (branch)
+    {
+        branch->lookups++;
+        branch->btb_hits += hit ? 1 : 0;
+    }
+}
+
+/*
+ * Records a resolved branch. predicted is the direction the front end
+ * followed, a branch neither fetch nor decode sent to its target counts as
+ * predicted not taken.
+ */
+void
+stats_record_outcome(APEX_Stats *stats, int pc, int predicted, int outcome)
+{
+    branch_stats *branch = stats_branch(stats, pc);
+
+    if (!branch)
+    {
+        return;
+    }
+
+    branch->executed++;
+    if (outcome == TAKEN)
+    {
+        branch->taken++;
+    }
+    if (predicted == TAKEN)
+    {
+        branch->pred_taken++;
+    }
+    else
+    {
+        branch->pred_not_taken++;
+    }
+    if (predicted == outcome)
+    {
+        branch->correct++;
+    }
+    else
+    {
+        branch->incorrect++;
+        stats->mispredictions++;
+    }
+}
+
+/* Charges a redirect by the instruction at pc, for cause, of cycles fetch lost */
+void
+stats_record_flush(APEX_Stats *stats, int pc, int cause, int cycles)
+{
+    branch_stats *branch = stats_branch(stats, pc);
+
+    if (branch)
+    {
+        branch->flush_cycles += cycles;
+    }
+    stats->flush_cycles += cycles;
+    stats->redirects[cause]++;
+    stats->redirect_cycles[cause] += cycles;
+}
+
+/*
+ * Charges one decode stall cycle of the instruction at pc to cause, producer
+ * being the pc of the instruction it waits for (0 if none)
+ */
+void
+stats_record_stall(APEX_Stats *stats, int pc, int cause, int producer)
+{
+    int index = (pc - CODE_MEMORY_BASE) / 4;
+
+    if (pc >= CODE_MEMORY_BASE && index < stats->num_insns)
+    {
+        stats->stalls[index].cycles[cause]++;
+        stats->stalls[index].producer = producer;
+    }
+    stats->stall_cycles[cause]++;
+}
+
+/* Records the target a JUMP or JALR at pc resolved to */
+void
+stats_record_target(APEX_Stats *stats, int pc, int target)
+{
+    int index = (pc - CODE_MEMORY_BASE) / 4;
+    indirect_stats *site;
+    int i;
+
+    if (pc < CODE_MEMORY_BASE || index >= stats->num_insns)
+    {
+        return;
+    }
+    site = &stats->indirect[index];
+
+    if (site->num_targets > 0 && target != site->last_target)
+    {
+        site->changes++;
+    }
+    site->last_target = target;
+
+    for (i = 0; i < site->num_targets; ++i)
+    {
+        if (site->targets[i] == target)
+        {
+            return;
+        }
+    }
+    if (site->num_targets < INDIRECT_SITE_TARGETS)
+    {
+        site->targets[site->num_targets++] = target;
+    }
+    else
+    {
+        site->more_targets = TRUE;
+    }
+}
+
+unsigned long
+stats_stall_total(const stall_stats *stall)
+{
+    unsigned long total = 0;
+    int cause;
+
+    for (cause = 0; cause < STALL_NUM_CAUSES; ++cause)
+    {
+        total += stall->cycles[cause];
+    }
+    return total;
+}
+
+/* Returns the short name printed for a STALL_* cause */
+const char *
+stats_stall_name(int cause)
+{
+    switch (cause)
+    {
+        case STALL_RAW_RS1:
+            return "raw_rs1";
+        case STALL_RAW_RS2:
+            return "raw_rs2";
+        case STALL_LOAD_USE:
+            return "load_use";
+        case STALL_ADDR_UPDATE:
+            return "addr_upd";
+        default:
+            return "struct";
+    }
+}
+
+/* Returns the short name printed for a FLUSH_* cause */
+const char *
+stats_flush_name(int cause)
+{
+    switch (cause)
+    {
+        case FLUSH_BTB_MISS:
+            return "btb_miss";
+        case FLUSH_DIRECTION:
+            return "direction";
+        default:
+            return "target";
+    }
+}
+
+/* Mispredictions per thousand retired instructions */
+double
+stats_mpki(const APEX_Stats *stats, int insn_completed)
+{
+    if (insn_completed <= 0)
+    {
+        return 0.0;
+    }
+    return (double)stats->mispredictions * 1000.0 / insn_completed;
+}
+
+/*
+ * Writes every counter to fp
+ *
+ * Returns 0 on success, -1 on a write error
+ */
+int
+stats_save(const APEX_Stats *stats, FILE *fp)
+{
+    if (fwrite(&stats->num_insns, sizeof(stats->num_insns), 1, fp) != 1
+        || fwrite(stats->branches, sizeof(branch_stats), stats->num_insns, fp)
+           != (size_t)stats->num_insns
+        || fwrite(stats->stalls, sizeof(stall_stats), stats->num_insns, fp)
+           != (size_t)stats->num_insns
+        || fwrite(stats->indirect, sizeof(indirect_stats), stats->num_insns, fp)
+           != (size_t)stats->num_insns
+        || fwrite(&stats->mispredictions, sizeof(stats->mispredictions), 1, fp) != 1
+        || fwrite(&stats->flush_cycles, sizeof(stats->flush_cycles), 1, fp) != 1
+        || fwrite(stats->redirects, sizeof(stats->redirects), 1, fp) != 1
+        || fwrite(stats->redirect_cycles, sizeof(stats->redirect_cycles), 1, fp) != 1
+        || fwrite(stats->stall_cycles, sizeof(stats->stall_cycles), 1, fp) != 1
+        || fwrite(&stats->ras, sizeof(stats->ras), 1, fp) != 1
+        || fwrite(&stats->ftq, sizeof(stats->ftq), 1, fp) != 1)
+    {
+        return -1;
+    }
+    return 0;
+}
+
+/*
+ * Reads back counters written by stats_save for a program of the same size
+ *
+ * Returns 0 on success, -1 on a read error or a size mismatch
+ */
+int
+stats_load(APEX_Stats *stats, FILE *fp)
+{
+    int num_insns;
+
+    if (fread(&num_insns, sizeof(num_insns), 1, fp) != 1
+        || num_insns != stats->num_insns)
+    {
+        return -1;
+    }
+    if (fread(stats->branches, sizeof(branch_stats), stats->num_insns, fp)
+           != (size_t)stats->num_insns
+        || fread(stats->stalls, sizeof(stall_stats), stats->num_insns, fp)
+           != (size_t)stats->num_insns
+        || fread(stats->indirect, sizeof(indirect_stats), stats->num_insns, fp)
+           != (size_t)stats->num_insns
+        || fread(&stats->mispredictions, sizeof(stats->mispredictions), 1, fp) != 1
+        || fread(&stats->flush_cycles, sizeof(stats->flush_cycles), 1, fp) != 1
+        || fread(stats->redirects, sizeof(stats->redirects), 1, fp) != 1
+        || fread(stats->redirect_cycles, sizeof(stats->redirect_cycles), 1, fp) != 1
+        || fread(stats->stall_cycles, sizeof(stats->stall_cycles), 1, fp) != 1
+        || fread(&stats->ras, sizeof(stats->ras), 1, fp) != 1
+        || fread(&stats->ftq, sizeof(stats->ftq), 1, fp) != 1)
+    {
+        return -1;
+    }
+    return 0;
+}
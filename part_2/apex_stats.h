@@ -0,0 +1,114 @@
+/*
+ * apex_stats.h
+ * Contains APEX branch and decode stall statistics declarations
+ *
+ * Author:
+ * Copyright (c) 2020, Gaurav Kothari (gkothar1@binghamton.edu)
+ * State University of New York at Binghamton
+ */
+#ifndef _APEX_STATS_H_
+#define _APEX_STATS_H_
+
+#include <stdio.h>
+
+/* Counters kept for every static branch */
+typedef struct branch_stats
+{
+    unsigned long lookups;         /* BTB lookups made at fetch */
+    unsigned long btb_hits;
+    unsigned long executed;        /* times resolved in execute */
+    unsigned long taken;
+    unsigned long pred_taken;      /* fetch followed the target */
+    unsigned long pred_not_taken;  /* fetch fell through */
+    unsigned long correct;
+    unsigned long incorrect;
+    unsigned long flush_cycles;    /* fetch cycles lost to redirects */
+} branch_stats;
+
+/* Distinct targets remembered for every JUMP and JALR */
+#define INDIRECT_SITE_TARGETS 8
+
+/* Target diversity of a JUMP or JALR */
+typedef struct indirect_stats
+{
+    int targets[INDIRECT_SITE_TARGETS]; /* distinct targets in the order first seen */
+    int num_targets;
+    int more_targets;              /* TRUE once a target beyond those was seen */
+    int last_target;
+    unsigned long changes;         /* resolutions to a different target than the last */
+} indirect_stats;
+
+/* Why the front end was redirected */
+#define FLUSH_BTB_MISS 0           /* taken branch with no BTB target to follow */
+#define FLUSH_DIRECTION 1          /* branch direction predicted wrong */
+#define FLUSH_TARGET 2             /* JUMP or JALR target missing or wrong */
+#define FLUSH_NUM_CAUSES 3
+
+/* Why decode held an instruction for a cycle */
+#define STALL_RAW_RS1 0            /* first source still being computed */
+#define STALL_RAW_RS2 1            /* second source still being computed */
+#define STALL_LOAD_USE 2           /* source is the result of a LOAD or LOADP */
+#define STALL_ADDR_UPDATE 3        /* source is the address register LOADP/STOREP bump */
+#define STALL_STRUCTURAL 4         /* register busy with no producer in flight */
+#define STALL_NUM_CAUSES 5
+
+/* Decode stall cycles kept for every instruction */
+typedef struct stall_stats
+{
+    unsigned long cycles[STALL_NUM_CAUSES];
+    int producer;                  /* pc last waited for, 0 if none was in flight */
+} stall_stats;
+
+/* Return address stack counters, kept for calls and returns reaching execute */
+typedef struct ras_stats
+{
+    unsigned long calls;           /* JALR pushes */
+    unsigned long returns;         /* JUMPs through a link register */
+    unsigned long correct;         /* returns fetch followed to the right target */
+    unsigned long incorrect;
+    unsigned long overflows;       /* pushes that dropped the oldest entry */
+    unsigned long underflows;      /* returns with the stack empty */
+} ras_stats;
+
+/* Fetch target queue counters */
+typedef struct ftq_stats
+{
+    unsigned long predictions;     /* instructions the prediction unit predicted */
+    unsigned long run_ahead;       /* of those, predicted in a cycle fetch was held */
+    unsigned long flushed;         /* predictions dropped by redirects */
+    unsigned long occupancy;       /* sum over cycles of the entries waiting for fetch */
+    unsigned long empty;           /* cycles fetch was ready with nothing predicted */
+} ftq_stats;
+
+/* Branch and stall statistics, one slot per code memory word */
+typedef struct APEX_Stats
+{
+    int num_insns;
+    branch_stats *branches;
+    stall_stats *stalls;
+    indirect_stats *indirect;
+    unsigned long mispredictions;
+    unsigned long flush_cycles;
+    unsigned long redirects[FLUSH_NUM_CAUSES];
+    unsigned long redirect_cycles[FLUSH_NUM_CAUSES];
+    unsigned long stall_cycles[STALL_NUM_CAUSES];
+    ras_stats ras;
+    ftq_stats ftq;
+} APEX_Stats;
+
+int stats_init(APEX_Stats *stats, int num_insns);
+void stats_free(APEX_Stats *stats);
+void stats_reset(APEX_Stats *stats);
+branch_stats *stats_branch(APEX_Stats *stats, int pc);
+void stats_record_lookup(APEX_Stats *stats, int pc, int hit);
+void stats_record_outcome(APEX_Stats *stats, int pc, int predicted, int outcome);
+void stats_record_flush(APEX_Stats *stats, int pc, int cause, int cycles);
+void stats_record_stall(APEX_Stats *stats, int pc, int cause, int producer);
+void stats_record_target(APEX_Stats *stats, int pc, int target);
+unsigned long stats_stall_total(const stall_stats *stall);
+const char *stats_stall_name(int cause);
+const char *stats_flush_name(int cause);
+double stats_mpki(const APEX_Stats *stats, int insn_completed);
+int stats_save(const APEX_Stats *stats, FILE *fp);
+int stats_load(APEX_Stats *stats, FILE *fp);
+#endif
@@ -0,0 +1,429 @@
+/*
+ * apex_sweep.c
+ * Simulates one program over a grid of BTB and predictor configurations,
+ * one independent APEX_CPU per grid point spread over a pool of threads,
+ * and writes one CSV row per point
+ *
+ * Author:
+ * Copyright (c) 2020, Gaurav Kothari (gkothar1@binghamton.edu)
+ * State University of New York at Binghamton
+ */
+#include <limits.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "apex_cpu.h"
+
+/* Most values one grid axis can take */
+#define SWEEP_MAX_VALUES 32
+
+/* Cycle limit per point, keeps a program that never halts from hanging the sweep */
+#define SWEEP_DEFAULT_CYCLES 10000000
+
+typedef struct sweep_axis
+{
+    int count;
+    int values[SWEEP_MAX_VALUES];
+} sweep_axis;
+
+/* Result of simulating one grid point */
+typedef struct sweep_point
+{
+    APEX_Config config;
+    int valid;                     /* CPU could be created for this config */
+    int halted;
+    int fault;
+    int cycles;
+    int instructions;
+    unsigned long mispredictions;
+    unsigned long flush_cycles;
+    unsigned long btb_lookups;
+    unsigned long btb_hits;
+    double mpki;
+} sweep_point;
+
+/* Work shared by the pool, next is the only field written after start */
+typedef struct sweep_job
+{
+    const char *filename;
+    int max_cycles;
+    int num_points;
+    sweep_point *points;
+    int next;
+    pthread_mutex_t lock;
+} sweep_job;
+
+/*
+ * Parses one value of an axis into *value
+ *
+ * Returns 0 on success, -1 if token is not a valid value for the axis
+ */
+typedef int (*axis_parser)(const char *token, int *value);
+
+/* Non-negative decimal integer, with nothing after the digits */
+static int
+parse_number(const char *token, int *value)
+{
+    char *end;
+    long number = strtol(token, &end, 10);
+
+    if (end == token || *end != '\0' || number < 0 || number > INT_MAX)
+    {
+        return -1;
+    }
+    *value = (int)number;
+    return 0;
+}
+
+static int
+parse_btb_policy(const char *token, int *value)
+{
+    *value = btb_policy_from_string(token);
+    return *value < 0 ? -1 : 0;
+}
+
+static int
+parse_predictor_kind(const char *token, int *value)
+{
+    *value = predictor_kind_from_string(token);
+    return *value < 0 ? -1 : 0;
+}
+
+/* 0-3, or opcode for COUNTER_INIT_BY_OPCODE */
+static int
+parse_counter_init(const char *token, int *value)
+{
+    if (strcmp(token, "opcode") == 0)
+    {
+        *value = COUNTER_INIT_BY_OPCODE;
+        return 0;
+    }
+    if (token[0] < '0' || token[0] > '3' || token[1] != '\0')
+    {
+        return -1;
+    }
+    *value = token[0] - '0';
+    return 0;
+}
+
+/*
+ * Parses a comma separated list into axis, each value through parser
+ *
+ * Returns 0 on success, -1 on a malformed or too long list or an empty element
+ */
+static int
+parse_axis(sweep_axis *axis, const char *arg, axis_parser parser)
+{
+    char buffer[256];
+    char *token = buffer;
+    char *comma;
+
+    if (strlen(arg) >= sizeof(buffer))
+    {
+        return -1;
+    }
+    strcpy(buffer, arg);
+
+    /* Split by hand, strtok would skip the empty element in "1,,2" */
+    axis->count = 0;
+    while (token != NULL)
+    {
+        comma = strchr(token, ',');
+        if (comma)
+        {
+            *comma = '\0';
+        }
+        if (*token == '\0' || axis->count == SWEEP_MAX_VALUES
+            || parser(token, &axis->values[axis->count]) != 0)
+        {
+            return -1;
+        }
+        axis->count++;
+        token = comma ? comma + 1 : NULL;
+    }
+    return axis->count > 0 ? 0 : -1;
+}
+
+static void
+simulate_point(const sweep_job *job, sweep_point *point)
+{
+    APEX_CPU *cpu = APEX_cpu_init(job->filename, &point->config);
+    int i;
+
+    if (!cpu)
+    {
+        return;
+    }
+
+    point->valid = TRUE;
+    point->halted = APEX_cpu_simulate(cpu, job->max_cycles);
+    point->fault = cpu->fault;
+    point->cycles = cpu->clock;
+    point->instructions = cpu->insn_completed;
+    point->mispredictions = cpu->stats.mispredictions;
+    point->flush_cycles = cpu->stats.flush_cycles;
+    point->mpki = stats_mpki(&cpu->stats, cpu->insn_completed);
+    for (i = 0; i < cpu->stats.num_insns; ++i)
+    {
+        point->btb_lookups += cpu->stats.branches[i].lookups;
+        point->btb_hits += cpu->stats.branches[i].btb_hits;
+    }
+    APEX_cpu_stop(cpu);
+}
+
+/* Pool worker, claims grid points one at a time until none are left */
+static void *
+sweep_worker(void *arg)
+{
+    sweep_job *job = arg;
+    int index;
+
+    while (TRUE)
+    {
+        pthread_mutex_lock(&job->lock);
+        index = job->next++;
+        pthread_mutex_unlock(&job->lock);
+
+        if (index >= job->num_points)
+        {
+            return NULL;
+        }
+        simulate_point(job, &job->points[index]);
+    }
+}
+
+static void
+write_csv(FILE *fp, const sweep_job *job)
+{
+    int i;
+
+    fprintf(fp, "btb_sets,btb_ways,btb_repl,predictor,predictor_bits,history_bits,"
+                "counter_init,status,cycles,instructions,ipc,mispredictions,mpki,"
+                "flush_cycles,btb_lookups,btb_hits\n");
+    for (i = 0; i < job->num_points; ++i)
+    {
+        const sweep_point *point = &job->points[i];
+        const APEX_Config *config = &point->config;
+
+        fprintf(fp, "%d,%d,%s,%s,%d,%d,", config->btb_sets, config->btb_ways,
+                btb_policy_name(config->btb_policy), predictor_name(config->predictor),
+                config->predictor_bits, config->history_bits);
+        if (config->counter_init == COUNTER_INIT_BY_OPCODE)
+        {
+            fprintf(fp, "opcode,");
+        }
+        else
+        {
+            fprintf(fp, "%d,", config->counter_init);
+        }
+
+        if (!point->valid)
+        {
+            fprintf(fp, "invalid,,,,,,,,\n");
+            continue;
+        }
+        fprintf(fp, "%s,%d,%d,%.4f,%lu,%.3f,%lu,%lu,%lu\n",
+                point->fault ? "fault" : point->halted ? "halted" : "stopped", point->cycles,
+                point->instructions,
+                point->cycles ? (double)point->instructions / point->cycles : 0.0,
+                point->mispredictions, point->mpki, point->flush_cycles,
+                point->btb_lookups, point->btb_hits);
+    }
+}
+
+static void
+print_usage(const char *prog)
+{
+    fprintf(stderr, "APEX_Help: Usage %s <input_file> [options]\n", prog);
+    fprintf(stderr, "  Every option but --threads, --cycles and --output takes a comma separated list,\n");
+    fprintf(stderr, "  one simulation is run for each combination of values.\n");
+    fprintf(stderr, "  Options:\n");
+    fprintf(stderr, "    --btb-sets <list>       Number of BTB sets (default %d)\n", BTB_DEFAULT_SETS);
+    fprintf(stderr, "    --btb-ways <list>       Entries per BTB set (default %d)\n", BTB_DEFAULT_WAYS);
+    fprintf(stderr, "    --btb-repl <list>       fifo, lru, plru (default fifo)\n");
+    fprintf(stderr, "    --predictor <list>      bimodal, gshare, pag, pap, tournament, tage (default bimodal)\n");
+    fprintf(stderr, "    --predictor-bits <list> log2 entries of the predictor table (default %d)\n", PREDICTOR_DEFAULT_BITS);
+    fprintf(stderr, "    --history-bits <list>   Branch history length (default %d)\n", PREDICTOR_DEFAULT_HISTORY);
+    fprintf(stderr, "    --counter-init <list>   Counter state of new branches, 0-3 or opcode (default opcode)\n");
+    fprintf(stderr, "    --threads <n>           Worker threads (default: online CPUs)\n");
+    fprintf(stderr, "    --cycles <n>            Cycle limit per simulation (default %d)\n", SWEEP_DEFAULT_CYCLES);
+    fprintf(stderr, "    --output <file>         CSV file (default stdout)\n");
+}
+
+int
+main(int argc, char const *argv[])
+{
+    enum { SETS, WAYS, REPL, PREDICTOR, PREDICTOR_BITS, HISTORY_BITS, COUNTER_INIT, NUM_AXES };
+    static const char *const axis_options[NUM_AXES] = {
+        "--btb-sets", "--btb-ways", "--btb-repl", "--predictor",
+        "--predictor-bits", "--history-bits", "--counter-init",
+    };
+    const axis_parser axis_parsers[NUM_AXES] = {
+        parse_number, parse_number, parse_btb_policy, parse_predictor_kind,
+        parse_number, parse_number, parse_counter_init,
+    };
+    sweep_axis axes[NUM_AXES];
+    APEX_Config defaults;
+    sweep_job job;
+    pthread_t *threads;
+    const char *output = NULL;
+    FILE *fp = stdout;
+    int num_threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    int i, a;
+
+    if (argc < 2)
+    {
+        print_usage(argv[0]);
+        exit(1);
+    }
+
+    APEX_config_init(&defaults);
+    defaults.batch = TRUE;
+    memset(axes, 0, sizeof(axes));
+    axes[SETS].values[0] = defaults.btb_sets;
+    axes[WAYS].values[0] = defaults.btb_ways;
+    axes[REPL].values[0] = defaults.btb_policy;
+    axes[PREDICTOR].values[0] = defaults.predictor;
+    axes[PREDICTOR_BITS].values[0] = defaults.predictor_bits;
+    axes[HISTORY_BITS].values[0] = defaults.history_bits;
+    axes[COUNTER_INIT].values[0] = defaults.counter_init;
+    for (a = 0; a < NUM_AXES; ++a)
+    {
+        axes[a].count = 1;
+    }
+
+    memset(&job, 0, sizeof(job));
+    job.filename = argv[1];
+    job.max_cycles = SWEEP_DEFAULT_CYCLES;
+
+    for (i = 2; i < argc; ++i)
+    {
+        if (i + 1 >= argc)
+        {
+            print_usage(argv[0]);
+            exit(1);
+        }
+        if (strcmp(argv[i], "--threads") == 0)
+        {
+            num_threads = atoi(argv[++i]);
+            continue;
+        }
+        if (strcmp(argv[i], "--cycles") == 0)
+        {
+            job.max_cycles = atoi(argv[++i]);
+            continue;
+        }
+        if (strcmp(argv[i], "--output") == 0)
+        {
+            output = argv[++i];
+            continue;
+        }
+
+        for (a = 0; a < NUM_AXES; ++a)
+        {
+            if (strcmp(argv[i], axis_options[a]) == 0)
+            {
+                break;
+            }
+        }
+        if (a == NUM_AXES)
+        {
+            print_usage(argv[0]);
+            exit(1);
+        }
+        if (parse_axis(&axes[a], argv[i + 1], axis_parsers[a]) != 0)
+        {
+            fprintf(stderr, "APEX_Error: Bad value list for %s: %s\n", argv[i], argv[i + 1]);
+            exit(1);
+        }
+        ++i;
+    }
+    if (num_threads < 1 || job.max_cycles < 0)
+    {
+        print_usage(argv[0]);
+        exit(1);
+    }
+
+    job.num_points = 1;
+    for (a = 0; a < NUM_AXES; ++a)
+    {
+        job.num_points *= axes[a].count;
+    }
+    job.points = calloc(job.num_points, sizeof(sweep_point));
+    if (!job.points)
+    {
+        fprintf(stderr, "APEX_Error: Unable to allocate %d sweep points\n", job.num_points);
+        exit(1);
+    }
+
+    /* Expand the grid, the last axis varies fastest */
+    for (i = 0; i < job.num_points; ++i)
+    {
+        APEX_Config *config = &job.points[i].config;
+        int rest = i;
+        int value[NUM_AXES];
+
+        for (a = NUM_AXES - 1; a >= 0; --a)
+        {
+            value[a] = axes[a].values[rest % axes[a].count];
+            rest /= axes[a].count;
+        }
+        *config = defaults;
+        config->btb_sets = value[SETS];
+        config->btb_ways = value[WAYS];
+        config->btb_policy = value[REPL];
+        config->predictor = value[PREDICTOR];
+        config->predictor_bits = value[PREDICTOR_BITS];
+        config->history_bits = value[HISTORY_BITS];
+        config->counter_init = value[COUNTER_INIT];
+    }
+
+    if (num_threads > job.num_points)
+    {
+        num_threads = job.num_points;
+    }
+    threads = calloc(num_threads, sizeof(pthread_t));
+    if (!threads)
+    {
+        fprintf(stderr, "APEX_Error: Unable to allocate %d threads\n", num_threads);
+        exit(1);
+    }
+    pthread_mutex_init(&job.lock, NULL);
+    for (i = 0; i < num_threads; ++i)
+    {
+        if (pthread_create(&threads[i], NULL, sweep_worker, &job) != 0)
+        {
+            fprintf(stderr, "APEX_Error: Unable to start sweep thread\n");
+            exit(1);
+        }
+    }
+    for (i = 0; i < num_threads; ++i)
+    {
+        pthread_join(threads[i], NULL);
+    }
+    pthread_mutex_destroy(&job.lock);
+
+    if (output)
+    {
+        fp = fopen(output, "w");
+        if (!fp)
+        {
+            fprintf(stderr, "APEX_Error: Unable to create %s\n", output);
+            exit(1);
+        }
+    }
+    write_csv(fp, &job);
+    if (output)
+    {
+        fclose(fp);
+    }
+
+    fprintf(stderr, "APEX_Sweep: configurations = %d threads = %d\n",
+            job.num_points, num_threads);
+    free(threads);
+    free(job.points);
+    return 0;
+}
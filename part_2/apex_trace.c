@@ -0,0 +1,162 @@
+/*
+ * apex_trace.c
+ * Contains APEX branch trace file implementation
+ *
+ * Author:
+ * Copyright (c) 2020, Gaurav Kothari (gkothar1@binghamton.edu)
+ * State University of New York at Binghamton
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "apex_trace.h"
+#include "apex_macros.h"
+
+static void
+trace_flush(APEX_Trace *trace)
+{
+    if (trace->count > 0)
+    {
+        fwrite(trace->buffer, sizeof(trace_record), trace->count, trace->fp);
+        trace->count = 0;
+    }
+}
+
+/*
+ * Creates path and writes the trace header
+ *
+ * Returns 0 on success, -1 if the file cannot be created
+ */
+int
+trace_open_write(APEX_Trace *trace, const char *path)
+{
+    trace_header header;
+
+    memset(trace, 0, sizeof(APEX_Trace));
+    trace->fp = fopen(path, "wb");
+    if (!trace->fp)
+    {
+        return -1;
+    }
+    trace->writing = TRUE;
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, TRACE_MAGIC, sizeof(header.magic));
+    header.version = TRACE_VERSION;
+    header.record_size = sizeof(trace_record);
+    if (fwrite(&header, sizeof(header), 1, trace->fp) != 1)
+    {
+        fclose(trace->fp);
+        trace->fp = NULL;
+        return -1;
+    }
+    return 0;
+}
+
+/*
+ * Opens path and checks its header
+ *
+ * Returns 0 on success, -1 if the file is missing or is not a trace of this
+ * version
+ */
+int
+trace_open_read(APEX_Trace *trace, const char *path)
+{
+    trace_header header;
+
+    memset(trace, 0, sizeof(APEX_Trace));
+    trace->fp = fopen(path, "rb");
+    if (!trace->fp)
+    {
+        return -1;
+    }
+
+    if (fread(&header, sizeof(header), 1, trace->fp) != 1
+        || memcmp(header.magic, TRACE_MAGIC, sizeof(header.magic)) != 0
+        || header.version != TRACE_VERSION
+        || header.record_size != sizeof(trace_record))
+    {
+        fclose(trace->fp);
+        trace->fp = NULL;
+        return -1;
+    }
+    return 0;
+}
+
+/*
+ * Appends a resolved branch. rd, rs1 and imm are the instruction's own
+ * fields, kept so a replay can tell calls and returns apart.
+ */
+void
+trace_write(APEX_Trace *trace, int pc, int target, int opcode, int outcome,
+            int rd, int rs1, int imm)
+{
+    trace_record *record = &trace->buffer[trace->count++];
+
+    record->pc = pc;
+    record->target = target;
+    record->opcode = (uint8_t)opcode;
+    record->outcome = (uint8_t)outcome;
+    record->rd = (uint8_t)rd;
+    record->rs1 = (uint8_t)rs1;
+    record->imm = imm;
+    trace->total++;
+
+    if (trace->count == TRACE_BUFFER_RECORDS)
+    {
+        trace_flush(trace);
+    }
+}
+
+/*
+ * Returns the next record, or NULL at the end of the trace. The record stays
+ * valid until the next call.
+ */
+const trace_record *
+trace_read(APEX_Trace *trace)
+{
+    if (trace->next == trace->count)
+    {
+        trace->count = fread(trace->buffer, sizeof(trace_record),
+                             TRACE_BUFFER_RECORDS, trace->fp);
+        trace->next = 0;
+        if (trace->count == 0)
+        {
+            return NULL;
+        }
+    }
+    trace->total++;
+    return &trace->buffer[trace->next++];
+}
+
+/*
+ * Flushes buffered records of a trace being written and closes the file
+ *
+ * Returns 0 on success, -1 if a write failed
+ */
+int
+trace_close(APEX_Trace *trace)
+{
+    int ret = 0;
+
+    if (!trace->fp)
+    {
+        return 0;
+    }
+
+    if (trace->writing)
+    {
+        trace_flush(trace);
+    }
+    if (ferror(trace->fp))
+    {
+        ret = -1;
+    }
+    if (fclose(trace->fp) != 0)
+    {
+        ret = -1;
+    }
+    trace->fp = NULL;
+    return ret;
+}
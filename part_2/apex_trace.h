@@ -0,0 +1,60 @@
+/*
+ * apex_trace.h
+ * Contains APEX branch trace file declarations
+ *
+ * Author:
+ * Copyright (c) 2020, Gaurav Kothari (gkothar1@binghamton.edu)
+ * State University of New York at Binghamton
+ */
+#ifndef _APEX_TRACE_H_
+#define _APEX_TRACE_H_
+
+#include <stdio.h>
+#include <stdint.h>
+
+/*
+ * A trace file is a trace_header followed by one trace_record per resolved
+ * branch, in the order execute resolved them. Fields are in host byte order.
+ */
+#define TRACE_MAGIC "APXT"
+#define TRACE_VERSION 2
+
+/* Records buffered between writes and reads */
+#define TRACE_BUFFER_RECORDS 4096
+
+typedef struct trace_header
+{
+    char magic[4];
+    uint32_t version;
+    uint32_t record_size;
+    uint32_t reserved;
+} trace_header;
+
+typedef struct trace_record
+{
+    int32_t pc;
+    int32_t target;                /* target address, taken or not */
+    int32_t imm;
+    uint8_t opcode;
+    uint8_t outcome;               /* TAKEN or NOT_TAKEN */
+    uint8_t rd;                    /* register a JALR links through */
+    uint8_t rs1;                   /* register a JUMP or JALR jumps through */
+} trace_record;
+
+typedef struct APEX_Trace
+{
+    FILE *fp;
+    int writing;
+    int count;                     /* records held in buffer */
+    int next;                      /* reader: next record to hand out */
+    unsigned long total;           /* records written or read so far */
+    trace_record buffer[TRACE_BUFFER_RECORDS];
+} APEX_Trace;
+
+int trace_open_write(APEX_Trace *trace, const char *path);
+int trace_open_read(APEX_Trace *trace, const char *path);
+void trace_write(APEX_Trace *trace, int pc, int target, int opcode, int outcome,
+                 int rd, int rs1, int imm);
+const trace_record *trace_read(APEX_Trace *trace);
+int trace_close(APEX_Trace *trace);
+#endif
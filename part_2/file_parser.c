@@ -3,287 +3,667 @@
  * Contains functions to parse input file and create code memory, you can edit
  * this file to add new instructions
  *
+ * The input is memory mapped and scanned once, one instruction per line.
+ * Mnemonic and operands are separated by spaces, tabs or commas; registers
+ * are written Rn and immediates #n (the # may be left out). An empty line is
+ * a NOP.
+ *
+ * A line may start with a label, "name:", and text from ';' or "//" to the
+ * end of the line is a comment. A line holding only a label or a comment
+ * takes no space in code memory. A label can stand in for any immediate:
+ * BZ, BNZ, BP, BNP, BN and BNN get the offset from their own pc, everything
+ * else the label's address. ".data addr, v1, v2, ..." seeds data memory with
+ * v1 at addr, v2 at addr + 4 and so on; a label on that line names addr.
+ *
  * Author:
  * Copyright (c) 2020, Gaurav Kothari (gkothar1@binghamton.edu)
  * State University of New York at Binghamton
  */
-#include <assert.h>
+#include <fcntl.h>
+#include <stdarg.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 #include "apex_cpu.h"
 #include "apex_macros.h"
 
+/* Distance between consecutive words of a .data directive */
+#define DATA_WORD_STRIDE 4
+
+/* A label definition, name points into the mapped file */
+typedef struct symbol
+{
+    const char *name;
+    int len;
+    int value;
+} symbol;
+
+/* An immediate naming a label, patched once every label is known */
+typedef struct fixup
+{
+    const char *name;
+    int len;
+    int line;
+    int column;
+    int index;                     /* instruction or .data word to patch */
+    int is_data;
+    int relative;                  /* branch offset from the instruction's pc */
+} fixup;
+
+/* Cursor over the mapped input file and everything decoded so far */
+typedef struct parser
+{
+    const char *filename;
+    const char *pos;
+    const char *end;
+    const char *line_start;
+    int line;
+    APEX_Instruction *code;
+    int code_size;
+    int code_capacity;
+    APEX_Data_Init *data;
+    int data_size;
+    int data_capacity;
+    symbol *symbols;
+    int num_symbols;
+    int symbols_capacity;
+    int *buckets;                  /* symbol index + 1, 0 when empty */
+    int num_buckets;               /* power of two */
+    fixup *fixups;
+    int num_fixups;
+    int fixups_capacity;
+} parser;
+
 /*
- * This function is related to parsing input file
+ * Operands each opcode takes, in source order: d = rd, s = rs1, t = rs2,
+ * i = immediate
+ */
+static const char *
+operand_layout(int opcode)
+{
+    switch (opcode)
+    {
+        case OPCODE_ADD:
+        case OPCODE_SUB:
+        case OPCODE_MUL:
+        case OPCODE_DIV:
+        case OPCODE_AND:
+        case OPCODE_OR:
+        case OPCODE_XOR:
+            return "dst";
+        case OPCODE_ADDL:
+        case OPCODE_SUBL:
+        case OPCODE_JALR:
+        case OPCODE_LOAD:
+        case OPCODE_LOADP:
+            return "dsi";
+        case OPCODE_MOVC:
+            return "di";
+        case OPCODE_CML:
+        case OPCODE_JUMP:
+            return "si";
+        case OPCODE_CMP:
+            return "st";
+        case OPCODE_STORE:
+        case OPCODE_STOREP:
+            return "sti";
+        case OPCODE_BZ:
+        case OPCODE_BNZ:
+        case OPCODE_BP:
+        case OPCODE_BNP:
+        case OPCODE_BN:
+        case OPCODE_BNN:
+            return "i";
+        default:
+            return "";
+    }
+}
+
+static void
+report_error(const parser *p, int line, int column, const char *fmt, va_list args)
+{
+    fprintf(stderr, "APEX_Error: %s:%d:%d: ", p->filename, line, column);
+    vfprintf(stderr, fmt, args);
+    fprintf(stderr, "\n");
+}
+
+/* Reports an error at the character at on the current line */
+static void
+parse_error(const parser *p, const char *at, const char *fmt, ...)
+{
+    va_list args;
+
+    va_start(args, fmt);
+    report_error(p, p->line, (int)(at - p->line_start) + 1, fmt, args);
+    va_end(args);
+}
+
+static void
+fixup_error(const parser *p, const fixup *fix, const char *fmt, ...)
+{
+    va_list args;
+
+    va_start(args, fmt);
+    report_error(p, fix->line, fix->column, fmt, args);
+    va_end(args);
+}
+
+/*
+ * Makes room for one more element in a growable array, doubling it when full
  *
- * Note : You are not supposed to edit this function
+ * Returns 0 on success, -1 on allocation failure
  */
 static int
-get_num_from_string(const char *buffer)
+reserve(void **array, int *capacity, int count, size_t elem_size)
 {
-    char str[16];
-    int i, j = 0;
+    int grown = *capacity ? *capacity * 2 : 64;
+    void *resized;
 
-    for (i = 1; buffer[i] != '\0'; ++i)
+    if (count < *capacity)
+    {
+        return 0;
+    }
+    resized = realloc(*array, grown * elem_size);
+    if (!resized)
     {
-        str[j] = buffer[i];
-        j++;
+        fprintf(stderr, "APEX_Error: Out of memory while loading the program\n");
+        return -1;
     }
-    str[j] = '\0';
+    *array = resized;
+    *capacity = grown;
+    return 0;
+}
+
+static int
+is_separator(char c)
+{
+    return c == ' ' || c == '\t' || c == '\r' || c == ',';
+}
 
-    return atoi(str);
+static int
+is_comment(const parser *p, const char *at)
+{
+    return *at == ';' || (*at == '/' && at + 1 < p->end && at[1] == '/');
+}
+
+static int
+is_label_char(char c, int first)
+{
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_'
+           || c == '.' || (!first && c >= '0' && c <= '9');
+}
+
+static int
+is_label_name(const char *name, int len)
+{
+    int i;
+
+    for (i = 0; i < len; ++i)
+    {
+        if (!is_label_char(name[i], i == 0))
+        {
+            return FALSE;
+        }
+    }
+    return len > 0;
 }
 
 /*
- * This function sets the numeric opcode to an instruction based on string value
+ * Finds the next token on the current line. A comment ends the line.
  *
- * Note : you can edit this function to add new instructions
+ * Returns its length with *token pointing at it, or 0 at the end of the line
  */
 static int
-set_opcode_str(const char *opcode_str)
+next_token(parser *p, const char **token)
 {
-    if (strcmp(opcode_str, "ADD") == 0)
+    const char *start;
+
+    while (p->pos < p->end && is_separator(*p->pos))
     {
-        return OPCODE_ADD;
+        p->pos++;
     }
-
-    if (strcmp(opcode_str, "SUB") == 0)
+    if (p->pos < p->end && is_comment(p, p->pos))
     {
-        return OPCODE_SUB;
+        while (p->pos < p->end && *p->pos != '\n')
+        {
+            p->pos++;
+        }
     }
-
-    if (strcmp(opcode_str, "MUL") == 0)
+    start = p->pos;
+    while (p->pos < p->end && *p->pos != '\n' && *p->pos != ';'
+           && !is_separator(*p->pos))
     {
-        return OPCODE_MUL;
+        p->pos++;
     }
+    *token = start;
+    return (int)(p->pos - start);
+}
+
+static uint32_t
+hash_name(const char *name, int len)
+{
+    uint32_t hash = 2166136261u;
+    int i;
 
-    if (strcmp(opcode_str, "DIV") == 0)
+    for (i = 0; i < len; ++i)
     {
-        return OPCODE_DIV;
+        hash = (hash ^ (unsigned char)name[i]) * 16777619u;
     }
+    return hash;
+}
+
+/* Returns the bucket holding name, or the empty bucket where it belongs */
+static int *
+find_bucket(const parser *p, const char *name, int len)
+{
+    uint32_t mask = (uint32_t)p->num_buckets - 1;
+    uint32_t slot = hash_name(name, len) & mask;
 
-    if (strcmp(opcode_str, "AND") == 0)
+    while (p->buckets[slot])
     {
-        return OPCODE_AND;
+        const symbol *sym = &p->symbols[p->buckets[slot] - 1];
+
+        if (sym->len == len && memcmp(sym->name, name, len) == 0)
+        {
+            break;
+        }
+        slot = (slot + 1) & mask;
     }
+    return &p->buckets[slot];
+}
+
+/*
+ * Defines label name with value, keeping the hash table at most half full
+ *
+ * Returns 0 on success, -1 after reporting a bad or duplicate label
+ */
+static int
+define_label(parser *p, const char *name, int len, int value)
+{
+    int *bucket;
+    int i;
 
-    if (strcmp(opcode_str, "OR") == 0)
+    if (!is_label_name(name, len))
     {
-        return OPCODE_OR;
+        parse_error(p, name, "invalid label '%.*s'", len, name);
+        return -1;
     }
-
-    if (strcmp(opcode_str, "EXOR") == 0 || strcmp(opcode_str, "EX-OR") == 0)
+    if ((p->num_symbols + 1) * 2 > p->num_buckets)
     {
-        return OPCODE_XOR;
+        int *old = p->buckets;
+
+        p->num_buckets = p->num_buckets ? p->num_buckets * 2 : 64;
+        p->buckets = calloc(p->num_buckets, sizeof(int));
+        free(old);
+        if (!p->buckets)
+        {
+            fprintf(stderr, "APEX_Error: Out of memory while loading the program\n");
+            return -1;
+        }
+        for (i = 0; i < p->num_symbols; ++i)
+        {
+            *find_bucket(p, p->symbols[i].name, p->symbols[i].len) = i + 1;
+        }
     }
 
-    if (strcmp(opcode_str, "MOVC") == 0)
+    bucket = find_bucket(p, name, len);
+    if (*bucket)
     {
-        return OPCODE_MOVC;
+        parse_error(p, name, "label '%.*s' is already defined", len, name);
+        return -1;
     }
-
-    if (strcmp(opcode_str, "LOAD") == 0)
+    if (reserve((void **)&p->symbols, &p->symbols_capacity, p->num_symbols,
+                sizeof(symbol)) != 0)
     {
-        return OPCODE_LOAD;
+        return -1;
     }
+    p->symbols[p->num_symbols].name = name;
+    p->symbols[p->num_symbols].len = len;
+    p->symbols[p->num_symbols].value = value;
+    *bucket = ++p->num_symbols;
+    return 0;
+}
+
+/* Records that the given instruction or .data word takes label's value */
+static int
+add_fixup(parser *p, const char *name, int len, int index, int is_data,
+          int relative)
+{
+    fixup *fix;
 
-    if (strcmp(opcode_str, "STORE") == 0)
+    if (reserve((void **)&p->fixups, &p->fixups_capacity, p->num_fixups,
+                sizeof(fixup)) != 0)
     {
-        return OPCODE_STORE;
+        return -1;
     }
+    fix = &p->fixups[p->num_fixups++];
+    fix->name = name;
+    fix->len = len;
+    fix->line = p->line;
+    fix->column = (int)(name - p->line_start) + 1;
+    fix->index = index;
+    fix->is_data = is_data;
+    fix->relative = relative;
+    return 0;
+}
 
-    if (strcmp(opcode_str, "BZ") == 0)
+/*
+ * Parses the digits of a number, optionally signed when negative_ok
+ *
+ * Returns 0 on success, -1 after reporting a malformed number
+ */
+static int
+parse_number(const parser *p, const char *token, int len, const char *digits,
+             int negative_ok, long limit, int *value)
+{
+    const char *q = digits;
+    const char *end = token + len;
+    int negative = FALSE;
+    long number = 0;
+
+    if (negative_ok && q < end && (*q == '-' || *q == '+'))
     {
-        return OPCODE_BZ;
+        negative = (*q == '-');
+        q++;
     }
-
-    if (strcmp(opcode_str, "BNZ") == 0)
+    if (q == end)
     {
-        return OPCODE_BNZ;
+        parse_error(p, token, "missing number in '%.*s'", len, token);
+        return -1;
     }
-
-    if (strcmp(opcode_str, "HALT") == 10 || strcmp(opcode_str, "HALT") == 0)
+    for (; q < end; ++q)
     {
-        return OPCODE_HALT;
+        if (*q < '0' || *q > '9')
+        {
+            parse_error(p, q, "invalid digit in '%.*s'", len, token);
+            return -1;
+        }
+        number = number * 10 + (*q - '0');
+        if (number > limit + 1)
+        {
+            parse_error(p, token, "'%.*s' is out of range", len, token);
+            return -1;
+        }
     }
-    if (strcmp(opcode_str, "NOP") == 10 || strcmp(opcode_str, "NOP") == 0 || strcmp(opcode_str, "")==0)
+    if (negative)
     {
-        return OPCODE_NOP;
+        number = -number;
     }
-    if (strcmp(opcode_str, "ADDL") == 0)
+    if (number > limit)
     {
-        return OPCODE_ADDL;
+        parse_error(p, token, "'%.*s' is out of range", len, token);
+        return -1;
     }
-    if (strcmp(opcode_str, "SUBL") == 0)
+    *value = (int)number;
+    return 0;
+}
+
+static int
+parse_register(const parser *p, const char *token, int len, int *value)
+{
+    if (*token != 'R' && *token != 'r')
     {
-        return OPCODE_SUBL;
+        parse_error(p, token, "expected a register, found '%.*s'", len, token);
+        return -1;
     }
-    if (strcmp(opcode_str, "STOREP") == 0)
+    return parse_number(p, token, len, token + 1, FALSE, REG_FILE_SIZE - 1, value);
+}
+
+/*
+ * Parses an immediate: a signed number with or without '#', or a label whose
+ * value is filled in by a fixup recorded against index
+ *
+ * Returns 0 on success, -1 after reporting an error
+ */
+static int
+parse_immediate(parser *p, const char *token, int len, int index, int is_data,
+                int relative, int *value)
+{
+    const char *body = (*token == '#') ? token + 1 : token;
+    int body_len = len - (int)(body - token);
+
+    if (body_len > 0 && is_label_char(*body, TRUE))
     {
-        return OPCODE_STOREP;
+        if (!is_label_name(body, body_len))
+        {
+            parse_error(p, token, "invalid label '%.*s'", len, token);
+            return -1;
+        }
+        *value = 0;
+        return add_fixup(p, body, body_len, index, is_data, relative);
     }
-    if (strcmp(opcode_str, "LOADP") == 0)
+    return parse_number(p, token, len, body, TRUE, 0x7fffffffL, value);
+}
+
+/*
+ * Decodes the instruction starting with mnemonic token into a new code
+ * memory slot
+ *
+ * Returns 0 on success, -1 after reporting an error
+ */
+static int
+parse_instruction(parser *p, const char *token, int len)
+{
+    APEX_Instruction *ins;
+    const char *layout;
+    int opcode, value, relative;
+
+    opcode = get_opcode_from_name(token, len);
+    if (opcode < 0)
     {
-        return OPCODE_LOADP;
+        parse_error(p, token, "unknown opcode '%.*s'", len, token);
+        return -1;
     }
-    // define OPCODE_CML 0x12
-    if (strcmp(opcode_str, "CML") == 0)
+    if (reserve((void **)&p->code, &p->code_capacity, p->code_size,
+                sizeof(APEX_Instruction)) != 0)
     {
-        return OPCODE_CML;
+        return -1;
     }
+    ins = &p->code[p->code_size];
+    memset(ins, 0, sizeof(APEX_Instruction));
+    ins->opcode = opcode;
+    ins->flags = get_opcode_flags(opcode);
 
-// #define OPCODE_CMP 0x13
- if (strcmp(opcode_str, "CMP") == 0)
+    /* Branches without a base register take a pc relative offset */
+    relative = (ins->flags & INSN_BRANCH) && !(ins->flags & INSN_READS_RS1);
+
+    for (layout = operand_layout(opcode); *layout; ++layout)
     {
-        return OPCODE_CMP;
+        len = next_token(p, &token);
+        if (len == 0)
+        {
+            parse_error(p, token, "missing operand for %s", get_opcode_name(opcode));
+            return -1;
+        }
+        if (*layout == 'i')
+        {
+            if (parse_immediate(p, token, len, p->code_size, FALSE, relative,
+                                &value) != 0)
+            {
+                return -1;
+            }
+            ins->imm = value;
+            continue;
+        }
+        if (parse_register(p, token, len, &value) != 0)
+        {
+            return -1;
+        }
+        switch (*layout)
+        {
+            case 'd':
+                ins->rd = value;
+                break;
+            case 's':
+                ins->rs1 = value;
+                break;
+            default:
+                ins->rs2 = value;
+                break;
+        }
     }
-// #define OPCODE_BP 0x14
- if (strcmp(opcode_str, "BP") == 0)
+
+    len = next_token(p, &token);
+    if (len != 0)
     {
-        return OPCODE_BP;
+        parse_error(p, token, "unexpected operand '%.*s' for %s", len, token,
+                    get_opcode_name(opcode));
+        return -1;
     }
-// #define OPCODE_BNP 0x15
- if (strcmp(opcode_str, "BNP") == 0)
+    p->code_size++;
+    return 0;
+}
+
+/*
+ * Decodes ".data addr, v1, ..." after the directive, defining label (if any)
+ * as addr
+ *
+ * Returns 0 on success, -1 after reporting an error
+ */
+static int
+parse_data(parser *p, const char *directive, const char *label, int label_len)
+{
+    const char *token;
+    int len, address, value;
+    int words = 0;
+
+    len = next_token(p, &token);
+    if (len == 0)
     {
-        return OPCODE_BNP;
+        parse_error(p, directive, "missing address for .data");
+        return -1;
     }
-// #define OPCODE_BN 0x16
- if (strcmp(opcode_str, "BN") == 0)
+    if (parse_number(p, token, len, *token == '#' ? token + 1 : token, FALSE,
+                     0x7fffffffL, &address) != 0)
     {
-        return OPCODE_BN;
+        return -1;
     }
-// #define OPCODE_BNN 0x17
- if (strcmp(opcode_str, "BNN") == 0)
+    if (label && define_label(p, label, label_len, address) != 0)
     {
-        return OPCODE_BNN;
+        return -1;
     }
-// #define OPCODE_JUMP 0x18
- if (strcmp(opcode_str, "JUMP") == 0)
+
+    while ((len = next_token(p, &token)) != 0)
     {
-        return OPCODE_JUMP;
+        if (reserve((void **)&p->data, &p->data_capacity, p->data_size,
+                    sizeof(APEX_Data_Init)) != 0
+            || parse_immediate(p, token, len, p->data_size, TRUE, FALSE, &value) != 0)
+        {
+            return -1;
+        }
+        p->data[p->data_size].address = address + words * DATA_WORD_STRIDE;
+        p->data[p->data_size].value = value;
+        p->data_size++;
+        words++;
     }
-// #define OPCODE_JALR 0x19
- if (strcmp(opcode_str, "JALR") == 0)
+    if (words == 0)
     {
-        return OPCODE_JALR;
+        parse_error(p, token, "missing value for .data");
+        return -1;
     }
- 
-    assert(0 && "Invalid opcode");
     return 0;
 }
 
-static void
-create_APEX_instruction(APEX_Instruction *ins, char *buffer)
+/*
+ * Decodes the current line, leaving the parser at its end
+ *
+ * Returns 0 on success, -1 after reporting an error
+ */
+static int
+parse_line(parser *p)
 {
-    int i, token_num = 0;
-    char tokens[6][128];
+    const char *token;
+    const char *label = NULL;
+    int label_len = 0;
+    int len;
 
-    // Initialize tokens buffer
-    for (i = 0; i < 6; ++i)
+    while (p->pos < p->end && is_separator(*p->pos))
+    {
+        p->pos++;
+    }
+    if (p->pos == p->end || *p->pos == '\n')
     {
-        strcpy(tokens[i], "");
+        /* A blank line has always been a NOP */
+        if (reserve((void **)&p->code, &p->code_capacity, p->code_size,
+                    sizeof(APEX_Instruction)) != 0)
+        {
+            return -1;
+        }
+        memset(&p->code[p->code_size], 0, sizeof(APEX_Instruction));
+        p->code[p->code_size].opcode = OPCODE_NOP;
+        p->code[p->code_size].flags = get_opcode_flags(OPCODE_NOP);
+        p->code_size++;
+        return 0;
     }
 
-    char *token = strtok(buffer, " ,\n");
+    len = next_token(p, &token);
+    if (len > 0 && token[len - 1] == ':')
+    {
+        label = token;
+        label_len = len - 1;
+        len = next_token(p, &token);
+    }
 
-    while (token != NULL)
+    if (len == 5 && memcmp(token, ".data", 5) == 0)
+    {
+        return parse_data(p, token, label, label_len);
+    }
+    if (len > 0 && *token == '.')
+    {
+        parse_error(p, token, "unknown directive '%.*s'", len, token);
+        return -1;
+    }
+    if (label && define_label(p, label, label_len,
+                              CODE_MEMORY_BASE + 4 * p->code_size) != 0)
     {
-        strcpy(tokens[token_num], token);
-        token_num++;
-        token = strtok(NULL, " ,\n");
+        return -1;
     }
+    return len > 0 ? parse_instruction(p, token, len) : 0;
+}
 
-    // Set opcode
-    strcpy(ins->opcode_str, tokens[0]);
-    ins->opcode = set_opcode_str(ins->opcode_str);
+/*
+ * Patches every label operand once the whole file is read
+ *
+ * Returns 0 on success, -1 after reporting an undefined label
+ */
+static int
+resolve_fixups(parser *p)
+{
+    int i;
 
-    // Handle different opcodes based on the number of tokens
-    switch (ins->opcode)
+    for (i = 0; i < p->num_fixups; ++i)
     {
-        case OPCODE_ADD:
-        case OPCODE_SUB:
-        case OPCODE_MUL:
-        case OPCODE_DIV:
-        case OPCODE_AND:
-        case OPCODE_OR:
-        case OPCODE_XOR:
-        {
-            ins->rd = get_num_from_string(tokens[1]);
-            ins->rs1 = get_num_from_string(tokens[2]);
-            ins->rs2 = get_num_from_string(tokens[3]);
-            break;
-        }
-        case OPCODE_ADDL:
-        case OPCODE_SUBL:
-        case OPCODE_JALR:
-        {
-            ins->rd = get_num_from_string(tokens[1]);
-            ins->rs1 = get_num_from_string(tokens[2]);
-            ins->rs2 = 0;
-            ins->imm = get_num_from_string(tokens[3]);
-            break;
-        }
-        case OPCODE_MOVC:
-        {
-            ins->rd = get_num_from_string(tokens[1]);
-            ins->imm = get_num_from_string(tokens[2]);
-            break;
-        }
-        case OPCODE_CML:
-        case OPCODE_JUMP:
-        {
-            ins->rs1 = get_num_from_string(tokens[1]);
-            ins->imm = get_num_from_string(tokens[2]);
-            break;
-        }
-        case OPCODE_CMP:
-        {
-            ins->rs1 = get_num_from_string(tokens[1]);
-            ins->rs2 = get_num_from_string(tokens[2]);
-            break;
-        }
-        case OPCODE_LOAD:
-        case OPCODE_LOADP:
-        {
-            ins->rd = get_num_from_string(tokens[1]);
-            ins->rs1 = get_num_from_string(tokens[2]);
-            ins->imm = get_num_from_string(tokens[3]);
-            break;
-        }
-        case OPCODE_STORE:
-        case OPCODE_STOREP:
-        {
-            ins->rs1 = get_num_from_string(tokens[1]);
-            ins->rs2 = get_num_from_string(tokens[2]);
-            ins->imm = get_num_from_string(tokens[3]);
-            break;
-        }
-        case OPCODE_BZ:
-        case OPCODE_BNZ:
-        case OPCODE_BP:
-        case OPCODE_BNP:
-        case OPCODE_BN:
-        case OPCODE_BNN:
+        const fixup *fix = &p->fixups[i];
+        int *bucket = p->num_buckets ? find_bucket(p, fix->name, fix->len) : NULL;
+        int value;
+
+        if (!bucket || !*bucket)
         {
-            ins->imm = get_num_from_string(tokens[1]);
-            break;
+            fixup_error(p, fix, "undefined label '%.*s'", fix->len, fix->name);
+            return -1;
         }
-        case OPCODE_NOP:
-        case OPCODE_HALT:
+        value = p->symbols[*bucket - 1].value;
+        if (fix->is_data)
         {
-            break;
+            p->data[fix->index].value = value;
         }
-        default:
+        else
         {
-            // Invalid opcode
-            printf("Invalid opcode_str: %s\n", ins->opcode_str);
-            assert(0 && "Invalid opcode");
-            break;
+            if (fix->relative)
+            {
+                value -= CODE_MEMORY_BASE + 4 * fix->index;
+            }
+            p->code[fix->index].imm = value;
         }
     }
+    return 0;
 }
+
 // static void
 // split_opcode_from_insn_string(char *buffer, char tokens[2][128])
 // {
@@ -412,58 +792,97 @@ create_APEX_instruction(APEX_Instruction *ins, char *buffer)
 // }
 
 /*
- * This function is related to parsing input file
+ * Maps filename and decodes it into a newly allocated code memory, growing
+ * the array as lines are read. Parse errors are reported with their line and
+ * column.
  *
- * Note : You are not supposed to edit this function
+ * Returns the code memory with its length in *size and the .data words in
+ * *data (NULL when there are none), or NULL if the file cannot be read, is
+ * empty or contains an error
  */
 APEX_Instruction *
-create_code_memory(const char *filename, int *size)
+create_code_memory(const char *filename, int *size, APEX_Data_Init **data,
+                   int *data_size)
 {
-    FILE *fp;
-    ssize_t nread;
-    size_t len = 0;
-    char *line = NULL;
-    int code_memory_size = 0;
-    int current_instruction = 0;
-    APEX_Instruction *code_memory;
-
+    int fd;
+    struct stat st;
+    char *map;
+    parser p;
+    int ret = 0;
+
+    *size = 0;
+    *data = NULL;
+    *data_size = 0;
     if (!filename)
     {
         return NULL;
     }
 
-    fp = fopen(filename, "r");
-    if (!fp)
+    fd = open(filename, O_RDONLY);
+    if (fd < 0)
     {
+        fprintf(stderr, "APEX_Error: Unable to open %s\n", filename);
         return NULL;
     }
-
-    while ((nread = getline(&line, &len, fp)) != -1)
+    if (fstat(fd, &st) != 0 || st.st_size == 0)
     {
-        code_memory_size++;
+        close(fd);
+        return NULL;
     }
-    *size = code_memory_size;
-    if (!code_memory_size)
+    map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED)
     {
-        fclose(fp);
+        fprintf(stderr, "APEX_Error: Unable to read %s\n", filename);
         return NULL;
     }
+    madvise(map, st.st_size, MADV_SEQUENTIAL);
 
-    code_memory = calloc(code_memory_size, sizeof(APEX_Instruction));
-    if (!code_memory)
+    memset(&p, 0, sizeof(parser));
+    p.filename = filename;
+    p.pos = map;
+    p.end = map + st.st_size;
+
+    /* Most instructions take 10 to 20 characters */
+    p.code_capacity = (int)(st.st_size / 12) + 16;
+    p.code = malloc(p.code_capacity * sizeof(APEX_Instruction));
+    if (!p.code)
     {
-        fclose(fp);
-        return NULL;
+        ret = -1;
+    }
+
+    while (ret == 0 && p.pos < p.end)
+    {
+        p.line_start = p.pos;
+        p.line++;
+        ret = parse_line(&p);
+
+        /* Step past the newline */
+        p.pos++;
+    }
+    if (ret == 0)
+    {
+        ret = resolve_fixups(&p);
+    }
+    if (ret == 0 && p.code_size == 0)
+    {
+        fprintf(stderr, "APEX_Error: %s holds no instructions\n", filename);
+        ret = -1;
     }
 
-    rewind(fp);
-    while ((nread = getline(&line, &len, fp)) != -1)
+    munmap(map, st.st_size);
+    free(p.symbols);
+    free(p.buckets);
+    free(p.fixups);
+    if (ret != 0)
     {
-        create_APEX_instruction(&code_memory[current_instruction], line);
-        current_instruction++;
+        free(p.code);
+        free(p.data);
+        return NULL;
     }
 
-    free(line);
-    fclose(fp);
-    return code_memory;
-}
\ No newline at end of file
+    *size = p.code_size;
+    *data = p.data;
+    *data_size = p.data_size;
+    return p.code;
+}
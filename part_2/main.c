@@ -10,39 +10,239 @@
 #include<string.h>
 #include "apex_cpu.h"
 
+static void
+print_usage(const char *prog)
+{
+    fprintf(stderr, "APEX_Help: Usage %s <input_file> [simulate <num_cycles>] [options]\n", prog);
+    fprintf(stderr, "  To run the code: %s <input_file>\n", prog);
+    fprintf(stderr, "  To simulate with a specific number of cycles: %s <input_file> simulate <num_cycles>\n", prog);
+    fprintf(stderr, "  Options:\n");
+    fprintf(stderr, "    --batch             Run without per-cycle output or single stepping, print a summary at the end\n");
+    fprintf(stderr, "    --btb-sets <n>      Number of BTB sets, power of two (default %d)\n", BTB_DEFAULT_SETS);
+    fprintf(stderr, "    --btb-ways <n>      Entries per BTB set (default %d)\n", BTB_DEFAULT_WAYS);
+    fprintf(stderr, "    --btb-repl <policy> BTB replacement: fifo, lru or plru (default fifo)\n");
+    fprintf(stderr, "    --predictor <name>  Direction predictor: bimodal, gshare, pag, pap, tournament or tage (default bimodal)\n");
+    fprintf(stderr, "    --predictor-bits <n> log2 entries of the predictor table (default %d)\n", PREDICTOR_DEFAULT_BITS);
+    fprintf(stderr, "    --history-bits <n>  Branch history length (default %d)\n", PREDICTOR_DEFAULT_HISTORY);
+    fprintf(stderr, "    --indirect-bits <n> log2 entries of the JUMP/JALR target predictor, 0 disables it (default %d)\n", INDIRECT_DEFAULT_BITS);
+    fprintf(stderr, "    --ras-depth <n>     Return address stack entries, 0 disables return prediction (default %d)\n", RAS_DEFAULT_DEPTH);
+    fprintf(stderr, "    --ftq-depth <n>     Predictions the front end runs ahead of fetch, 0 keeps them in lock step (default %d)\n", FTQ_DEFAULT_DEPTH);
+    fprintf(stderr, "    --no-decode-redirect Leave taken branches that missed in the BTB for execute to redirect\n");
+    fprintf(stderr, "    --core <name>       Back end: inorder (five stage pipeline) or ooo (default inorder)\n");
+    fprintf(stderr, "    --width <n>         Out-of-order fetch, rename, issue and commit width, 1-%d (default %d)\n",
+            OOO_MAX_WIDTH, OOO_DEFAULT_WIDTH);
+    fprintf(stderr, "    --rob-size <n>      Out-of-order reorder buffer entries, up to %d (default %d)\n",
+            OOO_MAX_ROB, OOO_DEFAULT_ROB);
+    fprintf(stderr, "    --iq-size <n>       Out-of-order issue queue entries, up to the ROB size (default %d)\n",
+            OOO_DEFAULT_IQ);
+    fprintf(stderr, "    --phys-regs <n>     Out-of-order physical registers, up to %d (default %d)\n",
+            OOO_MAX_PHYS_REGS, OOO_DEFAULT_PHYS_REGS);
+    fprintf(stderr, "    --branch-checkpoints <n> Out-of-order rename map checkpoints, up to %d (default %d)\n",
+            OOO_MAX_CHECKPOINTS, OOO_DEFAULT_CHECKPOINTS);
+    fprintf(stderr, "    --counter-init <s>  Counter state of new branches, 0-3 or opcode (default opcode: BNZ/BP 3, BZ/BNP 0)\n");
+    fprintf(stderr, "    --memory-size <n>   Data memory size in words (default %d)\n", DATA_MEMORY_SIZE);
+    fprintf(stderr, "    --forward-ports <n> Results execute and memory each forward per cycle, 0-%d (default %d)\n",
+            FORWARD_MAX_PORTS, FORWARD_DEFAULT_PORTS);
+    fprintf(stderr, "    --stats-file <file> Write per-branch statistics as CSV when the run ends\n");
+    fprintf(stderr, "    --checkpoint <cycle> <file> Save the complete simulation state after the given cycle\n");
+    fprintf(stderr, "    --restore <file>    Resume from a checkpoint taken with the same program and options\n");
+    fprintf(stderr, "    --fast-forward <n>  Execute the first n instructions functionally, warming the BTB and predictor\n");
+    fprintf(stderr, "    --sample <n>        With --fast-forward and --batch, time n cycles then fast forward again, repeatedly\n");
+    fprintf(stderr, "    --trace <file>      Record every resolved branch to a binary trace for apex_replay\n");
+    fprintf(stderr, "    --kanata <file>     Write the per-instruction pipeline timeline as a Kanata log\n");
+    fprintf(stderr, "    --events <n> <file> Keep the last n pipeline events and write them to file when the run ends\n");
+}
+
 int
 main(int argc, char const *argv[])
 {
     APEX_CPU *cpu;
+    APEX_Config config;
+    int num_cycles = 0;
+    int i;
 
     fprintf(stderr, "APEX CPU Pipeline Simulator v%0.1lf\n", VERSION);
 
-    if (argc != 2 && (argc != 4 || strcmp(argv[2], "simulate") != 0))
+    if (argc < 2)
     {
-        fprintf(stderr, "APEX_Help: Usage %s <input_file>\n", argv[0]);
-        fprintf(stderr, "  To run the code: %s <input_file>\n", argv[0]);
-        fprintf(stderr, "  To simulate with a specific number of cycles: %s <input_file> simulate <num_cycles>\n", argv[0]);
+        print_usage(argv[0]);
         exit(1);
     }
 
-    cpu = APEX_cpu_init(argv[1]);
+    APEX_config_init(&config);
+    for (i = 2; i < argc; ++i)
+    {
+        if (strcmp(argv[i], "simulate") == 0 && i + 1 < argc)
+        {
+            num_cycles = atoi(argv[++i]);
+            if (num_cycles <= 0) {
+                fprintf(stderr, "APEX_Error: Invalid number of cycles\n");
+                exit(1);
+            }
+        }
+        else if (strcmp(argv[i], "--batch") == 0)
+        {
+            config.batch = TRUE;
+        }
+        else if (strcmp(argv[i], "--btb-sets") == 0 && i + 1 < argc)
+        {
+            config.btb_sets = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--btb-ways") == 0 && i + 1 < argc)
+        {
+            config.btb_ways = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--btb-repl") == 0 && i + 1 < argc)
+        {
+            config.btb_policy = btb_policy_from_string(argv[++i]);
+            if (config.btb_policy < 0)
+            {
+                fprintf(stderr, "APEX_Error: Unknown BTB replacement policy %s\n", argv[i]);
+                exit(1);
+            }
+        }
+        else if (strcmp(argv[i], "--predictor") == 0 && i + 1 < argc)
+        {
+            config.predictor = predictor_kind_from_string(argv[++i]);
+            if (config.predictor < 0)
+            {
+                fprintf(stderr, "APEX_Error: Unknown branch predictor %s\n", argv[i]);
+                exit(1);
+            }
+        }
+        else if (strcmp(argv[i], "--predictor-bits") == 0 && i + 1 < argc)
+        {
+            config.predictor_bits = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--history-bits") == 0 && i + 1 < argc)
+        {
+            config.history_bits = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--indirect-bits") == 0 && i + 1 < argc)
+        {
+            config.indirect_bits = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--ras-depth") == 0 && i + 1 < argc)
+        {
+            config.ras_depth = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--ftq-depth") == 0 && i + 1 < argc)
+        {
+            config.ftq_depth = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--no-decode-redirect") == 0)
+        {
+            config.decode_redirect = FALSE;
+        }
+        else if (strcmp(argv[i], "--core") == 0 && i + 1 < argc)
+        {
+            ++i;
+            if (strcmp(argv[i], "inorder") == 0)
+            {
+                config.core = CORE_INORDER;
+            }
+            else if (strcmp(argv[i], "ooo") == 0)
+            {
+                config.core = CORE_OOO;
+            }
+            else
+            {
+                fprintf(stderr, "APEX_Error: Unknown core %s\n", argv[i]);
+                exit(1);
+            }
+        }
+        else if (strcmp(argv[i], "--width") == 0 && i + 1 < argc)
+        {
+            config.ooo_width = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--rob-size") == 0 && i + 1 < argc)
+        {
+            config.rob_size = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--iq-size") == 0 && i + 1 < argc)
+        {
+            config.iq_size = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--phys-regs") == 0 && i + 1 < argc)
+        {
+            config.phys_regs = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--branch-checkpoints") == 0 && i + 1 < argc)
+        {
+            config.branch_checkpoints = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--counter-init") == 0 && i + 1 < argc)
+        {
+            ++i;
+            config.counter_init = strcmp(argv[i], "opcode") == 0
+                                  ? COUNTER_INIT_BY_OPCODE : atoi(argv[i]);
+        }
+        else if (strcmp(argv[i], "--fast-forward") == 0 && i + 1 < argc)
+        {
+            config.fast_forward = strtoul(argv[++i], NULL, 10);
+        }
+        else if (strcmp(argv[i], "--sample") == 0 && i + 1 < argc)
+        {
+            config.sample_cycles = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--checkpoint") == 0 && i + 2 < argc)
+        {
+            config.checkpoint_cycle = atoi(argv[++i]);
+            config.checkpoint_file = argv[++i];
+        }
+        else if (strcmp(argv[i], "--restore") == 0 && i + 1 < argc)
+        {
+            config.restore_file = argv[++i];
+        }
+        else if (strcmp(argv[i], "--memory-size") == 0 && i + 1 < argc)
+        {
+            config.memory_size = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--forward-ports") == 0 && i + 1 < argc)
+        {
+            config.forward_ports = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--stats-file") == 0 && i + 1 < argc)
+        {
+            config.stats_file = argv[++i];
+        }
+        else if (strcmp(argv[i], "--trace") == 0 && i + 1 < argc)
+        {
+            config.trace_file = argv[++i];
+        }
+        else if (strcmp(argv[i], "--kanata") == 0 && i + 1 < argc)
+        {
+            config.kanata_file = argv[++i];
+        }
+        else if (strcmp(argv[i], "--events") == 0 && i + 2 < argc)
+        {
+            config.events = atoi(argv[++i]);
+            config.events_file = argv[++i];
+            if (config.events <= 0)
+            {
+                fprintf(stderr, "APEX_Error: Invalid number of pipeline events\n");
+                exit(1);
+            }
+        }
+        else
+        {
+            print_usage(argv[0]);
+            exit(1);
+        }
+    }
+
+    cpu = APEX_cpu_init(argv[1], &config);
     if (!cpu)
     {
         fprintf(stderr, "APEX_Error: Unable to initialize CPU\n");
         exit(1);
     }
-    if (argc == 4) {
-        int num_cycles = atoi(argv[3]);
-        if (num_cycles <= 0) {
-            fprintf(stderr, "APEX_Error: Invalid number of cycles\n");
-            exit(1);
-        }
+    if (num_cycles > 0) {
         simulate_cpu_for_cycles(cpu, num_cycles);
     } else {
         APEX_cpu_run(cpu);
     }
 
-    //APEX_cpu_run(cpu);
     APEX_cpu_stop(cpu);
     return 0;
-}
\ No newline at end of file
+}
@@ -0,0 +1,17 @@
+; options: --btb-ways 1
+; expect: Simulation Complete, cycles = [0-9]* instructions = 13$
+;
+; With a single BTB entry, fetch follows BNZ on the last iteration from the
+; entry its first instance trained, then decoding BZ evicts that entry before
+; BNZ executes. The not taken BNZ must still send fetch back to HALT, or the
+; loop never ends.
+        MOVC R1,#2
+        MOVC R5,#100
+loop:   LOAD R2,R5,#0
+        ADDL R3,R2,#1
+        BZ far
+        SUBL R1,R1,#1
+        BNZ loop
+        HALT
+far:    MOVC R7,#99
+        HALT